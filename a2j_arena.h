@@ -0,0 +1,110 @@
+/** \file
+Static memory arena of arduino2j.
+
+All buffers of arduino2j are carved out of one statically allocated struct (#a2j_arena),
+whose layout is fixed at compile time by the enabled features and the settings below.
+This keeps the RAM footprint of arduino2j in one place and makes it visible in the map file as a single symbol.
+
+Define A2J_ARENA_REPORT to print the size of every consumer while compiling arduino2j.c.
+With A2J_MEMINFO the sizes and the stack high-water mark can be queried at runtime (see #a2jMemInfo).
+
+The transport buffers are owned by the serial library and LUFA respectively and therefore not part of the arena.
+Service initiated frames (#a2jSendSif) are sent directly from the caller's memory and need no buffer either.*/
+
+#ifndef A2J_ARENA_H
+#define A2J_ARENA_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include "arduino2j.h"
+#include "a2j_debug.h"
+#include "a2j_prof.h"
+#include "a2j_capture.h"
+#include "a2j_subs.h"
+
+/** @name Arena consumers
+Sizes in bytes of the buffers in #a2j_arena (0 if the consumer is disabled). */
+//@{
+/** Frame buffer of #a2jProcess. Holds the payload of a request and the reply built in place. */
+#define A2J_ARENA_FRAME (A2J_MAX_PAYLOAD + 1)
+#ifdef A2J_DBG
+	/** Ring buffer of the debugging driver. */
+	#define A2J_ARENA_DBG A2J_DBG_CNT
+#else
+	#define A2J_ARENA_DBG 0
+#endif
+#ifdef A2J_FWUPDATE
+	/** Double buffered flash pages of the firmware update. */
+	#define A2J_ARENA_FW (2 * SPM_PAGESIZE)
+#else
+	#define A2J_ARENA_FW 0
+#endif
+#ifdef A2J_FASTPATH
+	/** Request and reply of the command executed by the receiver. */
+	#define A2J_ARENA_FAST A2J_FAST_PAYLOAD
+#else
+	#define A2J_ARENA_FAST 0
+#endif
+#ifdef A2J_PROF
+	/** Ring buffer of the PC-sampling profiler. */
+	#define A2J_ARENA_PROF (2 * A2J_PROF_CNT)
+#else
+	#define A2J_ARENA_PROF 0
+#endif
+#ifdef A2J_CAPTURE
+	/** Ring buffer of the traffic capture. */
+	#define A2J_ARENA_CAPTURE A2J_CAPTURE_CNT
+#else
+	#define A2J_ARENA_CAPTURE 0
+#endif
+#ifdef A2J_SUBS
+	/** Subscription table and payload of the SIF pushing the changed values. */
+	#define A2J_ARENA_SUBS (A2J_SUBS_CNT * sizeof(a2j_sub) + A2J_SUBS_SIF_LEN)
+#else
+	#define A2J_ARENA_SUBS 0
+#endif
+#ifdef A2J_PREFETCH
+	/** Chunk of a sequential a2jMany read prepared ahead of its request. */
+	#define A2J_ARENA_PREFETCH A2J_MANY_PAYLOAD
+#else
+	#define A2J_ARENA_PREFETCH 0
+#endif
+//@}
+
+/** Layout of the arena. */
+typedef struct{
+	uint8_t frame[A2J_ARENA_FRAME]; /**< See #A2J_ARENA_FRAME. */
+#ifdef A2J_DBG
+	uint8_t dbg[A2J_ARENA_DBG]; /**< See #A2J_ARENA_DBG. */
+#endif
+#ifdef A2J_FWUPDATE
+	uint8_t fw[2][SPM_PAGESIZE]; /**< See #A2J_ARENA_FW. */
+#endif
+#ifdef A2J_FASTPATH
+	uint8_t fast[A2J_ARENA_FAST]; /**< See #A2J_ARENA_FAST. */
+#endif
+#ifdef A2J_PROF
+	uint8_t prof[A2J_ARENA_PROF]; /**< See #A2J_ARENA_PROF. */
+#endif
+#ifdef A2J_CAPTURE
+	uint8_t capture[A2J_ARENA_CAPTURE]; /**< See #A2J_ARENA_CAPTURE. */
+#endif
+#ifdef A2J_SUBS
+	a2j_sub subs[A2J_SUBS_CNT]; /**< See #A2J_ARENA_SUBS. */
+	uint8_t subsSif[A2J_SUBS_SIF_LEN]; /**< See #A2J_ARENA_SUBS. */
+#endif
+#ifdef A2J_PREFETCH
+	uint8_t prefetch[A2J_ARENA_PREFETCH]; /**< See #A2J_ARENA_PREFETCH. */
+#endif
+}a2j_arena_t;
+
+extern a2j_arena_t a2j_arena;
+
+#ifdef A2J_MEMINFO
+#ifndef A2J_STACK_CANARY
+/** Pattern the unused RAM is painted with at startup to find the stack high-water mark. */
+#define A2J_STACK_CANARY 0xC5
+#endif
+#endif // A2J_MEMINFO
+
+#endif // A2J_ARENA_H
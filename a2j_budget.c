@@ -0,0 +1,204 @@
+/** \file
+Execution budgets (see a2j_budget.h).
+
+The timer detecting overruns of running commands is only available with the Timer1 clock of a2j_time.c,
+other clocks (A2J_TIME_EXTERN, the host build and the link simulator) detect overruns when the command returns. */
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_BUDGET
+
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "arduino2j.h"
+#include "a2j_budget.h"
+#include "a2j_time.h"
+
+#if !defined(A2J_TIME_EXTERN) && !defined(A2J_HOST) && !defined(A2J_LINKSIM)
+	/** Overruns are detected by compare unit B of Timer1. */
+	#define A2J_BUDGET_TIMER
+#endif
+#if defined(A2J_BUDGET_WDT) && !defined(A2J_BUDGET_TIMER)
+	#error "A2J_BUDGET_WDT requires the Timer1 clock of a2j_time.c"
+#endif
+
+#ifdef A2J_BUDGET_WDT
+#include <avr/wdt.h>
+
+/** Marks #hungFunc as valid. */
+#define A2J_BUDGET_MAGIC 0xB7D6
+
+/** @name Command that was running when the watchdog was started
+Not initialized at startup, so they survive the reset. */
+//@{
+static uint16_t hungMagic __attribute__((section(".noinit")));
+static uint8_t hungFunc __attribute__((section(".noinit")));
+//@}
+/** MCUSR at startup, which is cleared to disable the watchdog. */
+static uint8_t resetCause __attribute__((section(".noinit")));
+/** Number of watchdog resets caused by overruns since power-on, valid if #resetsMagic is #A2J_BUDGET_MAGIC. */
+static uint8_t resets __attribute__((section(".noinit")));
+static uint16_t resetsMagic __attribute__((section(".noinit")));
+
+/** Disables the watchdog, which stays enabled after it reset the device. */
+void a2jBudgetWdtOff(void) __attribute__((naked, used, section(".init3")));
+void a2jBudgetWdtOff(void){
+	resetCause = MCUSR;
+	MCUSR = 0;
+	wdt_disable();
+}
+#endif // A2J_BUDGET_WDT
+
+/** The command being executed. */
+static volatile struct{
+	bool active;
+	bool late; /**< The timer detected the overrun. */
+	uint8_t func;
+	uint32_t start;
+	uint32_t budget; /**< In ticks of #a2jTime. */
+}run;
+
+/** @name Statistics reported by #a2jBudgetStats */
+//@{
+static uint16_t overruns = 0;
+static volatile uint16_t sendDrops = 0;
+#ifndef A2J_BUDGET_WDT
+static const uint8_t resets = 0;
+#endif
+static uint8_t lastFunc = 0;
+static uint32_t lastTicks = 0;
+//@}
+
+#ifdef A2J_SIF
+/** Pending overrun report. */
+static bool alertPending = false;
+static uint8_t alert[6];
+#endif // A2J_SIF
+
+/** Records an overrun of the command at jumptable offset \a func, which took \a ticks. */
+static void a2jBudgetRecord(uint8_t func, uint32_t ticks, uint8_t flags){
+	if(overruns != 0xFFFF)
+		overruns++;
+	lastFunc = func;
+	lastTicks = ticks;
+#ifdef A2J_SIF
+	// a newer overrun replaces one that has not been sent yet
+	alert[0] = func;
+	a2jPutU32(alert + 1, ticks);
+	alert[5] = flags;
+	alertPending = true;
+#endif // A2J_SIF
+}
+
+#ifdef A2J_BUDGET_TIMER
+ISR(TIMER1_COMPB_vect){
+	// the compare value is the lower 16 bit of the deadline, hence it matches once per timer period
+	if((int32_t)(a2jTime() - run.start - run.budget) < 0)
+		return;
+	TIMSK1 &= ~_BV(OCIE1B);
+	run.late = true;
+#ifdef A2J_BUDGET_WDT
+	hungFunc = run.func;
+	hungMagic = A2J_BUDGET_MAGIC;
+	wdt_enable(A2J_BUDGET_WDT);
+#endif // A2J_BUDGET_WDT
+}
+#endif // A2J_BUDGET_TIMER
+
+void a2jBudgetStart(uint8_t func, uint8_t flags){
+	uint8_t cls = (flags & A2J_JT_BUDGET_MASK) >> A2J_JT_BUDGET_SHIFT;
+	if(cls == 0)
+		cls = (A2J_BUDGET_DEFAULT & A2J_JT_BUDGET_MASK) >> A2J_JT_BUDGET_SHIFT;
+	if(cls == 0)
+		return;
+
+	run.func = func;
+	run.late = false;
+	run.budget = (uint32_t)(A2J_TIME_HZ / 1000) << (cls - 1);
+	run.start = a2jTime();
+	run.active = true;
+#ifdef A2J_BUDGET_TIMER
+	OCR1B = (uint16_t)(run.start + run.budget);
+	TIFR1 = _BV(OCF1B);
+	TIMSK1 |= _BV(OCIE1B);
+#endif // A2J_BUDGET_TIMER
+}
+
+void a2jBudgetStop(void){
+	if(!run.active)
+		return;
+	uint32_t ticks = a2jTime() - run.start;
+#ifdef A2J_BUDGET_TIMER
+	TIMSK1 &= ~_BV(OCIE1B);
+#endif // A2J_BUDGET_TIMER
+#ifdef A2J_BUDGET_WDT
+	if(run.late){
+		wdt_disable();
+		hungMagic = 0;
+	}
+#endif // A2J_BUDGET_WDT
+	run.active = false;
+	if(ticks > run.budget)
+		a2jBudgetRecord(run.func, ticks, run.late ? A2J_BUDGET_LATE : 0);
+}
+
+void a2jBudgetPoll(void){
+#ifdef A2J_BUDGET_WDT
+	static bool checked = false;
+	if(!checked){
+		checked = true;
+		if(resetsMagic != A2J_BUDGET_MAGIC || (resetCause & _BV(PORF))){
+			resets = 0;
+			resetsMagic = A2J_BUDGET_MAGIC;
+		}
+		if((resetCause & _BV(WDRF)) && hungMagic == A2J_BUDGET_MAGIC){
+			if(resets != 0xFF)
+				resets++;
+			a2jBudgetRecord(hungFunc, 0xFFFFFFFFUL, A2J_BUDGET_LATE | A2J_BUDGET_RESET);
+		}
+		hungMagic = 0;
+	}
+#endif // A2J_BUDGET_WDT
+#ifdef A2J_SIF
+	if(alertPending && a2jSendSif(A2J_BUDGET_SIF, sizeof(alert), alert) == 0)
+		alertPending = false;
+#endif // A2J_SIF
+}
+
+void a2jBudgetSendDrop(void){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if(sendDrops != 0xFFFF)
+			sendDrops++;
+	}
+}
+
+/** Reports the overruns of the execution budgets (see a2j_budget.h).
+The reply consists of
+- number of overruns (2 byte little-endian, saturated)
+- number of frames that were not sent because the link did not become ready (2 byte little-endian, saturated)
+- number of watchdog resets caused by overruns since power-on (1 byte, saturated)
+- jumptable offset of the command that overran last (1 byte)
+- its execution time in ticks of #a2jTime (4 byte little-endian, 0xFFFFFFFF if it never returned)
+- ticks of #a2jTime per second (4 byte little-endian) */
+uint8_t a2jBudgetStats(uint8_t *const lenp, uint8_t* *const datap){
+	uint8_t* p = *datap;
+	a2jPutU16(p, overruns);
+	uint16_t drops;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		drops = sendDrops;
+	}
+	a2jPutU16(p + 2, drops);
+	p[4] = resets;
+	p[5] = lastFunc;
+	a2jPutU32(p + 6, lastTicks);
+	a2jPutU32(p + 10, A2J_TIME_HZ);
+	*lenp = 14;
+	return 0;
+}
+
+#endif // A2J_BUDGET
+#endif // A2J
@@ -0,0 +1,64 @@
+/** \file
+Execution budgets header.
+
+Commands declare an execution budget with #A2J_JT_BUDGET in their \ref jtflags "command flags", e.g.
+\code
+#define MY_CMDS(CMD, LCMD) CMD(readSensor, A2J_JT_IDEMPOTENT | A2J_JT_BUDGET(5)) LCMD(readLog, A2J_JT_BUDGET(20))
+\endcode
+Requests of #a2jMany inherit the budget of the addressed function, commands without one get #A2J_BUDGET_DEFAULT.
+#a2jProcess measures the execution time of every command with a budget. If it exceeds the budget,
+the overrun is counted (see #a2jBudgetStats) and reported in a service initiated frame with the command #A2J_BUDGET_SIF
+(if A2J_SIF is defined), whose payload consists of
+- the jumptable offset of the command (of the addressed function for #a2jMany) (1 byte)
+- the execution time in ticks of #a2jTime (4 byte little-endian, 0xFFFFFFFF if the command never returned)
+- \ref A2J_BUDGET_LATE "overrun flags" (1 byte).
+
+On the AVR compare unit B of Timer1 (which drives #a2jTime) fires at the end of the budget while the command is still running.
+If #A2J_BUDGET_WDT is defined, the watchdog is started then and resets the device unless the command returns in time.
+The overrun is reported after the reset with #A2J_BUDGET_RESET set.
+In that case the watchdog is disabled early during startup, so A2J_BUDGET_WDT must not be defined if the application uses it. */
+
+#ifndef A2J_BUDGET_H
+#define A2J_BUDGET_H
+
+#include <stdint.h>
+
+#ifdef A2J_BUDGET
+
+#if !defined(A2J_JT_FLAGS) || !defined(A2J_TIME)
+	#error "A2J_BUDGET requires A2J_JT_FLAGS and A2J_TIME"
+#endif
+
+/** @name Budget settings */
+//@{
+#ifndef A2J_BUDGET_DEFAULT
+/** Budget of commands declared without one, e.g. A2J_JT_BUDGET(100) (0 for none). */
+#define A2J_BUDGET_DEFAULT 0
+#endif
+#ifndef A2J_BUDGET_SIF
+/** Command of the SIFs reporting overruns. */
+#define A2J_BUDGET_SIF 0xE1
+#endif
+#ifdef DOXYGEN
+/** Watchdog timeout (e.g. WDTO_500MS) started when a command overruns its budget. Undefined by default. */
+#define A2J_BUDGET_WDT
+#endif
+//@}
+
+/** @name Overrun flags */
+//@{
+#define A2J_BUDGET_LATE (1<<0) /**< The overrun was detected by the timer while the command was running. */
+#define A2J_BUDGET_RESET (1<<1) /**< The watchdog reset the device while the command was running. */
+//@}
+
+/** Starts measuring the execution of the command at jumptable offset \a func with the \ref jtflags "command flags" \a flags. */
+void a2jBudgetStart(uint8_t func, uint8_t flags);
+/** Stops measuring the command started last and records an overrun. */
+void a2jBudgetStop(void);
+/** Sends a pending overrun report (called by #a2jProcess). */
+void a2jBudgetPoll(void);
+/** Counts a frame that could not be sent because the link did not become ready. May be called in interrupt context. */
+void a2jBudgetSendDrop(void);
+
+#endif // A2J_BUDGET
+#endif // A2J_BUDGET_H
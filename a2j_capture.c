@@ -0,0 +1,115 @@
+/** \file
+Traffic capture.
+
+Records the bytes received by the low level implementation with their timestamps into a ring buffer in #a2j_arena
+(see a2j_capture.h for the \ref capturetrace "record format"), so the traffic of a host in the field can be replayed
+against a host-native build later (see host/a2jreplay.c).
+The host starts and stops the capture and drains the records with #a2jCapture.
+Records are dropped (and counted) while the ring buffer is full, the time of the next record includes the gap.
+The requests draining the capture are captured as well. */
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_CAPTURE
+
+#include <stdbool.h>
+#include <util/atomic.h>
+#include "arduino2j.h"
+#include "a2j_capture.h"
+#include "a2j_arena.h"
+#include "a2j_time.h"
+
+/** All index operations are ANDed with this mask. */
+#define A2J_CAPTURE_MSK (A2J_CAPTURE_CNT - 1)
+
+/** @name Ring buffer indices
+Written by #a2jCaptureByte resp. #a2jCapture only. */
+//@{
+static volatile uint8_t captureWr = 0;
+static volatile uint8_t captureRd = 0;
+//@}
+/** Number of records dropped because the ring buffer was full (saturates at 255). */
+static volatile uint8_t captureLost = 0;
+static volatile bool captureOn = false;
+/** Time the previous record refers to. */
+static uint32_t captureLast;
+
+void a2jCaptureByte(uint8_t c){
+	if(!captureOn)
+		return;
+
+	uint32_t delta = (a2jTime() - captureLast) >> A2J_CAPTURE_SHIFT;
+	uint8_t rec[A2J_CAPTURE_REC_MAX];
+	uint8_t len = 0;
+	uint32_t v = delta;
+	while(v >= 0x80){
+		rec[len++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	rec[len++] = v;
+	rec[len++] = c;
+
+	uint8_t wr = captureWr;
+	if((uint8_t)((captureRd - wr - 1) & A2J_CAPTURE_MSK) < len){
+		if(captureLost != 0xFF)
+			captureLost++;
+		return;
+	}
+	for(uint8_t i = 0; i < len; i++){
+		a2j_arena.capture[wr] = rec[i];
+		wr = (wr + 1) & A2J_CAPTURE_MSK;
+	}
+	captureWr = wr;
+	// keep the remainder, so the rounding does not accumulate
+	captureLast += delta << A2J_CAPTURE_SHIFT;
+}
+
+/**@ingroup j2amany
+Controls the capture and drains its records.
+
+A write of one byte starts (non-zero) or stops (zero) the capture. Starting discards all records so far.
+The reply to a write contains the number of time units per second of the records (4 byte little-endian integer).
+A read returns the number of records dropped since the last read (1 byte, saturated at 255)
+followed by the recorded bytes (oldest first), which are removed from the ring buffer.
+Records may be split between reads. The offset is ignored. \a isLastp is set if the ring buffer has been emptied. */
+uint8_t a2jCapture(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	(void)offset;
+	uint8_t* data = *datap;
+	if(isWrite){
+		if(*lenp != 1)
+			return -1;
+		captureOn = false;
+		if(data[0]){
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+				captureRd = captureWr;
+				captureLost = 0;
+				captureLast = a2jTime();
+				captureOn = true;
+			}
+		}
+		a2jPutU32(data, A2J_TIME_HZ >> A2J_CAPTURE_SHIFT);
+		*lenp = 4;
+		return 0;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		data[0] = captureLost;
+		captureLost = 0;
+	}
+	uint8_t len = 1;
+	uint8_t rd = captureRd;
+	uint8_t wr = captureWr;
+	while(rd != wr && len < A2J_MANY_PAYLOAD){
+		data[len++] = a2j_arena.capture[rd];
+		rd = (rd + 1) & A2J_CAPTURE_MSK;
+	}
+	captureRd = rd;
+	*isLastp = (rd == captureWr);
+	*lenp = len;
+	return 0;
+}
+
+#endif // A2J_CAPTURE
+#endif // A2J
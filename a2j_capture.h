@@ -0,0 +1,54 @@
+/** \file
+Traffic capture header.
+
+\anchor capturetrace
+Every byte received by the low level implementation is recorded together with the time it was read
+(not the time it arrived on the wire, bytes buffered by the transport share the time they are fetched).
+A record consists of the time since the previous record in units of 2^#A2J_CAPTURE_SHIFT ticks of #a2jTime
+as unsigned LEB128 number (7 bits per byte, least significant group first, bit 7 set if another byte follows),
+followed by the received byte. The first record after starting the capture is relative to the start.
+
+A trace file (as written by host/a2jcapture.cpp and read by host/a2jreplay.c) consists of
+- the magic "A2JC" and the version #A2J_CAPTURE_VERSION (1 byte)
+- the number of units per second (4 byte little-endian)
+- the records, oldest first.*/
+
+#ifndef A2J_CAPTURE_H
+#define A2J_CAPTURE_H
+
+#include <stdint.h>
+
+#ifdef A2J_CAPTURE
+
+#ifndef A2J_TIME
+	#error "A2J_CAPTURE requires A2J_TIME"
+#endif
+
+/** @name Capture settings */
+//@{
+#ifndef A2J_CAPTURE_CNT
+/** Size of the ring buffer in bytes (i.e. about half as many captured bytes). Needs to be a power of two not larger than 256. */
+#define A2J_CAPTURE_CNT 128
+#endif
+#if A2J_CAPTURE_CNT > 256 || (A2J_CAPTURE_CNT & (A2J_CAPTURE_CNT - 1))
+	#error "A2J_CAPTURE_CNT needs to be a power of two not larger than 256"
+#endif
+#ifndef A2J_CAPTURE_SHIFT
+/** Resolution of the recorded times: one unit are 2^A2J_CAPTURE_SHIFT ticks of #a2jTime (8 us at the default 2 MHz). */
+#define A2J_CAPTURE_SHIFT 4
+#endif
+//@}
+
+/** Version of the trace file format. */
+#define A2J_CAPTURE_VERSION 1
+/** Maximum length of a record (5 bytes of time and the data byte). */
+#define A2J_CAPTURE_REC_MAX 6
+
+/** Records the received byte \a c if the capture is running.
+Called by the low level implementations for every byte they hand to arduino2j. */
+void a2jCaptureByte(uint8_t c);
+
+#else
+	#define a2jCaptureByte(c)
+#endif // A2J_CAPTURE
+#endif // A2J_CAPTURE_H
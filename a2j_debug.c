@@ -7,18 +7,16 @@ Debugging driver.*/
 #include <stdlib.h>
 #include <avr/pgmspace.h>
 #include "a2j_debug.h"
+#include "a2j_arena.h"
 
 /** @name Buffer related variables
 These are responsible to control access to the debug buffer */
 //@{
-/** The number of characters the debug buffer can hold.
-Needs to be a number of two. */
-#define A2J_DBG_CNT 256
 /** All index operations are ANDed with this mask to emulate modulo.
-Therefore it has to match #A2J_DBG_CNT, and #A2J_DBG_CNT needs to be a power of two.*/
-#define A2J_DBG_MSK (0xFF)
-/** Buffer of #A2J_DBG_CNT bytes/characters organized as ring buffer */
-static uint8_t buf[A2J_DBG_CNT];
+Therefore #A2J_DBG_CNT needs to be a power of two.*/
+#define A2J_DBG_MSK (A2J_DBG_CNT - 1)
+/** Buffer of #A2J_DBG_CNT bytes/characters organized as ring buffer (in #a2j_arena). */
+#define buf (a2j_arena.dbg)
 /** Index for read operations.*/
 static uint8_t rdOff = 0;
 /** Index for write operations.*/
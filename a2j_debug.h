@@ -6,6 +6,15 @@ Debugging driver header.*/
 
 #ifdef A2J_DBG
 
+#ifndef A2J_DBG_CNT
+/** The number of characters the debug buffer can hold.
+Needs to be a power of two not larger than 256. */
+#define A2J_DBG_CNT 256
+#endif
+#if A2J_DBG_CNT > 256 || (A2J_DBG_CNT & (A2J_DBG_CNT - 1))
+#error "A2J_DBG_CNT needs to be a power of two not larger than 256"
+#endif
+
 uint8_t rdCnt(void);
 uint8_t wrCnt(void);
 uint8_t wr(char c);
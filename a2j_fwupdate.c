@@ -0,0 +1,283 @@
+/** \file
+Firmware update via arduino2j.
+
+The new image is written by the host with #a2jFwUpdate to a staging area in flash (#A2J_FW_START).
+Chunks have to be sent in order. The last chunk is followed by the CRC-16 (CRC-CCITT as used by
+#A2J_CSUM_CRC16, little-endian) of the whole image.
+
+Received data is collected in two page buffers in RAM, full pages are programmed while the other buffer is filled.
+The staging area lies in the RWW section, which cannot be read while it is erased or written (about 8 ms per page).
+Hence interrupts are only left enabled while programming if the interrupt vectors have been moved to the
+boot loader section (IVSEL set, the ISRs of the link then have to be located there as well).
+Then full pages are programmed right after the reply to the chunk has been sent (see #a2jFwPoll),
+while the host prepares and sends the next chunk. Otherwise received bytes would be lost while interrupts are disabled,
+so the pages are programmed when the next chunk has been received completely (the host is waiting for its reply then).
+Every page is verified after programming.
+A chunk repeated by the host (e.g. after its reply was lost) is acknowledged again without being applied twice.
+When the CRC of the complete staged image matches, the image is activated by writing the #A2J_FW_INFO record
+to EEPROM and resetting the device by the watchdog. Copying the image over the application is then up to the boot loader.
+
+Self-programming has to be done from the boot loader section, hence the linker has to place the section
+.bootloader there (e.g. -Wl,--section-start=.bootloader=0x7000 on an ATmega32U4 with 4kB boot section).
+Host builds (or boards with special boot loaders) can define #A2J_FW_EXTERN_FLASH and provide
+#a2jFwProgramPage, #a2jFwReadByte and #a2jFwImageEnd themselves, e.g. to simulate the flash (see host/a2jdevice.c). */
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_FWUPDATE
+
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include "arduino2j.h"
+#include "a2j_fwupdate.h"
+#include "a2j_arena.h"
+
+#if (A2J_FW_SIZE % SPM_PAGESIZE) != 0
+	#error "A2J_FW_SIZE needs to be a multiple of SPM_PAGESIZE"
+#endif
+#if (A2J_FW_START % SPM_PAGESIZE) != 0
+	#error "A2J_FW_START needs to be a multiple of SPM_PAGESIZE"
+#endif
+#if defined(FLASHEND) && A2J_FW_START + A2J_FW_SIZE > FLASHEND + 1
+	#error "The staging area exceeds the flash"
+#endif
+
+/** State of the update. */
+enum {
+	A2J_FW_IDLE, /**< No update in progress. */
+	A2J_FW_ACTIVE, /**< Receiving the image. */
+	A2J_FW_ERROR, /**< Update failed, needs to be restarted at offset 0. */
+	A2J_FW_DONE, /**< Image verified and activated, reset pending. */
+};
+
+/** @name Page buffers */
+//@{
+/** Pages being filled and programmed (in #a2j_arena). */
+#define pages (a2j_arena.fw)
+/** Flash addresses of the pages to be programmed. */
+static uint32_t pageAddr[2];
+/** Bit i is set if page i has to be programmed. */
+static uint8_t pending = 0;
+/** Index of the page being filled. */
+static uint8_t fill = 0;
+/** Number of bytes in the page being filled. */
+static uint16_t fillLen = 0;
+//@}
+
+static uint8_t state = A2J_FW_IDLE;
+static uint8_t err;
+/** Image offset expected for the next chunk. */
+static uint32_t next;
+/** Image offset of the chunk received last. */
+static uint32_t prev;
+/** CRC of the image received so far. */
+static uint16_t crc;
+
+#ifndef A2J_FW_EXTERN_FLASH
+#include <avr/boot.h>
+
+/** Interrupts may stay enabled while the RWW section is programmed (see above). */
+#define a2jFwIrqSafe() (MCUCR & _BV(IVSEL))
+
+/** Programs the page, keeping interrupts enabled (if #a2jFwIrqSafe) except for the timed SPM sequences. */
+BOOTLOADER_SECTION void a2jFwProgramPage(uint32_t addr, const uint8_t* data){
+	uint8_t sreg = SREG;
+	if(!a2jFwIrqSafe())
+		cli();
+	eeprom_busy_wait();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		boot_page_erase(addr);
+	}
+	while(boot_spm_busy())
+		;
+	for(uint16_t i = 0; i < SPM_PAGESIZE; i += 2){
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+			boot_page_fill(addr + i, data[i] | (data[i + 1] << 8));
+		}
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		boot_page_write(addr);
+	}
+	while(boot_spm_busy())
+		;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		boot_rww_enable();
+	}
+	SREG = sreg;
+}
+
+uint8_t a2jFwReadByte(uint32_t addr){
+#if FLASHEND > 0xFFFF
+	return pgm_read_byte_far(addr);
+#else
+	return pgm_read_byte((uint16_t)addr);
+#endif
+}
+
+/** End of the load image of .data, i.e. of the application image in flash (defined by the linker script of avr-libc). */
+extern const uint8_t __data_load_end[];
+
+uint32_t a2jFwImageEnd(void){
+#if FLASHEND > 0xFFFF
+	return pgm_get_far_address(__data_load_end);
+#else
+	return (uint16_t)__data_load_end;
+#endif
+}
+#else
+/** The external implementation of #a2jFwProgramPage has to keep interrupts enabled. */
+#define a2jFwIrqSafe() true
+#endif // A2J_FW_EXTERN_FLASH
+
+/** Programs and verifies page buffer \a i. */
+static void a2jFwProgram(uint8_t i){
+	a2jFwProgramPage(pageAddr[i], pages[i]);
+	pending &= ~(1 << i);
+	for(uint16_t j = 0; j < SPM_PAGESIZE; j++){
+		if(a2jFwReadByte(pageAddr[i] + j) != pages[i][j]){
+			state = A2J_FW_ERROR;
+			err = A2J_FW_ERR_VERIFY;
+			return;
+		}
+	}
+}
+
+/** Programs all pending pages. */
+static void a2jFwProgramPending(void){
+	for(uint8_t i = 0; i < 2; i++){
+		if(pending & (1 << i))
+			a2jFwProgram(i);
+	}
+}
+
+/** Queues the page being filled for programming and switches to the other buffer. */
+static void a2jFwQueue(void){
+	for(; fillLen < SPM_PAGESIZE; fillLen++)
+		pages[fill][fillLen] = 0xFF;
+	pageAddr[fill] = A2J_FW_START + next - SPM_PAGESIZE;
+	pending |= 1 << fill;
+	fill ^= 1;
+	fillLen = 0;
+	if(pending & (1 << fill))
+		a2jFwProgram(fill);
+}
+
+/** Calculates the CRC of \a size bytes of the staged image. */
+static uint16_t a2jFwCrc(uint32_t size){
+	uint16_t c = 0xFFFF;
+	for(uint32_t i = 0; i < size; i++)
+		c = _crc_ccitt_update(c, a2jFwReadByte(A2J_FW_START + i));
+	return c;
+}
+
+/** Verifies and activates the staged image of \a size bytes.
+@return 0 on success */
+static uint8_t a2jFwFinish(uint32_t size, uint16_t expected){
+	if(fillLen > 0){
+		next += SPM_PAGESIZE - fillLen; // the page is padded
+		a2jFwQueue();
+	}
+	a2jFwProgramPending();
+	if(state == A2J_FW_ERROR)
+		return err;
+	if(crc != expected || a2jFwCrc(size) != expected)
+		return A2J_FW_ERR_CRC;
+
+	eeprom_update_word((uint16_t*)A2J_FW_INFO, A2J_FW_MAGIC);
+	eeprom_update_dword((uint32_t*)(A2J_FW_INFO + 2), size);
+	eeprom_update_word((uint16_t*)(A2J_FW_INFO + 6), expected);
+	state = A2J_FW_DONE;
+	return 0;
+}
+
+/**@ingroup j2amany
+Receives a new firmware image via a2jMany writes.
+The chunks have to be written in order starting at offset 0 (which (re)starts an update).
+A repetition of the chunk received last is acknowledged but ignored.
+The last chunk carries the CRC-16 of the image in its last two bytes.
+Reads are not possible.
+@return 0 on success, -1 on reads, else one of the \ref A2J_FW_ERR_SEQ "firmware update errors" */
+uint8_t a2jFwUpdate(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	if(!isWrite)
+		return -1;
+
+	if(*offset == 0){
+		state = A2J_FW_ACTIVE;
+		next = 0;
+		crc = 0xFFFF;
+		fillLen = 0;
+		pending = 0;
+		if(a2jFwImageEnd() > A2J_FW_START){
+			state = A2J_FW_ERROR;
+			return err = A2J_FW_ERR_OVERLAP;
+		}
+	}
+	if(state != A2J_FW_ACTIVE)
+		return (state == A2J_FW_ERROR) ? err : A2J_FW_ERR_SEQ;
+	if(!a2jFwIrqSafe())
+		a2jFwProgramPending();
+	if(*offset != next){
+		if(*offset == prev && next != 0){
+			*lenp = 0;
+			return (state == A2J_FW_ERROR) ? err : 0;
+		}
+		state = A2J_FW_ERROR;
+		return err = A2J_FW_ERR_SEQ;
+	}
+	prev = *offset;
+
+	uint8_t len = *lenp;
+	uint8_t* data = *datap;
+	uint16_t expected = 0;
+	if(*isLastp){
+		if(len < 2){
+			state = A2J_FW_ERROR;
+			return err = A2J_FW_ERR_SEQ;
+		}
+		len -= 2;
+		expected = a2jGetU16(data + len);
+	}
+	if(next + len > A2J_FW_SIZE){
+		state = A2J_FW_ERROR;
+		return err = A2J_FW_ERR_SIZE;
+	}
+
+	for(uint8_t i = 0; i < len; i++){
+		pages[fill][fillLen++] = data[i];
+		crc = _crc_ccitt_update(crc, data[i]);
+		next++;
+		if(fillLen == SPM_PAGESIZE)
+			a2jFwQueue();
+	}
+	*lenp = 0;
+	if(state == A2J_FW_ERROR)
+		return err;
+	if(*isLastp)
+		return a2jFwFinish(next, expected);
+	return 0;
+}
+
+/** Programs pending pages (if #a2jFwIrqSafe) and resets the device after an update has been activated.
+Called by #a2jProcess after the reply to the current frame has been sent. */
+void a2jFwPoll(void){
+	if(state != A2J_FW_ACTIVE && state != A2J_FW_DONE)
+		return;
+	if(a2jFwIrqSafe())
+		a2jFwProgramPending();
+	if(state == A2J_FW_DONE){
+		wdt_enable(WDTO_15MS);
+		for(;;)
+			;
+	}
+}
+
+#endif // A2J_FWUPDATE
+#endif // A2J
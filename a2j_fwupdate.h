@@ -0,0 +1,56 @@
+/** \file
+Firmware update via arduino2j header.*/
+
+#ifndef A2J_FWUPDATE_H
+#define A2J_FWUPDATE_H
+
+#include <stdint.h>
+
+#ifdef A2J_FWUPDATE
+
+#ifdef A2J_HOST
+	/** The host build emulates the flash (see host/a2jdevice.c). */
+	#define A2J_FW_EXTERN_FLASH
+#endif
+
+/** @name Firmware update settings */
+//@{
+#ifndef A2J_FW_START
+/** Byte address in flash where the new image is staged. Has to lie above the application image (see #a2jFwImageEnd). */
+#define A2J_FW_START 0x3800UL
+#endif
+#ifndef A2J_FW_SIZE
+/** Maximum size of an image in bytes. Needs to be a multiple of SPM_PAGESIZE. */
+#define A2J_FW_SIZE 0x3800UL
+#endif
+#ifndef A2J_FW_INFO
+/** EEPROM address of the record that tells the boot loader to install a staged image.
+The record consists of #A2J_FW_MAGIC, the image size (4 bytes) and its CRC-16 (2 bytes), all little-endian. */
+#define A2J_FW_INFO 0x3F0
+#endif
+//@}
+
+/** Marks a valid #A2J_FW_INFO record. */
+#define A2J_FW_MAGIC 0xA2F1
+
+/** @name Firmware update errors
+Return values of #a2jFwUpdate besides 0 and -1. */
+//@{
+#define A2J_FW_ERR_SEQ 1 /**< Chunk not at the expected offset. */
+#define A2J_FW_ERR_SIZE 2 /**< Image too large. */
+#define A2J_FW_ERR_VERIFY 3 /**< Programmed page differs from received data. */
+#define A2J_FW_ERR_CRC 4 /**< CRC of the staged image does not match. */
+#define A2J_FW_ERR_OVERLAP 5 /**< The staging area overlaps the running application image. */
+//@}
+
+/** Programs the page at byte address \a addr in flash with SPM_PAGESIZE bytes at \a data.
+Has to be executed from the boot loader section (see #A2J_FW_EXTERN_FLASH to provide another implementation).*/
+void a2jFwProgramPage(uint32_t addr, const uint8_t* data);
+/** Reads the byte at byte address \a addr in flash. */
+uint8_t a2jFwReadByte(uint32_t addr);
+/** Returns the byte address in flash following the running application image. */
+uint32_t a2jFwImageEnd(void);
+void a2jFwPoll(void);
+
+#endif // A2J_FWUPDATE
+#endif // A2J_FWUPDATE_H
@@ -8,11 +8,11 @@ Arduino2java generic lowlevel abstraction interface.*/
 #include "arduino2j.h"
 
 #ifdef A2J
-	#if defined(A2J_SERIAL) && defined(A2J_USB)
-		#error "multiple a2j low level functions enabled. please define either A2J_SERIAL _or_ A2J_USB"
+	#if (defined(A2J_SERIAL) + defined(A2J_USB) + defined(A2J_HOST) + defined(A2J_LINKSIM)) > 1
+		#error "multiple a2j low level functions enabled. please define either A2J_SERIAL, A2J_USB, A2J_HOST _or_ A2J_LINKSIM"
 	#endif
-	#if !(defined(A2J_SERIAL) || defined(A2J_USB))
-		#error "no a2j low level implementation selected. please define A2J_SERIAL or A2J_USB"
+	#if !(defined(A2J_SERIAL) || defined(A2J_USB) || defined(A2J_HOST) || defined(A2J_LINKSIM))
+		#error "no a2j low level implementation selected. please define A2J_SERIAL, A2J_USB, A2J_HOST or A2J_LINKSIM"
 	#endif
 
 /** Indicates wheter the underlying stream layer is connected and ready.
@@ -55,5 +55,38 @@ uint8_t a2jWriteEscapedByte(uint8_t data);
 /** Ensures any written byte before is really pushed to the underlying stream.*/
 void a2jFlush(void);
 
+#ifdef A2J_FASTPATH
+/** Feeds all bytes received so far to #a2jRxByte.
+
+Called by #a2jProcess and in interrupt context as soon as data arrives, so commands flagged #A2J_JT_ISR are executed
+without waiting for the main loop: by the OUT endpoint interrupt with USB and by #a2jSerialRxIsr with serial links.
+Calls while another call is in progress return immediately (the data is then fed by the call in progress).*/
+void a2jRxPoll(void);
+#endif // A2J_FASTPATH
+
+#ifdef A2J_CAPS
+/** Length of #a2j_link_caps. */
+#define A2J_LINK_CAPS_LEN 10
+
+#ifndef A2J_CAPS_WINDOW
+	#ifdef A2J_FASTPATH
+		/* frames arriving while one is executed are answered with A2J_RET_BUSY (see a2jRxByte) */
+		#define A2J_CAPS_WINDOW 1
+	#endif
+#endif
+
+/** Properties of the link reported by #a2jGetCaps, defined by every low level implementation:
+- link type (e.g. #A2J_LINK_SERIAL)
+- number of requests the host may have in flight (#A2J_CAPS_WINDOW, defaults depend on the link)
+- 2 byte little-endian sizes of the packets received and sent by the link (e.g. USB endpoint sizes, 0 if not packet based)
+- 4 byte little-endian baud rate (0 if not applicable)*/
+extern const uint8_t PROGMEM a2j_link_caps[A2J_LINK_CAPS_LEN];
+#endif // A2J_CAPS
+
+/** Resets all settings negotiated during a session (e.g. the frame checksum).
+
+Has to be called by the low level implementations when a new connection may have been established.*/
+void a2jReset(void);
+
 #endif // A2J
 #endif // A2J_LL_H
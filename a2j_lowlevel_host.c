@@ -0,0 +1,182 @@
+/** \file
+Host implementation of the Arduino2java lowlevel abstraction interface.
+
+Input is read in blocks and buffered, output is buffered until #a2jFlush is called (i.e. once per frame).
+The stream is always ready, the end of the input is signaled by #a2jHostWait.*/
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_HOST
+
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include "a2j_lowlevel.h"
+#include "a2j_lowlevel_host.h"
+#include "a2j_props_ee.h"
+#include "a2j_time.h"
+#include "a2j_capture.h"
+
+/** Emulated EEPROM (see host/compat/avr/eeprom.h). */
+uint8_t a2j_host_eeprom[E2END + 1];
+
+static int fdIn = 0;
+static int fdOut = 1;
+static bool closed = false;
+
+/** @name Input buffer */
+//@{
+static uint8_t rxBuf[256];
+static uint16_t rxPos = 0, rxLen = 0;
+//@}
+
+/** @name Output buffer */
+//@{
+static uint8_t txBuf[2 * (A2J_MAX_PAYLOAD + 16)];
+static uint16_t txLen = 0;
+//@}
+
+void a2jHostOpen(int in, int out){
+	fdIn = in;
+	fdOut = out;
+	closed = false;
+	rxPos = rxLen = 0;
+	txLen = 0;
+	a2jReset();
+}
+
+/** Refills the input buffer, waiting up to \a timeout milliseconds.
+@return true if bytes are available */
+static bool a2jHostFill(int timeout){
+	if(rxPos < rxLen)
+		return true;
+	if(closed)
+		return false;
+	struct pollfd pfd = {.fd = fdIn, .events = POLLIN};
+	int r;
+	while((r = poll(&pfd, 1, timeout)) < 0 && errno == EINTR)
+		;
+	if(r <= 0)
+		return false;
+	ssize_t n;
+	while((n = read(fdIn, rxBuf, sizeof(rxBuf))) < 0 && errno == EINTR)
+		;
+	if(n <= 0){
+		if(n == 0 || errno != EAGAIN)
+			closed = true;
+		return false;
+	}
+	rxPos = 0;
+	rxLen = n;
+	return true;
+}
+
+bool a2jHostWait(int timeout){
+	return a2jHostFill(timeout);
+}
+
+void a2jInit(void){
+	memset(a2j_host_eeprom, 0xFF, sizeof(a2j_host_eeprom));
+	a2jReset();
+#ifdef A2J_PROPS_EE
+	a2jPropsEeInit();
+#endif
+#ifdef A2J_TIME
+	a2jTimeInit();
+#endif
+}
+
+void a2jTask(void){
+	;
+}
+
+#ifdef A2J_CAPS
+#ifndef A2J_CAPS_WINDOW
+	/* requests wait in the buffers of the operating system */
+	#define A2J_CAPS_WINDOW 8
+#endif
+const uint8_t PROGMEM a2j_link_caps[A2J_LINK_CAPS_LEN] = {
+	A2J_LINK_HOST, A2J_CAPS_WINDOW,
+	sizeof(rxBuf) & 0xFF, sizeof(rxBuf) >> 8, sizeof(txBuf) & 0xFF, sizeof(txBuf) >> 8,
+	0, 0, 0, 0
+};
+#endif // A2J_CAPS
+
+uint8_t a2jReady(void){
+	return true;
+}
+
+uint8_t a2jAvailable(void){
+	return a2jHostFill(0);
+}
+
+uint16_t a2jReadByte(void){
+	if(!a2jHostFill(A2J_TIMEOUT))
+		return -A2J_RET_TO;
+	uint8_t c = rxBuf[rxPos++];
+	a2jCaptureByte(c);
+	return c;
+}
+
+uint8_t a2jWriteByte(uint8_t data){
+	if(txLen == sizeof(txBuf))
+		a2jFlush();
+	txBuf[txLen++] = data;
+	return 0;
+}
+
+void a2jFlush(void){
+	uint16_t done = 0;
+	while(done < txLen){
+		ssize_t n = write(fdOut, txBuf + done, txLen - done);
+		if(n < 0){
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN){
+				struct pollfd pfd = {.fd = fdOut, .events = POLLOUT};
+				poll(&pfd, 1, A2J_TIMEOUT);
+				continue;
+			}
+			break; // the reader is gone, the frame is lost
+		}
+		done += n;
+	}
+	txLen = 0;
+}
+
+#ifdef A2J_FASTPATH
+void a2jRxPoll(void){
+	while(a2jHostFill(0)){
+		while(rxPos < rxLen){
+			uint8_t c = rxBuf[rxPos++];
+			a2jCaptureByte(c);
+			a2jRxByte(c);
+		}
+	}
+}
+#endif // A2J_FASTPATH
+
+#ifdef A2J_TIME
+/** Start of the clock. */
+static struct timespec timeStart;
+
+void a2jTimeInit(void){
+	clock_gettime(CLOCK_MONOTONIC, &timeStart);
+}
+
+/** Counts microseconds since #a2jTimeInit. */
+uint32_t a2jTime(void){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)((now.tv_sec - timeStart.tv_sec) * 1000000LL + (now.tv_nsec - timeStart.tv_nsec) / 1000);
+}
+#endif // A2J_TIME
+
+#endif // A2J_HOST
+#endif // A2J
@@ -0,0 +1,26 @@
+/** \file
+Arduino2java host lowlevel abstraction header.
+
+The host implementation (A2J_HOST) runs arduino2j as a native process on the development machine,
+e.g. to test host software or to benchmark the protocol code without hardware.
+It is compiled with the replacements of the avr-libc headers in host/compat (i.e. -Ihost/compat)
+and reads and writes the frames from and to a pair of file descriptors (a tty, pty, pipe or socket).*/
+
+#ifndef A2J_LL_HOST_H
+	#define A2J_LL_HOST_H
+
+	#ifdef A2J
+		#ifdef A2J_HOST
+			#include <stdbool.h>
+			#include "a2j_lowlevel.h"
+
+			/** Sets the file descriptors requests are read from and replies are written to.
+			Defaults to stdin and stdout. Resets the session (see #a2jReset). */
+			void a2jHostOpen(int in, int out);
+
+			/** Waits up to \a timeout milliseconds (forever if negative) for input.
+			@return true if input is available, false on timeouts and after the input has been closed */
+			bool a2jHostWait(int timeout);
+		#endif // A2J_HOST
+	#endif // A2J
+#endif // A2J_LL_HOST_H
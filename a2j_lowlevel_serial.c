@@ -9,12 +9,23 @@ Serial implementation of the Arduino2java lowlevel abstraction interface.*/
 
 #include <stdbool.h>
 #include <util/delay.h>
+#include <util/atomic.h>
 #include "a2j_lowlevel.h"
 #include "a2j_lowlevel_serial.h"
+#include "a2j_props_ee.h"
+#include "a2j_time.h"
+#include "a2j_capture.h"
 #include "serial.h"
 
 // use -D SERIAL_BAUD <baudrate> as compiler flag
 inline void a2jInit(void){
+	a2jReset();
+#ifdef A2J_PROPS_EE
+	a2jPropsEeInit();
+#endif
+#ifdef A2J_TIME
+	a2jTimeInit();
+#endif
 	serialInit();
 }
 
@@ -22,6 +33,20 @@ void a2jTask(void){
 	;
 }
 
+#ifdef A2J_CAPS
+#ifndef A2J_CAPS_WINDOW
+	/* without flow control further requests may overflow the receive buffer */
+	#define A2J_CAPS_WINDOW 1
+#endif
+#ifndef SERIAL_BAUD
+	#define SERIAL_BAUD 0
+#endif
+const uint8_t PROGMEM a2j_link_caps[A2J_LINK_CAPS_LEN] = {
+	A2J_LINK_SERIAL, A2J_CAPS_WINDOW, 0, 0, 0, 0,
+	(uint32_t)SERIAL_BAUD & 0xFF, ((uint32_t)SERIAL_BAUD >> 8) & 0xFF, ((uint32_t)SERIAL_BAUD >> 16) & 0xFF, (uint32_t)SERIAL_BAUD >> 24
+};
+#endif // A2J_CAPS
+
 uint8_t a2jReady(void){
     return true;
 }
@@ -34,7 +59,9 @@ uint16_t a2jReadByte(){
 	uint8_t cnt = A2J_TIMEOUT;
 	for(;cnt>0;cnt--){
 		if (serialReadIsAvailable()){
-			return serialReadNoWait();
+			uint8_t data = serialReadNoWait();
+			a2jCaptureByte(data);
+			return data;
 		}
 		_delay_ms(1);
 	}
@@ -49,5 +76,29 @@ void a2jFlush(void){
 	// TODO
 }
 
+#ifdef A2J_FASTPATH
+void a2jRxPoll(void){
+	static volatile bool busy = false;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if(busy)
+			return;
+		busy = true;
+	}
+	while(serialReadIsAvailable()){
+		uint8_t data = serialReadNoWait();
+		a2jCaptureByte(data);
+		a2jRxByte(data);
+	}
+	busy = false;
+}
+
+void a2jSerialRxIsr(void){
+	// the library has read the byte already, a nested receive interrupt returns from a2jRxPoll immediately
+	NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE){
+		a2jRxPoll();
+	}
+}
+#endif // A2J_FASTPATH
+
 #endif // A2J_SERIAL
 #endif // A2J
@@ -7,6 +7,16 @@ Arduino2java serial lowlevel abstraction header.*/
 	#ifdef A2J
 		#ifdef A2J_SERIAL
 			#include "a2j_lowlevel.h"
+
+			#ifdef A2J_FASTPATH
+			/** Receive hook for #A2J_FASTPATH.
+			The receive interrupt is owned by the serial library, hence the application has to call this function
+			from the library's receive hook after the byte has been buffered, e.g. by building the library with
+			\code -DSERIAL_RX_HOOK=a2jSerialRxIsr \endcode
+			Without the hook commands flagged #A2J_JT_ISR are only executed when #a2jProcess polls the receiver.
+			The interrupts are enabled while the receiver runs (it may execute commands), so further bytes are still buffered. */
+			void a2jSerialRxIsr(void);
+			#endif // A2J_FASTPATH
 		#endif
 	#endif
 #endif
\ No newline at end of file
@@ -0,0 +1,415 @@
+/** \file
+Link simulator implementation of the Arduino2java lowlevel abstraction interface (see a2j_lowlevel_sim.h).*/
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_LINKSIM
+
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <avr/io.h>
+#include "a2j_lowlevel.h"
+#include "a2j_lowlevel_sim.h"
+#include "a2j_props_ee.h"
+#include "a2j_time.h"
+#include "a2j_capture.h"
+
+/** Size of the queues of bytes and packets in transit (power of two). */
+#define SIM_Q 8192
+#define SIM_MSK (SIM_Q - 1)
+/** Length of a USB frame in ns. */
+#define SIM_USB_FRAME 1000000ULL
+/** Bits added to every USB packet (token, PID, CRC, handshake) for the error injection. */
+#define SIM_USB_OVERHEAD 48
+/** Upper limit of retransmissions of a USB packet. */
+#define SIM_USB_RETRIES 16
+
+/** Emulated EEPROM (see host/compat/avr/eeprom.h). */
+uint8_t a2j_host_eeprom[E2END + 1];
+
+static a2j_sim_link link;
+static a2j_sim_host host;
+static a2j_sim_stats stats;
+/** Current time of the device. */
+static uint64_t now;
+/** Time of the next timer of the host. */
+static uint64_t hostNext;
+static uint32_t rnd;
+
+/** A byte in transit and the time it arrives. */
+typedef struct{
+	uint64_t t;
+	uint8_t c;
+}sim_byte;
+
+/** @name Host to device */
+//@{
+/** UART: bytes on the line. */
+static sim_byte h2d[SIM_Q];
+static uint16_t h2dRd, h2dWr;
+/** Time the line is free again. */
+static uint64_t h2dFree;
+/** USB: packets waiting for an OUT slot. */
+static struct{
+	uint64_t ready; /**< Time the host wants to send the packet. */
+	uint8_t retries; /**< Number of slots lost to bit errors. */
+	uint16_t len;
+	uint16_t start; /**< Index of the first byte in #outData. */
+}outPkt[SIM_Q];
+static uint16_t outRd, outWr;
+static uint8_t outData[SIM_Q];
+static uint16_t outDataWr;
+/** USB: time of the next unused OUT slot. */
+static uint64_t outFree;
+/** USB: number of OUT banks holding data. */
+static uint8_t outBanks;
+/** USB: bytes left of the packets in the banks (oldest first). */
+static uint16_t outLeft[256];
+static uint8_t outLeftRd;
+/** Bytes received by the device but not read yet (UART buffer or the OUT banks). */
+static uint8_t rxData[SIM_Q];
+static uint16_t rxRd, rxWr;
+//@}
+
+/** @name Device to host */
+//@{
+/** Bytes sent by the device and the time they arrive at the host. */
+static sim_byte d2h[SIM_Q];
+static uint16_t d2hRd, d2hWr;
+/** UART: time the line is free again. */
+static uint64_t txFree;
+/** USB: packet being filled. */
+static uint8_t inPkt[1024];
+static uint16_t inLen;
+/** USB: time of the next unused IN slot. */
+static uint64_t inFree;
+/** USB: transfer times of the last packets (one per bank). */
+static uint64_t inDone[256];
+static uint32_t inCnt;
+//@}
+
+/** Returns a pseudo random number in [0; 1). */
+static double simRand(void){
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	return rnd / 4294967296.0;
+}
+
+/** Returns true with the probability that at least one of \a bits bits is flipped. */
+static bool simError(uint32_t bits){
+	if(link.ber <= 0)
+		return false;
+	return simRand() < 1 - pow(1 - link.ber, bits);
+}
+
+/** Converts \a cycles of the device to ns. */
+static uint64_t simCycles(uint32_t cycles){
+	return (uint64_t)cycles * 1000000000ULL / link.cpuHz;
+}
+
+/** Duration of a UART byte in ns. */
+static uint64_t simByteTime(void){
+	return 10 * 1000000000ULL / link.baud;
+}
+
+/** Duration of a USB packet slot in ns. */
+static uint64_t simSlot(void){
+	return SIM_USB_FRAME / link.perFrame;
+}
+
+/** Returns the first USB slot not before \a t. */
+static uint64_t simAlign(uint64_t t){
+	uint64_t slot = simSlot();
+	return (t + slot - 1) / slot * slot;
+}
+
+/** Returns the time the next OUT packet is transferred or UINT64_MAX if there is none or no bank is free. */
+static uint64_t simOutNext(void){
+	if(outRd == outWr || outBanks >= link.banks)
+		return UINT64_MAX;
+	uint64_t t = outPkt[outRd].ready > outFree ? outPkt[outRd].ready : outFree;
+	return simAlign(t) + outPkt[outRd].retries * simSlot();
+}
+
+/** Moves the bytes that arrived up to now into the receive buffer of the device. */
+static void simDeliver(void){
+	if(link.type == A2J_SIM_UART){
+		while(h2dRd != h2dWr && h2d[h2dRd].t <= now){
+			if(((rxWr - rxRd) & SIM_MSK) >= link.rxBuf){
+				stats.overruns++;
+			} else {
+				rxData[rxWr++ & SIM_MSK] = h2d[h2dRd].c;
+				rxWr &= SIM_MSK;
+				now += simCycles(link.byteCycles);
+			}
+			h2dRd = (h2dRd + 1) & SIM_MSK;
+		}
+	} else {
+		uint64_t t;
+		while((t = simOutNext()) <= now){
+			uint16_t len = outPkt[outRd].len;
+			for(uint16_t i = 0; i < len; i++){
+				rxData[rxWr] = outData[(outPkt[outRd].start + i) & SIM_MSK];
+				rxWr = (rxWr + 1) & SIM_MSK;
+			}
+			outLeft[(uint8_t)(outLeftRd + outBanks)] = len;
+			outBanks++;
+			outFree = t + simSlot();
+			outRd = (outRd + 1) & SIM_MSK;
+			now += simCycles(link.byteCycles) * len;
+		}
+	}
+}
+
+/** Passes the bytes that arrived at the host up to now to it and runs its timers. */
+static void simHost(void){
+	while(d2hRd != d2hWr && d2h[d2hRd].t <= now){
+		host.rx(d2h[d2hRd].c, d2h[d2hRd].t);
+		d2hRd = (d2hRd + 1) & SIM_MSK;
+	}
+	hostNext = host.step(now);
+}
+
+/** Returns the time of the next event of the link or the host. */
+static uint64_t simNext(void){
+	uint64_t next = hostNext;
+	if(d2hRd != d2hWr && d2h[d2hRd].t < next)
+		next = d2h[d2hRd].t;
+	if(link.type == A2J_SIM_UART){
+		if(h2dRd != h2dWr && h2d[h2dRd].t < next)
+			next = h2d[h2dRd].t;
+	} else {
+		uint64_t t = simOutNext();
+		if(t < next)
+			next = t;
+	}
+	return next > now ? next : now + 1;
+}
+
+/** Advances the time to \a t, passing all events on the way (the receiver keeps working meanwhile). */
+static void simWait(uint64_t t){
+	while(now < t){
+		uint64_t next = simNext();
+		now = next < t ? next : t;
+		simHost();
+		simDeliver();
+	}
+}
+
+void a2jSimOpen(const a2j_sim_link* l, const a2j_sim_host* h){
+	link = *l;
+	host = *h;
+	memset(&stats, 0, sizeof(stats));
+	now = 0;
+	hostNext = UINT64_MAX;
+	rnd = link.seed ? link.seed : 1;
+	h2dRd = h2dWr = 0;
+	h2dFree = 0;
+	outRd = outWr = outDataWr = 0;
+	outFree = 0;
+	outBanks = 0;
+	outLeftRd = 0;
+	rxRd = rxWr = 0;
+	d2hRd = d2hWr = 0;
+	txFree = 0;
+	inLen = 0;
+	inFree = 0;
+	inCnt = 0;
+	a2jReset();
+}
+
+void a2jSimSend(const uint8_t* data, uint16_t len, uint64_t t){
+	if(link.type == A2J_SIM_UART){
+		uint64_t bt = simByteTime();
+		if(h2dFree > t)
+			t = h2dFree;
+		for(uint16_t i = 0; i < len; i++){
+			uint8_t c = data[i];
+			if(simError(10)){
+				c ^= 1 << (rnd % 8);
+				stats.corrupted++;
+			}
+			t += bt;
+			h2d[h2dWr].t = t;
+			h2d[h2dWr].c = c;
+			h2dWr = (h2dWr + 1) & SIM_MSK;
+		}
+		h2dFree = t;
+	} else {
+		if(link.sofAlign)
+			t = (t + SIM_USB_FRAME - 1) / SIM_USB_FRAME * SIM_USB_FRAME;
+		for(uint16_t off = 0; off < len; off += link.epSize){
+			uint16_t plen = len - off < link.epSize ? len - off : link.epSize;
+			outPkt[outWr].ready = t;
+			outPkt[outWr].len = plen;
+			outPkt[outWr].start = outDataWr;
+			outPkt[outWr].retries = 0;
+			while(outPkt[outWr].retries < SIM_USB_RETRIES && simError(plen * 8 + SIM_USB_OVERHEAD)){
+				outPkt[outWr].retries++;
+				stats.corrupted++;
+			}
+			for(uint16_t i = 0; i < plen; i++)
+				outData[outDataWr++ & SIM_MSK] = data[off + i];
+			outDataWr &= SIM_MSK;
+			outWr = (outWr + 1) & SIM_MSK;
+		}
+	}
+}
+
+void a2jSimRun(uint64_t until){
+	while(now < until){
+		simHost();
+		simDeliver();
+		if(rxRd != rxWr){
+			a2jProcess();
+			continue;
+		}
+		uint64_t next = simNext();
+		now = next < until ? next : until;
+	}
+}
+
+uint64_t a2jSimNow(void){
+	return now;
+}
+
+const a2j_sim_stats* a2jSimStats(void){
+	return &stats;
+}
+
+void a2jInit(void){
+	memset(a2j_host_eeprom, 0xFF, sizeof(a2j_host_eeprom));
+	a2jReset();
+#ifdef A2J_PROPS_EE
+	a2jPropsEeInit();
+#endif
+#ifdef A2J_TIME
+	a2jTimeInit();
+#endif
+}
+
+void a2jTask(void){
+	;
+}
+
+#ifdef A2J_CAPS
+#ifndef A2J_CAPS_WINDOW
+	#define A2J_CAPS_WINDOW 8
+#endif
+const uint8_t PROGMEM a2j_link_caps[A2J_LINK_CAPS_LEN] = {
+	A2J_LINK_SIM, A2J_CAPS_WINDOW, 0, 0, 0, 0, 0, 0, 0, 0
+};
+#endif // A2J_CAPS
+
+uint8_t a2jReady(void){
+	return true;
+}
+
+uint8_t a2jAvailable(void){
+	simDeliver();
+	return rxRd != rxWr;
+}
+
+uint16_t a2jReadByte(void){
+	uint64_t deadline = now + A2J_TIMEOUT * 1000000ULL;
+	for(;;){
+		simDeliver();
+		if(rxRd != rxWr)
+			break;
+		uint64_t next = simNext();
+		if(next > deadline){
+			simWait(deadline);
+			stats.timeouts++;
+			return -A2J_RET_TO;
+		}
+		simWait(next);
+	}
+
+	uint8_t c = rxData[rxRd];
+	rxRd = (rxRd + 1) & SIM_MSK;
+	stats.rxBytes++;
+	a2jCaptureByte(c);
+	if(link.type == A2J_SIM_USB && --outLeft[outLeftRd] == 0){
+		// the bank is free again, the host may send the next packet from now on
+		outLeftRd++;
+		outBanks--;
+		if(outFree < now)
+			outFree = now;
+	}
+	if(c == A2J_SOF)
+		now += simCycles(link.frameCycles);
+	return c;
+}
+
+/** Commits the USB IN packet being filled, which is transferred in the next free slot. */
+static void simCommit(void){
+	uint64_t t = simAlign(inFree > now ? inFree : now);
+	uint8_t retries = 0;
+	while(retries < SIM_USB_RETRIES && simError(inLen * 8 + SIM_USB_OVERHEAD)){
+		retries++;
+		stats.corrupted++;
+	}
+	t += retries * simSlot();
+	inFree = t + simSlot();
+	for(uint16_t i = 0; i < inLen; i++){
+		d2h[d2hWr].t = t;
+		d2h[d2hWr].c = inPkt[i];
+		d2hWr = (d2hWr + 1) & SIM_MSK;
+	}
+	inDone[inCnt++ % link.banks] = t;
+	inLen = 0;
+}
+
+uint8_t a2jWriteByte(uint8_t data){
+	now += simCycles(link.byteCycles);
+	stats.txBytes++;
+	if(link.type == A2J_SIM_UART){
+		uint64_t bt = simByteTime();
+		// wait until the byte txBuf bytes before this one has been sent
+		if(txFree > now + link.txBuf * bt)
+			simWait(txFree - link.txBuf * bt);
+		uint64_t t = (txFree > now ? txFree : now) + bt;
+		if(simError(10)){
+			data ^= 1 << (rnd % 8);
+			stats.corrupted++;
+		}
+		d2h[d2hWr].t = t;
+		d2h[d2hWr].c = data;
+		d2hWr = (d2hWr + 1) & SIM_MSK;
+		txFree = t;
+	} else {
+		// a new packet needs a free bank
+		if(inLen == 0 && inCnt >= link.banks){
+			uint64_t oldest = inDone[inCnt % link.banks];
+			if(oldest > now)
+				simWait(oldest);
+		}
+		inPkt[inLen++] = data;
+		if(inLen == link.epSize)
+			simCommit();
+	}
+	return 0;
+}
+
+void a2jFlush(void){
+	if(link.type == A2J_SIM_USB && inLen > 0)
+		simCommit();
+}
+
+#ifdef A2J_TIME
+void a2jTimeInit(void){
+	;
+}
+
+/** Counts microseconds of the simulated time. */
+uint32_t a2jTime(void){
+	return (uint32_t)(now / 1000);
+}
+#endif // A2J_TIME
+
+#endif // A2J_LINKSIM
+#endif // A2J
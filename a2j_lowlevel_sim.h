@@ -0,0 +1,88 @@
+/** \file
+Arduino2java link simulator lowlevel abstraction header.
+
+The link simulator (A2J_LINKSIM) runs arduino2j on the host against a timing model of the link instead of a real stream,
+e.g. to predict the throughput of a baud rate, endpoint size or framing option before building hardware (see host/a2jlinksim.c).
+Like the host implementation it is compiled with the replacements of the avr-libc headers in host/compat.
+
+Everything happens in simulated time (nanoseconds), which is advanced by the transfers on the link,
+the cost of handling the bytes on the device and the waits of the device.
+The simulated host is driven by callbacks that receive the bytes sent by the device and send requests by #a2jSimSend.
+
+Models:
+- UART: every byte takes 10 bit times in each direction. Received bytes are stored in a buffer of #a2j_sim_link::rxBuf bytes,
+  which overruns (the byte is lost) if the device does not read in time. The device blocks while its transmit buffer is full.
+- USB full-speed bulk: data is transferred in packets of up to #a2j_sim_link::epSize bytes.
+  Every direction gets #a2j_sim_link::perFrame packet slots per 1 ms frame.
+  The device has #a2j_sim_link::banks packet buffers per direction: the host is NAKed while all OUT banks are full,
+  the device blocks while all IN banks are full. Transfers requested by the host start at a frame boundary if #a2j_sim_link::sofAlign is set.
+
+Bit errors are injected with the bit error rate #a2j_sim_link::ber: UART bytes are corrupted, USB packets are retransmitted in the next slot.*/
+
+#ifndef A2J_LL_SIM_H
+	#define A2J_LL_SIM_H
+
+	#ifdef A2J
+		#ifdef A2J_LINKSIM
+			#include <stdbool.h>
+			#include <stdint.h>
+			#include "a2j_lowlevel.h"
+
+			#ifdef A2J_FASTPATH
+				#error "A2J_LINKSIM does not support A2J_FASTPATH"
+			#endif
+
+			/** @name Link types */
+			//@{
+			#define A2J_SIM_UART 0
+			#define A2J_SIM_USB 1
+			//@}
+
+			/** Timing model of the link. */
+			typedef struct{
+				uint8_t type; /**< #A2J_SIM_UART or #A2J_SIM_USB. */
+				uint32_t baud; /**< UART: baud rate. */
+				uint16_t rxBuf; /**< UART: bytes buffered by the receiver of the device. */
+				uint16_t txBuf; /**< UART: bytes buffered by the transmitter of the device. */
+				uint16_t epSize; /**< USB: endpoint size. */
+				uint8_t banks; /**< USB: packet buffers per endpoint. */
+				uint8_t perFrame; /**< USB: packet slots per frame and direction. */
+				bool sofAlign; /**< USB: transfers of the host start at the next frame. */
+				uint32_t cpuHz; /**< Clock of the device. */
+				uint16_t byteCycles; /**< Cycles spent per byte received or sent (interrupt handler, copying). */
+				uint16_t frameCycles; /**< Cycles spent per reply (decoding, dispatching, executing). */
+				double ber; /**< Bit error rate. */
+				uint32_t seed; /**< Seed of the error injection. */
+			}a2j_sim_link;
+
+			/** Callbacks of the simulated host. */
+			typedef struct{
+				/** Receives the byte \a c sent by the device, which arrived at time \a t. */
+				void (*rx)(uint8_t c, uint64_t t);
+				/** Handles the timers of the host up to time \a t.
+				@return the time of the next timer or UINT64_MAX */
+				uint64_t (*step)(uint64_t t);
+			}a2j_sim_host;
+
+			/** Statistics of the simulation. */
+			typedef struct{
+				uint32_t rxBytes; /**< Bytes received by the device. */
+				uint32_t txBytes; /**< Bytes sent by the device. */
+				uint32_t overruns; /**< Bytes lost because the receive buffer was full. */
+				uint32_t corrupted; /**< Bytes (UART) or packets (USB) hit by bit errors. */
+				uint32_t timeouts; /**< Timeouts while the device waited for a byte. */
+			}a2j_sim_stats;
+
+			/** Resets the simulation to time 0 with the link \a link and the host \a host. */
+			void a2jSimOpen(const a2j_sim_link* link, const a2j_sim_host* host);
+			/** Sends \a len bytes from the host at time \a t (as one transfer). */
+			void a2jSimSend(const uint8_t* data, uint16_t len, uint64_t t);
+			/** Runs #a2jProcess until time \a until. */
+			void a2jSimRun(uint64_t until);
+			/** Returns the current time of the device. */
+			uint64_t a2jSimNow(void);
+			/** Returns the statistics since #a2jSimOpen. */
+			const a2j_sim_stats* a2jSimStats(void);
+		#endif // A2J_LINKSIM
+	#endif // A2J
+#endif // A2J_LL_SIM_H
@@ -2,12 +2,23 @@
 USB implementation of the Arduino2java lowlevel abstraction interface.*/
 
 #include <util/delay.h>
+#include <util/atomic.h>
 #include <avr/pgmspace.h>
 #include "a2j_lowlevel_usb.h"
+#include "a2j_props_ee.h"
+#include "a2j_time.h"
+#include "a2j_capture.h"
 
 #ifdef A2J_USB
 
 inline void a2jInit(void){
+	a2jReset();
+#ifdef A2J_PROPS_EE
+	a2jPropsEeInit();
+#endif
+#ifdef A2J_TIME
+	a2jTimeInit();
+#endif
 	USB_Init();
 }
 
@@ -15,6 +26,11 @@ void EVENT_USB_Device_ConfigurationChanged(void){
 	Endpoint_ConfigureEndpoint(A2J_USB_IN_ADDR, EP_TYPE_BULK, A2J_USB_IN_EPSIZE, 1);
 	Endpoint_ConfigureEndpoint(A2J_USB_OUT_ADDR, EP_TYPE_BULK, A2J_USB_OUT_EPSIZE, 1);
 	A2J_USB_CONFIG
+#ifdef A2J_FASTPATH
+	Endpoint_SelectEndpoint(A2J_USB_OUT_ADDR);
+	UEIENX |= _BV(RXOUTE);
+#endif // A2J_FASTPATH
+	a2jReset();
 }
 
 inline void a2jTask(void){
@@ -25,6 +41,18 @@ inline uint8_t a2jReady(void){
 	return USB_DeviceState == DEVICE_STATE_Configured;
 }
 
+#ifdef A2J_CAPS
+#ifndef A2J_CAPS_WINDOW
+	/* the host controller holds further requests back until the OUT endpoint is read (NAK) */
+	#define A2J_CAPS_WINDOW 8
+#endif
+const uint8_t PROGMEM a2j_link_caps[A2J_LINK_CAPS_LEN] = {
+	A2J_LINK_USB, A2J_CAPS_WINDOW,
+	A2J_USB_OUT_EPSIZE & 0xFF, A2J_USB_OUT_EPSIZE >> 8, A2J_USB_IN_EPSIZE & 0xFF, A2J_USB_IN_EPSIZE >> 8,
+	0, 0, 0, 0
+};
+#endif // A2J_CAPS
+
 uint8_t a2jAvailable(void){
 	Endpoint_SelectEndpoint(A2J_USB_OUT_ADDR);
 	return Endpoint_BytesInEndpoint() != 0;
@@ -38,6 +66,7 @@ uint16_t a2jReadByte(){
 			uint8_t data = Endpoint_Read_8();
 			if (!(Endpoint_BytesInEndpoint()))
 				Endpoint_ClearOUT();
+			a2jCaptureByte(data);
 			return data;
 		}
 		_delay_ms(1);
@@ -73,6 +102,47 @@ void a2jFlush(void){
 	}
 }
 
+#ifdef A2J_FASTPATH
+void a2jRxPoll(void){
+	static volatile bool busy = false;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if(busy)
+			return;
+		busy = true;
+	}
+	// might interrupt code using another endpoint
+	uint8_t prev = Endpoint_GetCurrentEndpoint();
+	Endpoint_SelectEndpoint(A2J_USB_OUT_ADDR);
+	while(Endpoint_BytesInEndpoint()){
+		uint8_t data = Endpoint_Read_8();
+		if (!(Endpoint_BytesInEndpoint()))
+			Endpoint_ClearOUT();
+		a2jCaptureByte(data);
+		a2jRxByte(data);
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		busy = false;
+		// the endpoint is empty, the next packet triggers the interrupt again
+		UEIENX |= _BV(RXOUTE);
+	}
+	Endpoint_SelectEndpoint(prev);
+}
+
+#ifdef INTERRUPT_CONTROL_ENDPOINT
+	#error "A2J_FASTPATH uses USB_COM_vect, which LUFA takes with INTERRUPT_CONTROL_ENDPOINT"
+#endif
+/** Feeds the packets of the OUT endpoint to the receiver as soon as they arrive.
+The interrupt is disabled until #a2jRxPoll emptied the endpoint, since it may be running in the main loop already
+(RXOUTI stays set until then). */
+ISR(USB_COM_vect){
+	uint8_t prev = Endpoint_GetCurrentEndpoint();
+	Endpoint_SelectEndpoint(A2J_USB_OUT_ADDR);
+	UEIENX &= ~_BV(RXOUTE);
+	Endpoint_SelectEndpoint(prev);
+	a2jRxPoll();
+}
+#endif // A2J_FASTPATH
+
 static const USB_Descriptor_Device_t PROGMEM DeviceDescriptor =
 {
 	.Header				 = {.Size = sizeof(USB_Descriptor_Device_t), .Type = DTYPE_Device},
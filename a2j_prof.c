@@ -0,0 +1,179 @@
+/** \file
+PC-sampling profiler.
+
+A timer interrupt (#A2J_PROF_VECT) records the program counter of the interrupted code into a ring buffer in #a2j_arena.
+The host starts and stops the sampling and drains the samples with #a2jProfile.
+Each sample is the word address (as pushed by the interrupt, i.e. the flash byte address divided by 2)
+of the instruction to be executed next. Only the lower 16 bits are recorded on devices with more than 128 kB of flash.
+Samples are dropped (and counted) while the ring buffer is full.
+
+The interrupt handler is naked and written in assembler, so it does not disturb the profile more than necessary
+and finds the return address at a fixed position on the stack.
+Code running with interrupts disabled is attributed to the instruction following the re-enabling.
+host/a2jprofile.cpp drains the samples into a file, which tools/a2jprof.py symbolizes against the ELF file into a flat profile.
+
+Timer0 is shared with the Arduino core (millis(), delay() and PWM on OC0A/OC0B), see #a2jProfTimer. */
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_PROF
+
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "arduino2j.h"
+#include "a2j_prof.h"
+#include "a2j_arena.h"
+
+/** All index operations are ANDed with this mask (indices are byte offsets into the ring buffer). */
+#define A2J_PROF_MSK (2 * A2J_PROF_CNT - 1)
+
+/** @name Ring buffer indices
+Written by the sampler resp. #a2jProfile only. */
+//@{
+volatile uint8_t a2j_prof_wr = 0;
+volatile uint8_t a2j_prof_rd = 0;
+//@}
+/** Number of samples dropped because the ring buffer was full (saturates at 255). */
+volatile uint8_t a2j_prof_lost = 0;
+
+#ifdef __AVR_3_BYTE_PC__
+	#define A2J_PROF_PC_HI 9
+#else
+	#define A2J_PROF_PC_HI 8
+#endif
+
+ISR(A2J_PROF_VECT, ISR_NAKED){
+	__asm__ __volatile__(
+		"push r24\n\t"
+		"in r24, __SREG__\n\t"
+		"push r24\n\t"
+		"push r25\n\t"
+		"push r26\n\t"
+		"push r27\n\t"
+		"push r30\n\t"
+		"push r31\n\t"
+		// the return address is stored above the 7 saved bytes, high byte first
+		"in r30, __SP_L__\n\t"
+		"in r31, __SP_H__\n\t"
+		"ldd r25, Z+%[pchi]\n\t"
+		"ldd r24, Z+%[pclo]\n\t"
+		// append it to the ring buffer unless it is full
+		"lds r26, %[wr]\n\t"
+		"mov r27, r26\n\t"
+		"subi r27, -2\n\t"
+		"andi r27, %[mask]\n\t"
+		"lds r30, %[rd]\n\t"
+		"cp r27, r30\n\t"
+		"breq 1f\n\t"
+		"sts %[wr], r27\n\t"
+		"ldi r27, 0\n\t"
+		"subi r26, lo8(-(%[buf]))\n\t"
+		"sbci r27, hi8(-(%[buf]))\n\t"
+		"st X+, r24\n\t"
+		"st X, r25\n\t"
+		"rjmp 2f\n"
+		"1:\n\t"
+		"lds r24, %[lost]\n\t"
+		"cpi r24, 0xFF\n\t"
+		"breq 2f\n\t"
+		"inc r24\n\t"
+		"sts %[lost], r24\n"
+		"2:\n\t"
+		"pop r31\n\t"
+		"pop r30\n\t"
+		"pop r27\n\t"
+		"pop r26\n\t"
+		"pop r25\n\t"
+		"pop r24\n\t"
+		"out __SREG__, r24\n\t"
+		"pop r24\n\t"
+		"reti\n\t"
+		:: [pchi] "I" (A2J_PROF_PC_HI),
+		   [pclo] "I" (A2J_PROF_PC_HI + 1),
+		   [mask] "M" (A2J_PROF_MSK),
+		   [wr] "i" (&a2j_prof_wr),
+		   [rd] "i" (&a2j_prof_rd),
+		   [lost] "i" (&a2j_prof_lost),
+		   [buf] "i" (a2j_arena.prof)
+	);
+}
+
+#ifndef A2J_PROF_EXTERN_TIMER
+/** @name Timer0 configuration
+Saved by #a2jProfTimer if it had to start Timer0 itself, restored when the sampling stops. */
+//@{
+static bool ownTimer = false;
+static uint8_t savedTccr0a, savedTccr0b, savedOcr0a;
+//@}
+
+void a2jProfTimer(uint8_t on){
+	if(on){
+		if(!(TCCR0B & (_BV(CS02) | _BV(CS01) | _BV(CS00)))){
+			savedTccr0a = TCCR0A;
+			savedTccr0b = TCCR0B;
+			savedOcr0a = OCR0A;
+			ownTimer = true;
+			TCCR0A = _BV(WGM01);
+			OCR0A = A2J_PROF_OCR;
+			TCCR0B = _BV(CS01) | _BV(CS00);
+		}
+		TIFR0 = _BV(OCF0A);
+		TIMSK0 |= _BV(OCIE0A);
+	} else {
+		TIMSK0 &= ~_BV(OCIE0A);
+		if(ownTimer){
+			TCCR0B = savedTccr0b;
+			TCCR0A = savedTccr0a;
+			OCR0A = savedOcr0a;
+			ownTimer = false;
+		}
+	}
+}
+#endif // A2J_PROF_EXTERN_TIMER
+
+/**@ingroup j2amany
+Controls the profiler and drains its samples.
+
+A write of one byte starts (non-zero) or stops (zero) the sampling. Starting discards all samples recorded so far.
+A read returns the number of samples dropped since the last read (1 byte, saturated at 255)
+followed by the recorded samples (2 byte little-endian word addresses each, oldest first), which are removed from the ring buffer.
+The offset is ignored. \a isLastp is set if the ring buffer has been emptied. */
+uint8_t a2jProfile(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	uint8_t* data = *datap;
+	if(isWrite){
+		if(*lenp != 1)
+			return -1;
+		a2jProfTimer(0);
+		if(data[0]){
+			a2j_prof_rd = a2j_prof_wr;
+			a2j_prof_lost = 0;
+			a2jProfTimer(1);
+		}
+		*lenp = 0;
+		return 0;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		data[0] = a2j_prof_lost;
+		a2j_prof_lost = 0;
+	}
+	uint8_t len = 1;
+	uint8_t rd = a2j_prof_rd;
+	uint8_t wr = a2j_prof_wr;
+	while(rd != wr && len + 2 <= A2J_MANY_PAYLOAD){
+		data[len++] = a2j_arena.prof[rd];
+		data[len++] = a2j_arena.prof[rd + 1];
+		rd = (rd + 2) & A2J_PROF_MSK;
+	}
+	a2j_prof_rd = rd;
+	*isLastp = (rd == a2j_prof_wr);
+	*lenp = len;
+	return 0;
+}
+
+#endif // A2J_PROF
+#endif // A2J
@@ -0,0 +1,40 @@
+/** \file
+PC-sampling profiler header.*/
+
+#ifndef A2J_PROF_H
+#define A2J_PROF_H
+
+#include <stdint.h>
+
+#ifdef A2J_PROF
+
+/** @name Profiler settings */
+//@{
+#ifndef A2J_PROF_CNT
+/** Number of samples the ring buffer can hold. Needs to be a power of two not larger than 128. */
+#define A2J_PROF_CNT 64
+#endif
+#if A2J_PROF_CNT > 128 || (A2J_PROF_CNT & (A2J_PROF_CNT - 1))
+	#error "A2J_PROF_CNT needs to be a power of two not larger than 128"
+#endif
+#ifndef A2J_PROF_OCR
+/** Compare value of Timer0 (prescaler 64) if #a2jProfTimer has to start it.
+The sampling rate is F_CPU / 64 / (#A2J_PROF_OCR + 1), i.e. 1 kHz at 16 MHz. */
+#define A2J_PROF_OCR 249
+#endif
+#ifndef A2J_PROF_VECT
+/** Interrupt vector of the sampler. Has to be changed together with #a2jProfTimer if Timer0 is not available. */
+#define A2J_PROF_VECT TIMER0_COMPA_vect
+#endif
+//@}
+
+/** Starts (\a on != 0) or stops the timer triggering #A2J_PROF_VECT.
+The default implementation uses the compare match A interrupt of Timer0, which the Arduino core runs for millis() and delay().
+If Timer0 is running already, its configuration is left alone and one sample is taken per timer period
+(F_CPU / 64 / 256, i.e. 976 Hz with the Arduino core at 16 MHz), so millis(), delay() and PWM keep working.
+Otherwise Timer0 is started in CTC mode (see #A2J_PROF_OCR) and its previous configuration is restored when sampling stops.
+Define #A2J_PROF_EXTERN_TIMER and #A2J_PROF_VECT to use another timer, e.g. if the application uses TIMER0_COMPA_vect itself. */
+void a2jProfTimer(uint8_t on);
+
+#endif // A2J_PROF
+#endif // A2J_PROF_H
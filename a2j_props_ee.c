@@ -0,0 +1,221 @@
+/** \file
+EEPROM overlay for arduino2j properties.
+
+Properties written by the host are stored in EEPROM and take precedence over the defaults in flash.
+The EEPROM area is split into two banks. Each bank starts with a header (#A2J_PROPS_EE_MAGIC, generation)
+followed by an append-only log of records terminated by 0xFF.
+A record consists of one length byte followed by the key (including its '\\0') and the value.
+
+Updates are appended to the log of the active bank, hence the cells wear evenly.
+Only if the active bank is full, the latest record of every key is copied to the other bank (compaction),
+whose header is written last to make it the active one.
+A record's length byte is written after its content, so an interrupted update leaves the previous log intact.
+(If the update needed a compaction, the property may fall back to its default though.)
+
+The EEPROM address of the latest record of every key is kept in a small index in RAM,
+which is built from the log by #a2jPropsEeInit. */
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_PROPS_EE
+
+#include <stdbool.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include "arduino2j.h"
+#include "a2j_props_ee.h"
+
+/** Marks the header of a valid bank. */
+#define A2J_PROPS_EE_MAGIC 0xA2
+/** Length of the header of a bank (magic, generation). */
+#define A2J_PROPS_EE_HDR 2
+/** Terminates the log. */
+#define A2J_PROPS_EE_END 0xFF
+#define A2J_PROPS_EE_BANK (A2J_PROPS_EE_SIZE / 2)
+#define A2J_PROPS_EE_BANK0 (A2J_PROPS_EE_START)
+#define A2J_PROPS_EE_BANK1 (A2J_PROPS_EE_START + A2J_PROPS_EE_BANK)
+
+/** @name External properties */
+//@{
+extern char const PROGMEM a2j_props[];
+extern const uint32_t a2j_props_size;
+//@}
+
+/** Index entry of an overridden property. */
+typedef struct{
+	uint16_t voff; /**< Offset of the default value in #a2j_props. */
+	uint16_t rec; /**< EEPROM address of the latest record. */
+}ee_idx;
+
+static ee_idx idx[A2J_PROPS_EE_KEYS];
+static uint8_t idxCnt = 0;
+/** Start address of the active bank. */
+static uint16_t bank;
+/** Generation of the active bank. */
+static uint8_t gen;
+/** Address of the log's terminator in the active bank. */
+static uint16_t tail;
+
+static inline uint8_t eeRd(uint16_t addr){
+	return eeprom_read_byte((const uint8_t*)addr);
+}
+
+static inline void eeWr(uint16_t addr, uint8_t val){
+	eeprom_update_byte((uint8_t*)addr, val);
+}
+
+/** Returns the index entry for the property with the default value at \a voff or NULL. */
+static ee_idx* a2jPropsEeIdx(uint16_t voff){
+	for(uint8_t i = 0; i < idxCnt; i++){
+		if(idx[i].voff == voff)
+			return &idx[i];
+	}
+	return NULL;
+}
+
+/** Adds the record at \a rec to the index if its key is still present in flash. */
+static void a2jPropsEeIndex(uint16_t rec){
+	char key[A2J_PROPS_EE_KEYLEN + 1];
+	uint8_t klen = 0;
+	uint16_t addr = rec + 1;
+	while(klen <= A2J_PROPS_EE_KEYLEN && (key[klen] = eeRd(addr++)) != '\0')
+		klen++;
+	if(klen > A2J_PROPS_EE_KEYLEN)
+		return;
+
+	uint16_t voff = a2jFindProp(key, klen);
+	if(voff >= a2j_props_size)
+		return;
+	ee_idx* e = a2jPropsEeIdx(voff);
+	if(e == NULL){
+		if(idxCnt >= A2J_PROPS_EE_KEYS)
+			return;
+		e = &idx[idxCnt++];
+		e->voff = voff;
+	}
+	e->rec = rec;
+}
+
+/** Copies the latest record of every indexed property but \a skip to the inactive bank and activates it. */
+static void a2jPropsEeCompact(const ee_idx* skip){
+	uint16_t dst = (bank == A2J_PROPS_EE_BANK0) ? A2J_PROPS_EE_BANK1 : A2J_PROPS_EE_BANK0;
+	eeWr(dst, 0); // invalidate until completely written
+
+	uint16_t addr = dst + A2J_PROPS_EE_HDR;
+	for(uint8_t i = 0; i < idxCnt; i++){
+		if(&idx[i] == skip)
+			continue;
+		uint16_t rec = idx[i].rec;
+		uint16_t len = 1 + eeRd(rec);
+		for(uint16_t j = 0; j < len; j++)
+			eeWr(addr + j, eeRd(rec + j));
+		idx[i].rec = addr;
+		addr += len;
+	}
+	if(addr < dst + A2J_PROPS_EE_BANK)
+		eeWr(addr, A2J_PROPS_EE_END);
+	gen++;
+	eeWr(dst + 1, gen);
+	eeWr(dst, A2J_PROPS_EE_MAGIC);
+	bank = dst;
+	tail = addr;
+}
+
+/** Selects the active bank and builds the index from its log.
+An EEPROM without valid bank is formatted. */
+void a2jPropsEeInit(void){
+	bool v0 = eeRd(A2J_PROPS_EE_BANK0) == A2J_PROPS_EE_MAGIC;
+	bool v1 = eeRd(A2J_PROPS_EE_BANK1) == A2J_PROPS_EE_MAGIC;
+	uint8_t g0 = eeRd(A2J_PROPS_EE_BANK0 + 1);
+	uint8_t g1 = eeRd(A2J_PROPS_EE_BANK1 + 1);
+
+	idxCnt = 0;
+	if(!v0 && !v1){
+		bank = A2J_PROPS_EE_BANK0;
+		gen = 0;
+		eeWr(bank + A2J_PROPS_EE_HDR, A2J_PROPS_EE_END);
+		eeWr(bank + 1, gen);
+		eeWr(bank, A2J_PROPS_EE_MAGIC);
+	} else if(v1 && (!v0 || (int8_t)(g1 - g0) > 0)){
+		bank = A2J_PROPS_EE_BANK1;
+		gen = g1;
+	} else {
+		bank = A2J_PROPS_EE_BANK0;
+		gen = g0;
+	}
+
+	uint16_t addr = bank + A2J_PROPS_EE_HDR;
+	uint8_t len;
+	while(addr < bank + A2J_PROPS_EE_BANK && (len = eeRd(addr)) != A2J_PROPS_EE_END){
+		if(addr + 1 + len > bank + A2J_PROPS_EE_BANK)
+			break;
+		a2jPropsEeIndex(addr);
+		addr += 1 + len;
+	}
+	tail = addr;
+}
+
+/** Looks up the overridden value of the property with the default value at \a voff in #a2j_props.
+@return the EEPROM address of the value (its length is stored at \a lenp) or 0 if the property is not overridden */
+uint16_t a2jPropsEeGet(uint16_t voff, uint8_t *const lenp){
+	ee_idx* e = a2jPropsEeIdx(voff);
+	if(e == NULL)
+		return 0;
+
+	uint8_t len = eeRd(e->rec);
+	uint16_t addr = e->rec + 1;
+	uint8_t klen = 0;
+	while(eeRd(addr + klen) != '\0')
+		klen++;
+	*lenp = len - klen - 1;
+	return addr + klen + 1;
+}
+
+/** Stores \a vlen bytes at \a val as new value of the property \a key (of length \a klen),
+whose default value is at \a voff in #a2j_props.
+@return 0 on success, 1 if the record is too long, 2 if too many properties are overridden, 3 if the EEPROM is full */
+uint8_t a2jPropsEeSet(uint16_t voff, const char* key, uint8_t klen, const uint8_t* val, uint8_t vlen){
+	uint16_t len = klen + 1 + vlen;
+	if(klen > A2J_PROPS_EE_KEYLEN || len >= A2J_PROPS_EE_END)
+		return 1;
+	ee_idx* e = a2jPropsEeIdx(voff);
+	if(e == NULL && idxCnt >= A2J_PROPS_EE_KEYS)
+		return 2;
+
+	if(tail + 1 + len > bank + A2J_PROPS_EE_BANK){
+		// the current record of this property is superseded, hence it is not copied
+		uint16_t used = A2J_PROPS_EE_HDR + 1 + len;
+		for(uint8_t i = 0; i < idxCnt; i++){
+			if(&idx[i] != e)
+				used += 1 + eeRd(idx[i].rec);
+		}
+		if(used > A2J_PROPS_EE_BANK)
+			return 3;
+		a2jPropsEeCompact(e);
+	}
+
+	uint16_t rec = tail;
+	uint16_t addr = rec + 1;
+	for(uint8_t i = 0; i < klen; i++)
+		eeWr(addr++, key[i]);
+	eeWr(addr++, '\0');
+	for(uint8_t i = 0; i < vlen; i++)
+		eeWr(addr++, val[i]);
+	if(addr < bank + A2J_PROPS_EE_BANK)
+		eeWr(addr, A2J_PROPS_EE_END);
+	eeWr(rec, len); // commits the record
+
+	if(e == NULL){
+		e = &idx[idxCnt++];
+		e->voff = voff;
+	}
+	e->rec = rec;
+	tail = addr;
+	return 0;
+}
+
+#endif // A2J_PROPS_EE
+#endif // A2J
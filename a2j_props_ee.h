@@ -0,0 +1,40 @@
+/** \file
+EEPROM overlay for arduino2j properties header.*/
+
+#ifndef A2J_PROPS_EE_H
+#define A2J_PROPS_EE_H
+
+#include <stdint.h>
+
+#ifdef A2J_PROPS_EE
+
+/** @name EEPROM overlay settings */
+//@{
+#ifndef A2J_PROPS_EE_START
+/** First EEPROM address used for the overlay. */
+#define A2J_PROPS_EE_START 0
+#endif
+#ifndef A2J_PROPS_EE_SIZE
+/** Number of EEPROM bytes used for the overlay. Split into two banks, hence it needs to be even. */
+#define A2J_PROPS_EE_SIZE 256
+#endif
+#ifndef A2J_PROPS_EE_KEYS
+/** Maximum number of properties that can be overridden (each costs 4B of RAM). */
+#define A2J_PROPS_EE_KEYS 8
+#endif
+#ifndef A2J_PROPS_EE_KEYLEN
+/** Maximum length of the key of an overridden property. */
+#define A2J_PROPS_EE_KEYLEN 31
+#endif
+//@}
+
+#if (A2J_PROPS_EE_SIZE & 1) || A2J_PROPS_EE_SIZE < 8
+	#error "A2J_PROPS_EE_SIZE needs to be even and at least 8"
+#endif
+
+void a2jPropsEeInit(void);
+uint16_t a2jPropsEeGet(uint16_t voff, uint8_t *const lenp);
+uint8_t a2jPropsEeSet(uint16_t voff, const char* key, uint8_t klen, const uint8_t* val, uint8_t vlen);
+
+#endif // A2J_PROPS_EE
+#endif // A2J_PROPS_EE_H
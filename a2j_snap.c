@@ -0,0 +1,76 @@
+/** \file
+Consistent snapshots of data produced by interrupt service routines (see a2j_snap.h).
+
+The indices are single bytes, which are read and written atomically. */
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_SNAP
+
+#include <stdbool.h>
+#include <string.h>
+#include "arduino2j.h"
+#include "a2j_snap.h"
+
+/** Publishes the buffer filled by the producer and selects the next one, which is neither published nor pinned.
+Must not be interrupted by the reader. */
+void a2jSnapPublish(a2j_snap* s){
+	uint8_t pub = s->wr;
+	s->pub = pub;
+	uint8_t pin = s->pin;
+	uint8_t wr = 0;
+	while(wr == pub || wr == pin)
+		wr++;
+	s->wr = wr;
+}
+
+/** Pins the latest published buffer (releasing the one pinned before) and returns it.
+The buffer stays unchanged until the next call or #a2jSnapUnpin. */
+const uint8_t* a2jSnapPin(a2j_snap* s){
+	uint8_t pub;
+	do{
+		pub = s->pub;
+		s->pin = pub;
+		// a publish in between may have selected this buffer to be filled next before it was pinned
+	}while(s->pub != pub);
+	return s->buf + pub * s->size;
+}
+
+/** Releases the pinned buffer. */
+void a2jSnapUnpin(a2j_snap* s){
+	s->pin = A2J_SNAP_NONE;
+}
+
+/**@ingroup j2amany
+Reads snapshot \a s via a2jMany.
+A write without data starts a transfer: it pins the latest version and replies with the size of the snapshot (2 byte little-endian).
+Reads are served from the pinned version (the latest one is pinned if there is none), so a retry of any chunk,
+including the one at offset 0, returns the same data as before.
+@return 0 on success, -1 on writes with data and offsets beyond the snapshot */
+uint8_t a2jSnapMany(a2j_snap* s, bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	if(isWrite){
+		if(*lenp != 0)
+			return -1;
+		a2jSnapPin(s);
+		a2jPutU16(*datap, s->size);
+		*lenp = 2;
+		*isLastp = true;
+		return 0;
+	}
+	if(*offset >= s->size)
+		return -1;
+
+	uint8_t pin = s->pin;
+	const uint8_t* buf = pin == A2J_SNAP_NONE ? a2jSnapPin(s) : s->buf + pin * s->size;
+	uint16_t rest = s->size - *offset;
+	uint8_t len = rest < A2J_MANY_PAYLOAD ? rest : A2J_MANY_PAYLOAD;
+	memcpy(*datap, buf + *offset, len);
+	*lenp = len;
+	*isLastp = len == rest;
+	return 0;
+}
+
+#endif // A2J_SNAP
+#endif // A2J
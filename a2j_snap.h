@@ -0,0 +1,78 @@
+/** \file
+Consistent snapshots of data produced by interrupt service routines.
+
+A snapshot (#a2j_snap) consists of three equally sized buffers. The producer (usually an ISR) fills the buffer returned by
+#a2jSnapWriteBuf and publishes it completely with #a2jSnapPublish, which just swaps indices.
+The reader pins the latest published buffer with #a2jSnapPin and can copy from it for as long as it likes,
+the producer never writes into a published or pinned buffer. Neither side disables interrupts.
+
+Three buffers are needed because a pinned buffer may stay pinned while the producer publishes several times:
+one buffer is pinned, one holds the latest version and the producer fills the third one.
+With only two the producer would have to wait for the reader or overwrite the pinned version.
+
+#a2jSnapMany serves a snapshot via a2jMany. The host starts a transfer explicitly with a write without data,
+which pins the latest version. All reads (at any offset, also retries and retransmissions of windowed reads,
+see #a2jManyWindow) are served from the pinned version until the next transfer is started,
+hence multi-chunk reads are consistent. Reads without a pinned version pin the latest one.
+Define a handler for the jumptable with #A2J_SNAP_MANY, e.g.
+\code
+A2J_SNAP_DEFINE(samples, 512);
+A2J_SNAP_MANY(getSamples, samples)
+
+ISR(ADC_vect){
+	static uint16_t i = 0;
+	uint8_t* buf = a2jSnapWriteBuf(&samples);
+	buf[i++] = ADCH;
+	if(i == 512){
+		a2jSnapPublish(&samples);
+		i = 0;
+	}
+}
+\endcode
+
+There must be only one producer and one reader per snapshot. #a2jSnapPublish must not be interrupted by the reader
+(which holds if it is called from an ISR and the reader runs in #a2jProcess, or both run in the same context). */
+
+#ifndef A2J_SNAP_H
+#define A2J_SNAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef A2J_SNAP
+
+/** Value of #a2j_snap::pin if no buffer is pinned. */
+#define A2J_SNAP_NONE 0xFF
+
+/** State of a snapshot. Define instances with #A2J_SNAP_DEFINE. */
+typedef struct{
+	uint8_t* buf; /**< Three buffers of #size bytes each. */
+	uint16_t size; /**< Size of a buffer in bytes. */
+	volatile uint8_t pub; /**< Index of the latest published buffer. */
+	volatile uint8_t pin; /**< Index of the buffer pinned by the reader or #A2J_SNAP_NONE. */
+	volatile uint8_t wr; /**< Index of the buffer filled by the producer. */
+}a2j_snap;
+
+/** Defines the snapshot \a name with buffers of \a size bytes. Initially a version of zeros is published. */
+#define A2J_SNAP_DEFINE(name, size) \
+	static uint8_t name##_bufs[3 * (uint32_t)(size)]; \
+	a2j_snap name = {name##_bufs, (size), 0, A2J_SNAP_NONE, 1}
+
+/** Defines the #CMD_P_MANY function \a func serving snapshot \a snap with #a2jSnapMany. */
+#define A2J_SNAP_MANY(func, snap) \
+	uint8_t func(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){ \
+		return a2jSnapMany(&(snap), isLastp, isWrite, offset, lenp, datap); \
+	}
+
+/** Returns the buffer the producer has to fill next. It stays the same until #a2jSnapPublish is called. */
+static inline uint8_t* a2jSnapWriteBuf(a2j_snap* s){
+	return s->buf + s->wr * s->size;
+}
+
+void a2jSnapPublish(a2j_snap* s);
+const uint8_t* a2jSnapPin(a2j_snap* s);
+void a2jSnapUnpin(a2j_snap* s);
+uint8_t a2jSnapMany(a2j_snap* s, bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+
+#endif // A2J_SNAP
+#endif // A2J_SNAP_H
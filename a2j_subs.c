@@ -0,0 +1,151 @@
+/** \file
+Telemetry subscriptions.
+
+Keeps the subscription table in #a2j_arena and pushes the changed values from #a2jProcess
+(see a2j_subs.h for the semantics). The values are read with #a2jRegionRead, so everything reachable by #a2jRegion
+can be subscribed to and the permissions of the regions apply.
+The table is only touched from #a2jProcess (#a2jSubsPoll before a request is processed, #a2jSubscribe while processing it),
+so it needs no locking. */
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_SUBS
+
+#include <stdbool.h>
+#include <string.h>
+#include "arduino2j.h"
+#include "a2j_subs.h"
+#include "a2j_arena.h"
+#include "a2j_time.h"
+
+/** Ticks of #a2jTime per ms. */
+#define A2J_SUBS_TICKS_MS (A2J_TIME_HZ / 1000)
+
+A2J_LAYOUT(a2jSubRec, A2J_SUB_REC)
+
+/** Returns the value at \a p of subscription \a sub as integer (sign extended if #A2J_SUB_SIGNED is set). */
+static uint32_t a2jSubInt(const a2j_sub* sub, const uint8_t* p){
+	uint32_t v = 0;
+	for(uint8_t i = sub->len; i-- > 0; )
+		v = (v << 8) | p[i];
+	if((sub->flags & A2J_SUB_SIGNED) && sub->len < 4 && (p[sub->len - 1] & 0x80))
+		v |= 0xFFFFFFFFUL << (8 * sub->len);
+	return v;
+}
+
+/** @return true if \a val has to be pushed for subscription \a sub */
+static bool a2jSubChanged(const a2j_sub* sub, const uint8_t* val){
+	if(sub->deadband == 0)
+		return memcmp(sub->value, val, sub->len) != 0;
+
+	uint32_t a = a2jSubInt(sub, val);
+	uint32_t b = a2jSubInt(sub, sub->value);
+	bool greater = (sub->flags & A2J_SUB_SIGNED) ? (int32_t)a > (int32_t)b : a > b;
+	// the difference always fits unsigned
+	uint32_t diff = greater ? a - b : b - a;
+	return diff > sub->deadband;
+}
+
+void a2jSubsPoll(void){
+	static uint32_t lastPoll;
+	// slot the scan starts with, following the one pushed last, so frequently changing slots cannot starve the others
+	static uint8_t first = 0;
+	uint32_t now = a2jTime();
+	if(now - lastPoll < (uint32_t)A2J_SUBS_TICK * A2J_SUBS_TICKS_MS)
+		return;
+	lastPoll = now;
+
+	uint8_t* buf = a2j_arena.subsSif;
+	uint8_t len = 0;
+	for(uint8_t i = 0; i < A2J_SUBS_CNT; i++){
+		uint8_t s = (first + i) % A2J_SUBS_CNT;
+		const a2j_sub* sub = &a2j_arena.subs[s];
+		if(sub->len == 0 || len + 1 + sub->len > A2J_SUBS_SIF_LEN)
+			continue;
+		bool fresh = sub->flags & A2J_SUB_FRESH;
+		if(!fresh && now - sub->last < (uint32_t)sub->period * A2J_SUBS_TICKS_MS)
+			continue;
+		uint8_t* val = buf + len + 1;
+		if(a2jRegionRead(sub->offset, val, sub->len) != 0)
+			continue;
+		if(!fresh && !a2jSubChanged(sub, val))
+			continue;
+		buf[len] = s;
+		len += 1 + sub->len;
+	}
+	if(len == 0)
+		return;
+	// on failure the values are still considered changed and pushed with the next poll
+	if(a2jSendSif(A2J_SUBS_SIF, len, buf) != 0)
+		return;
+
+	for(uint8_t i = 0; i < len; ){
+		a2j_sub* sub = &a2j_arena.subs[buf[i]];
+		memcpy(sub->value, buf + i + 1, sub->len);
+		sub->last = now;
+		sub->flags &= ~A2J_SUB_FRESH;
+		first = (buf[i] + 1) % A2J_SUBS_CNT;
+		i += 1 + sub->len;
+	}
+}
+
+/**@ingroup j2acmds
+Adds, changes and cancels subscriptions.
+
+The request consists of any number of records of #A2J_SUB_REC_LEN bytes (integers little-endian):
+slot (1 byte), offset for #a2jRegion (4), length (1), \ref A2J_SUB_SIGNED "flags" (1), minimum period in ms (2) and deadband (2).
+A record with length 0 cancels the subscription of its slot (all of them for #A2J_SUB_ALL).
+Otherwise the slot is (re)subscribed and the value is pushed with the next poll.
+A deadband requires a length of 1, 2 or 4 bytes.
+The records are checked before any of them is applied, a request with an invalid record is rejected completely.
+
+The reply contains the number of slots (1 byte). */
+uint8_t a2jSubscribe(uint8_t *const lenp, uint8_t* *const datap){
+	uint8_t* data = *datap;
+	uint8_t len = *lenp;
+	if(len % A2J_SUB_REC_LEN != 0)
+		return -1;
+
+	uint8_t tmp[A2J_SUBS_LEN];
+	for(uint8_t i = 0; i < len; i += A2J_SUB_REC_LEN){
+		const uint8_t* rec = data + i;
+		uint8_t slot = a2jSubRec_slot(rec);
+		uint8_t vlen = a2jSubRec_len(rec);
+		if(vlen == 0){
+			if(slot >= A2J_SUBS_CNT && slot != A2J_SUB_ALL)
+				return -1;
+			continue;
+		}
+		if(slot >= A2J_SUBS_CNT || vlen > A2J_SUBS_LEN)
+			return -1;
+		if(a2jSubRec_deadband(rec) != 0 && vlen != 1 && vlen != 2 && vlen != 4)
+			return -1;
+		if(a2jRegionRead(a2jSubRec_offset(rec), tmp, vlen) != 0)
+			return -1;
+	}
+
+	for(uint8_t i = 0; i < len; i += A2J_SUB_REC_LEN){
+		const uint8_t* rec = data + i;
+		uint8_t slot = a2jSubRec_slot(rec);
+		if(slot == A2J_SUB_ALL){
+			for(uint8_t s = 0; s < A2J_SUBS_CNT; s++)
+				a2j_arena.subs[s].len = 0;
+			continue;
+		}
+		a2j_sub* sub = &a2j_arena.subs[slot];
+		sub->offset = a2jSubRec_offset(rec);
+		sub->len = a2jSubRec_len(rec);
+		sub->flags = (a2jSubRec_flags(rec) & A2J_SUB_SIGNED) | A2J_SUB_FRESH;
+		sub->period = a2jSubRec_period(rec);
+		sub->deadband = a2jSubRec_deadband(rec);
+	}
+
+	data[0] = A2J_SUBS_CNT;
+	*lenp = 1;
+	return 0;
+}
+
+#endif // A2J_SUBS
+#endif // A2J
@@ -0,0 +1,85 @@
+/** \file
+Telemetry subscriptions header.
+
+Instead of polling variables, the host subscribes to ranges of the memory regions (see #a2jRegion) with #a2jSubscribe.
+#a2jProcess compares the subscribed values with the values pushed last whenever it is called (at most every #A2J_SUBS_TICK ms)
+and pushes the changed ones in a service initiated frame with the command #A2J_SUBS_SIF.
+Its payload consists of one record per changed value: the slot (1 byte) followed by the value (as many bytes as subscribed).
+Values not fitting into one frame are pushed with the next one.
+The slots are scanned round-robin starting after the slot pushed last, so all changed values get their turn.
+
+A value is pushed if the minimum period of its subscription has elapsed since its last push and
+- it differs from the value pushed last (deadband 0) or
+- it differs by more than the deadband from the value pushed last, compared as little-endian integer of 1, 2 or 4 bytes
+  (signed if #A2J_SUB_SIGNED is set).
+
+The value is always pushed once after subscribing. Subscriptions persist (also across connections) until they are cancelled.*/
+
+#ifndef A2J_SUBS_H
+#define A2J_SUBS_H
+
+#include <stdint.h>
+
+#ifdef A2J_SUBS
+
+#if !defined(A2J_SIF) || !defined(A2J_REGIONS) || !defined(A2J_TIME)
+	#error "A2J_SUBS requires A2J_SIF, A2J_REGIONS and A2J_TIME"
+#endif
+
+/** @name Subscription settings */
+//@{
+#ifndef A2J_SUBS_CNT
+/** Number of subscription slots. */
+#define A2J_SUBS_CNT 8
+#endif
+#ifndef A2J_SUBS_LEN
+/** Maximum length of a subscribed value in bytes. */
+#define A2J_SUBS_LEN 8
+#endif
+#ifndef A2J_SUBS_SIF_LEN
+/** Maximum payload of a SIF carrying the changed values. */
+#define A2J_SUBS_SIF_LEN 32
+#endif
+#if A2J_SUBS_SIF_LEN < A2J_SUBS_LEN + 1
+	#error "A2J_SUBS_SIF_LEN has to hold at least one value"
+#endif
+#ifndef A2J_SUBS_SIF
+/** Command of the SIFs carrying the changed values. */
+#define A2J_SUBS_SIF 0xE0
+#endif
+#ifndef A2J_SUBS_TICK
+/** Minimum time between two comparisons of the subscribed values in ms. */
+#define A2J_SUBS_TICK 1
+#endif
+//@}
+
+/** @name Subscription flags */
+//@{
+#define A2J_SUB_SIGNED (1<<0) /**< The value is a signed integer (for the deadband). */
+#define A2J_SUB_FRESH (1<<7) /**< Internal: the value has not been pushed since subscribing. */
+//@}
+
+/** Length of a subscription record in the request of #a2jSubscribe. */
+#define A2J_SUB_REC_LEN 11
+/** Fields of a subscription record (see #A2J_LAYOUT). */
+#define A2J_SUB_REC(F, L) F(L, slot, U8, 0) F(L, offset, U32, 1) F(L, len, U8, 5) F(L, flags, U8, 6) \
+	F(L, period, U16, 7) F(L, deadband, U16, 9)
+/** Slot denoting all slots when cancelling. */
+#define A2J_SUB_ALL 0xFF
+
+/** State of a subscription slot. */
+typedef struct{
+	uint32_t offset; /**< Offset of the value for #a2jRegion. */
+	uint8_t len; /**< Length of the value, 0 if the slot is free. */
+	uint8_t flags; /**< See \ref A2J_SUB_SIGNED "subscription flags". */
+	uint16_t period; /**< Minimum time between two pushes in ms. */
+	uint16_t deadband;
+	uint32_t last; /**< Time of the last push. */
+	uint8_t value[A2J_SUBS_LEN]; /**< Value pushed last. */
+}a2j_sub;
+
+/** Pushes the subscribed values that changed (called by #a2jProcess). */
+void a2jSubsPoll(void);
+
+#endif // A2J_SUBS
+#endif // A2J_SUBS_H
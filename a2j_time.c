@@ -0,0 +1,64 @@
+/** \file
+Device clock of arduino2j.
+
+Provides a free running 32-bit clock used to timestamp frames (see #a2jTimeSync).
+The default implementation counts with Timer1, which is extended to 32 bits by its overflow interrupt.
+Applications that need Timer1 themselves (or have a clock already) can define #A2J_TIME_EXTERN
+and provide #a2jTimeInit, #a2jTime and #A2J_TIME_HZ instead.
+The host build (A2J_HOST) and the link simulator (A2J_LINKSIM) provide their own clocks. */
+
+//ISO C forbids an empty source file
+#include <stdint.h>
+
+#ifdef A2J
+#ifdef A2J_TIME
+#if !defined(A2J_TIME_EXTERN) && !defined(A2J_HOST) && !defined(A2J_LINKSIM)
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "a2j_time.h"
+
+#if A2J_TIME_PRESCALER == 1
+	#define A2J_TIME_CS (_BV(CS10))
+#elif A2J_TIME_PRESCALER == 8
+	#define A2J_TIME_CS (_BV(CS11))
+#elif A2J_TIME_PRESCALER == 64
+	#define A2J_TIME_CS (_BV(CS11) | _BV(CS10))
+#elif A2J_TIME_PRESCALER == 256
+	#define A2J_TIME_CS (_BV(CS12))
+#elif A2J_TIME_PRESCALER == 1024
+	#define A2J_TIME_CS (_BV(CS12) | _BV(CS10))
+#else
+	#error "A2J_TIME_PRESCALER has to be 1, 8, 64, 256 or 1024"
+#endif
+
+/** Upper 16 bits of the clock. */
+static volatile uint16_t timeHigh = 0;
+
+ISR(TIMER1_OVF_vect){
+	timeHigh++;
+}
+
+void a2jTimeInit(void){
+	TCCR1A = 0;
+	TCNT1 = 0;
+	TCCR1B = A2J_TIME_CS;
+	TIMSK1 |= _BV(TOIE1);
+}
+
+uint32_t a2jTime(void){
+	uint16_t hi, lo;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		hi = timeHigh;
+		lo = TCNT1;
+		// overflow not handled yet
+		if((TIFR1 & _BV(TOV1)) && lo < 0x8000)
+			hi++;
+	}
+	return ((uint32_t)hi << 16) | lo;
+}
+
+#endif // !A2J_TIME_EXTERN && !A2J_HOST && !A2J_LINKSIM
+#endif // A2J_TIME
+#endif // A2J
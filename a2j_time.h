@@ -0,0 +1,34 @@
+/** \file
+Device clock of arduino2j header.*/
+
+#ifndef A2J_TIME_H
+#define A2J_TIME_H
+
+#include <stdint.h>
+
+#ifdef A2J_TIME
+
+/** @name Device clock settings */
+//@{
+#ifndef A2J_TIME_PRESCALER
+/** Prescaler of Timer1 (1, 8, 64, 256 or 1024). */
+#define A2J_TIME_PRESCALER 8
+#endif
+#if !defined(A2J_TIME_HZ) && (defined(A2J_HOST) || defined(A2J_LINKSIM))
+/* the host build and the link simulator count microseconds (see a2j_lowlevel_host.c, a2j_lowlevel_sim.c) */
+#define A2J_TIME_HZ 1000000UL
+#endif
+#ifndef A2J_TIME_HZ
+/** Frequency of #a2jTime in Hz. Has to be defined when providing another clock (see #A2J_TIME_EXTERN). */
+#define A2J_TIME_HZ (F_CPU / A2J_TIME_PRESCALER)
+#endif
+//@}
+
+/** Starts the clock. Called by #a2jInit. */
+void a2jTimeInit(void);
+/** Returns the current time in ticks of 1/#A2J_TIME_HZ seconds.
+The value wraps around after 2^32 ticks. May be called in interrupt context. */
+uint32_t a2jTime(void);
+
+#endif // A2J_TIME
+#endif // A2J_TIME_H
@@ -14,11 +14,44 @@ For documentation of the code of the "other" side please see j2arduino and espec
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <util/atomic.h>
+#ifdef A2J_CRC16
+#include <util/crc16.h>
+#endif
 #include "a2j_lowlevel.h"
 #include "arduino2j.h"
+#include "a2j_arena.h"
+#if defined(A2J_PROPS_EE) || defined(A2J_REGIONS)
+#include <avr/eeprom.h>
+#endif
+#ifdef A2J_PROPS_EE
+#include "a2j_props_ee.h"
+#endif
+#ifdef A2J_FWUPDATE
+#include "a2j_fwupdate.h"
+#endif
+#ifdef A2J_TIME
+#include "a2j_time.h"
+#endif
+#ifdef A2J_BUDGET
+#include "a2j_budget.h"
+#endif
+#ifdef A2J_SIMAVR
+#include <avr/io.h>
+#include <simavr/avr/avr_mcu_section.h>
+#endif
+
+#ifdef A2J_SIMAVR
+	/* Tells simavr the MCU and its clock, so the firmware can be loaded without further options. */
+	AVR_MCU(F_CPU, A2J_SIMAVR_MCU);
+	/** Writes the \ref simavrtrace "trace marker" \a m to #A2J_SIMAVR_REG. */
+	#define a2jTrace(m) (A2J_SIMAVR_REG = (m))
+#else
+	#define a2jTrace(m)
+#endif // A2J_SIMAVR
 
 #ifndef min
 #define min(x,y) ((x) < (y) ? (x) : (y))
@@ -45,6 +78,14 @@ static void a2jSendErrorFrame(uint8_t ret, uint8_t seq, uint16_t line);
 	//@}
 #endif // A2J_PROPS
 
+#ifdef A2J_REGIONS
+	/** @name External memory regions */
+	//@{
+	extern const PROGMEM a2j_region a2j_regions[];
+	extern const uint8_t a2j_regions_elems;
+	//@}
+#endif // A2J_REGIONS
+
 #else // A2J_OPTS
 
 	#ifdef __GNUC__
@@ -53,8 +94,173 @@ static void a2jSendErrorFrame(uint8_t ret, uint8_t seq, uint16_t line);
 
 	STARTJT
 	ENDJT
+
+	#ifdef A2J_REGIONS
+	STARTREGIONS
+	ENDREGIONS
+	#endif // A2J_REGIONS
 #endif // A2J_OPTS
 
+/** Reads the function pointer at offset \a off out of the jumptable in flash. */
+#if defined(A2J_FMAP) || defined(A2J_JT_FLAGS)
+	#define a2jJtCmd(off) pgm_read_word(&(a2j_jt[(off)].cmd))
+#else
+	#define a2jJtCmd(off) pgm_read_word(&a2j_jt[(off)])
+#endif
+#ifdef A2J_JT_FLAGS
+/** Reads the \ref jtflags "command flags" at offset \a off out of the jumptable in flash. */
+	#define a2jJtFlags(off) pgm_read_byte(&(a2j_jt[(off)].flags))
+#endif
+
+/** Sequence number of the frame currently processed by #a2jProcess. */
+static uint8_t curSeq;
+
+#ifdef A2J_JT_FLAGS
+/** @name Previous request
+Sequence number and offset of the last command executed by #a2jProcess, to detect repeated requests. */
+//@{
+static uint8_t lastSeq;
+static uint8_t lastOff;
+static bool lastValid = false;
+//@}
+#endif // A2J_JT_FLAGS
+
+/** All buffers of arduino2j (see a2j_arena.h). */
+a2j_arena_t a2j_arena;
+
+#ifdef A2J_ARENA_REPORT
+	#define A2J_XSTR(x) #x
+	#define A2J_STR(x) A2J_XSTR(x)
+	#pragma message("a2j arena: frame " A2J_STR(A2J_ARENA_FRAME) " B")
+	#pragma message("a2j arena: debug " A2J_STR(A2J_ARENA_DBG) " B")
+	#pragma message("a2j arena: fwupdate " A2J_STR(A2J_ARENA_FW) " B")
+	#pragma message("a2j arena: fast path " A2J_STR(A2J_ARENA_FAST) " B")
+	#pragma message("a2j arena: profiler " A2J_STR(A2J_ARENA_PROF) " B")
+	#pragma message("a2j arena: capture " A2J_STR(A2J_ARENA_CAPTURE) " B")
+	#pragma message("a2j arena: subscriptions " A2J_STR(A2J_ARENA_SUBS) " B")
+	#pragma message("a2j arena: prefetch " A2J_STR(A2J_ARENA_PREFETCH) " B")
+#endif // A2J_ARENA_REPORT
+
+#ifdef A2J_CRC16
+/** Checksum used for the frames of the current session. */
+static uint8_t csumMode = A2J_CSUM_XOR;
+/** Checksum to be used after the reply to #a2jSetChecksum has been sent. */
+static uint8_t csumModeNext = A2J_CSUM_XOR;
+#endif // A2J_CRC16
+
+#ifdef A2J_TIME
+/** Time the request being answered was received completely or #a2jSendSif was called. */
+static uint32_t stampTime;
+#ifdef A2J_BENCH
+/** Time the start of the request being answered was received. */
+static uint32_t benchStart;
+/** Timing of the last frame executed by #a2jExecute, reported by #a2jBenchStats. */
+static struct{
+	uint32_t rx; /**< Receiving the request. */
+	uint32_t exec; /**< Executing the command. */
+	uint32_t tx; /**< Sending the reply. */
+	uint8_t reqLen;
+	uint8_t replyLen;
+}bench;
+#endif // A2J_BENCH
+/** Timestamps are appended to the frames of the current session (see #a2jTimeSync). */
+static bool stamps = false;
+/** Timestamps to be used after the reply to #a2jTimeSync has been sent. */
+static bool stampsNext = false;
+#endif // A2J_TIME
+
+void a2jReset(void){
+#ifdef A2J_CRC16
+	csumMode = A2J_CSUM_XOR;
+	csumModeNext = A2J_CSUM_XOR;
+#endif // A2J_CRC16
+#ifdef A2J_JT_FLAGS
+	lastValid = false;
+#endif // A2J_JT_FLAGS
+#ifdef A2J_TIME
+	stamps = false;
+	stampsNext = false;
+#endif // A2J_TIME
+}
+
+/** @name Frame checksum
+The checksum covers the sequence number, command, length and payload of a frame.
+Depending on the session it is either an 8-bit XOR sum or a CRC-16 (see #a2jSetChecksum).*/
+//@{
+/** Starts a new checksum over the header fields of a frame. */
+static uint16_t a2jCsumStart(uint8_t seq, uint8_t cmd, uint8_t len){
+#ifdef A2J_CRC16
+	if(csumMode == A2J_CSUM_CRC16){
+		uint16_t crc = _crc_ccitt_update(0xFFFF, seq);
+		crc = _crc_ccitt_update(crc, cmd);
+		return _crc_ccitt_update(crc, len);
+	}
+#endif // A2J_CRC16
+	return (uint8_t)(seq ^ (cmd + A2J_CRC_CMD) ^ (len + A2J_CRC_LEN));
+}
+
+/** Adds one payload byte to the checksum. */
+static inline uint16_t a2jCsumAdd(uint16_t csum, uint8_t data){
+#ifdef A2J_CRC16
+	if(csumMode == A2J_CSUM_CRC16)
+		return _crc_ccitt_update(csum, data);
+#endif // A2J_CRC16
+	return csum ^ data;
+}
+
+/** Writes the checksum to the stream.
+@return 0 on success */
+static uint8_t a2jWriteCsum(uint16_t csum){
+#ifdef A2J_CRC16
+	if(csumMode == A2J_CSUM_CRC16){
+		if(a2jWriteEscapedByte(csum & 0xFF))
+			return 1;
+		return a2jWriteEscapedByte(csum >> 8);
+	}
+#endif // A2J_CRC16
+	return a2jWriteEscapedByte((uint8_t)csum);
+}
+
+#ifndef A2J_FASTPATH
+/** Reads the checksum from the stream and compares it to \a csum.
+@return 0 if they match, #A2J_RET_TO on timeouts and #A2J_RET_CHKSUM on a mismatch */
+static uint8_t a2jReadCsum(uint16_t csum){
+	uint8_t cnt = 1;
+#ifdef A2J_CRC16
+	if(csumMode == A2J_CSUM_CRC16)
+		cnt = 2;
+#endif // A2J_CRC16
+	bool match = true;
+	for(; cnt > 0; cnt--){
+		uint16_t tmp = a2jReadEscapedByte();
+		if(tmp > 0xFF)
+			return A2J_RET_TO;
+		if((uint8_t)tmp != (csum & 0xFF))
+			match = false;
+		csum >>= 8;
+	}
+	return match ? 0 : A2J_RET_CHKSUM;
+}
+#endif // A2J_FASTPATH
+
+#ifdef A2J_TIME
+/** Writes the timestamps #stampTime and \a txTime (little-endian) to the stream, if enabled for the session.
+@return the checksum \a csum updated by the timestamps */
+static uint16_t a2jWriteStamps(uint16_t csum, uint32_t txTime){
+	if(!stamps)
+		return csum;
+	uint8_t ts[8];
+	a2jPutU32(ts, stampTime);
+	a2jPutU32(ts + 4, txTime);
+	for(uint8_t i = 0; i < sizeof(ts); i++){
+		a2jWriteEscapedByte(ts[i]);
+		csum = a2jCsumAdd(csum, ts[i]);
+	}
+	return csum;
+}
+#endif // A2J_TIME
+//@}
+
 uint16_t a2jReadEscapedByte(){
 	// we need either one unescaped byte...
 	uint16_t data;
@@ -82,19 +288,81 @@ uint8_t a2jWriteEscapedByte(uint8_t data){
 		return a2jWriteByte(data);
 }
 
+#ifdef A2J_INDEX
+/** @name Sorted name indices
+The entries of an index are offsets (e.g. into the jumptable), whose names are returned by a function of type #a2jIndexKey.
+An index is sorted once by #a2jIndexSort and then searched by #a2jIndexFind. */
+//@{
+/** Returns the name (a C-string in flash) of the entry \a e of an index. */
+typedef PGM_P (*a2jIndexKey)(uint16_t e);
+
+/** Compares the \a len characters at \a name (not terminated) to the C-string \a key in flash like strcmp. */
+static int8_t a2jIndexCmp(const char* name, uint8_t len, PGM_P key){
+	int r = strncmp_P(name, key, len);
+	if(r != 0)
+		return r < 0 ? -1 : 1;
+	return pgm_read_byte(key + len) == '\0' ? 0 : -1;
+}
+
+/** Compares the C-strings \a a and \a b in flash like strcmp. */
+static int8_t a2jIndexCmp_P(PGM_P a, PGM_P b){
+	uint8_t ca, cb;
+	do{
+		ca = pgm_read_byte(a++);
+		cb = pgm_read_byte(b++);
+	}while(ca == cb && ca != '\0');
+	return ca < cb ? -1 : ca > cb;
+}
+
+/** Sorts the \a cnt entries at \a idx by their names.
+The insertion sort is stable, hence the first of several entries of the same name is found. */
+static void a2jIndexSort(uint16_t* idx, uint8_t cnt, a2jIndexKey key){
+	for(uint8_t i = 1; i < cnt; i++){
+		uint16_t e = idx[i];
+		PGM_P k = key(e);
+		uint8_t j = i;
+		for(; j > 0 && a2jIndexCmp_P(key(idx[j - 1]), k) > 0; j--)
+			idx[j] = idx[j - 1];
+		idx[j] = e;
+	}
+}
+
+/** Searches the \a cnt sorted entries at \a idx for the first one named like the \a len characters at \a name.
+@return the entry or 0xFFFF if there is none */
+static uint16_t a2jIndexFind(const uint16_t* idx, uint8_t cnt, a2jIndexKey key, const char* name, uint8_t len){
+	uint8_t lo = 0;
+	uint8_t hi = cnt;
+	while(lo < hi){
+		uint8_t mid = lo + (hi - lo) / 2;
+		if(a2jIndexCmp(name, len, key(idx[mid])) > 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if(lo < cnt && a2jIndexCmp(name, len, key(idx[lo])) == 0)
+		return idx[lo];
+	return 0xFFFF;
+}
+//@}
+#endif // A2J_INDEX
+
 /** @name Default arduino2j functions*/
 //@{
 #ifdef A2J_FMAP
 /** Fetches the function <-> name mapping from flash.
 The mappings are stored as C-strings in flash, first function (index 0) of the jumptable first, then second etc.
 This method retrieves them and puts them sequentially into memory starting at *datap.
-\todo redo with a2jMany*/
+If they do not fit into a single frame, -1 is returned and the mapping has to be fetched with #a2jGetMappingMany.*/
 uint8_t a2jGetMapping(uint8_t *const lenp, uint8_t* *const datap){
-	uint8_t retlen = 0;
+	uint16_t retlen = 0;
 	// get total length of mapping strings
 	for(uint8_t off=0; off<a2j_jt_elems; off++){
 		retlen += strlen_P((PGM_P)pgm_read_word(&(a2j_jt[off].name)))+1;
 	}
+	if(retlen > A2J_MAX_PAYLOAD){
+		*lenp = 0;
+		return -1;
+	}
 
 	char* data = (char*) *datap;
 	// copy all mapping strings into *data
@@ -110,8 +378,498 @@ uint8_t a2jGetMapping(uint8_t *const lenp, uint8_t* *const datap){
 	}
 	return 0;
 }
+
+/**@ingroup j2amany
+Fetches the function <-> name mapping from flash via a2jMany.
+The block read is the same sequence of C-strings as returned by #a2jGetMapping,
+but it is not limited in size. Writes are not possible. */
+uint8_t a2jGetMappingMany(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	if(isWrite)
+		return -1;
+
+	uint32_t pos = 0; // offset of the current name inside the block
+	uint8_t len = 0;
+	uint8_t off = 0;
+	for(; off < a2j_jt_elems && len < A2J_MANY_PAYLOAD; off++){
+		PGM_P name = (PGM_P)pgm_read_word(&(a2j_jt[off].name));
+		uint8_t nlen = strlen_P(name) + 1;
+		if(pos + nlen > *offset){
+			uint8_t skip = (pos < *offset) ? *offset - pos : 0;
+			uint8_t cpylen = min(nlen - skip, A2J_MANY_PAYLOAD - len);
+			memcpy_P(*datap + len, name + skip, cpylen);
+			len += cpylen;
+		}
+		pos += nlen;
+	}
+
+	if(len == 0)
+		return -1;
+	*lenp = len;
+	*isLastp = (off == a2j_jt_elems) && (*offset + len == pos);
+	return 0;
+}
+
+#ifdef A2J_INDEX
+/** Index of the function names (see #a2jFindFunc). */
+static uint16_t jtIndex[A2J_INDEX_FUNCS];
+static bool jtIndexValid = false;
+
+/** Returns the name of the function at \a off in the jumptable. */
+static PGM_P a2jJtName(uint16_t off){
+	return (PGM_P)pgm_read_word(&(a2j_jt[off].name));
+}
+#endif // A2J_INDEX
+
+/** Searches the jumptable for the function named like the \a len characters at \a name.
+With A2J_INDEX the names are sorted into an index on the first call and searched binary
+(unless the jumptable has more than #A2J_INDEX_FUNCS entries), else they are scanned.
+@return the offset of the function or 0xFF if there is none */
+static uint8_t a2jFindFunc(const char* name, uint8_t len){
+#ifdef A2J_INDEX
+	if(!jtIndexValid && a2j_jt_elems <= A2J_INDEX_FUNCS){
+		for(uint8_t off = 0; off < a2j_jt_elems; off++)
+			jtIndex[off] = off;
+		a2jIndexSort(jtIndex, a2j_jt_elems, a2jJtName);
+		jtIndexValid = true;
+	}
+	if(jtIndexValid)
+		return (uint8_t)a2jIndexFind(jtIndex, a2j_jt_elems, a2jJtName, name, len);
+#endif // A2J_INDEX
+	for(uint8_t off = 0; off < a2j_jt_elems; off++){
+		PGM_P fname = (PGM_P)pgm_read_word(&(a2j_jt[off].name));
+		if(strncmp_P(name, fname, len) == 0 && pgm_read_byte(fname + len) == '\0')
+			return off;
+	}
+	return 0xFF;
+}
+
+/** Resolves function names to their offsets in the jumptable.
+The payload consists of one or more names separated by '\\0'.
+The reply contains one byte per name: the offset of the function or 0xFF if there is no function of that name.
+Hence a host can resolve the functions it needs without fetching the whole mapping. */
+uint8_t a2jLookup(uint8_t *const lenp, uint8_t* *const datap){
+	uint8_t* data = *datap;
+	uint8_t len = *lenp;
+	uint8_t cnt = 0;
+	uint8_t start = 0;
+	while(start < len){
+		uint8_t nlen = 0;
+		while(start + nlen < len && data[start + nlen] != '\0')
+			nlen++;
+
+		uint8_t found = a2jFindFunc((const char*)data + start, nlen);
+		// the name has been consumed, hence the result may overwrite it
+		data[cnt++] = found;
+		start += nlen + 1;
+	}
+	*lenp = cnt;
+	return 0;
+}
 #endif // A2J_FMAP
 
+#ifdef A2J_JT_FLAGS
+/** Fetches the \ref jtflags "command flags" of all jumptable entries.
+The reply contains one byte per entry, first function (index 0) of the jumptable first. */
+uint8_t a2jGetFlags(uint8_t *const lenp, uint8_t* *const datap){
+	for(uint8_t off = 0; off < a2j_jt_elems; off++)
+		(*datap)[off] = a2jJtFlags(off);
+	*lenp = a2j_jt_elems;
+	return 0;
+}
+
+/** @return true if the function at \a off is #a2jMany or #a2jManyWindow */
+static bool a2jIsMany(uint8_t off){
+	CMD_P cmd = (CMD_P)a2jJtCmd(off);
+	return cmd == &a2jMany
+#ifdef A2J_MANY_WIN
+			|| cmd == &a2jManyWindow
+#endif
+			;
+}
+
+/** Returns the \ref jtflags "command flags" that apply to the request for the function at \a off.
+Requests of #a2jMany (and #a2jManyWindow) inherit the flags of the addressed #CMD_P_MANY function,
+whose reads are idempotent unless it is flagged #A2J_JT_STREAMING. */
+static uint8_t a2jReqFlags(uint8_t off, const uint8_t* payload, uint8_t len){
+	if(!a2jIsMany(off))
+		return a2jJtFlags(off);
+
+	if(len < A2J_MANY_HEADER || a2jManyReq_func(payload) >= a2j_jt_elems)
+		return A2J_JT_IDEMPOTENT; // rejected by a2jMany anyway
+	uint8_t flags = a2jJtFlags(a2jManyReq_func(payload));
+	if(!(a2jManyReq_flags(payload) & A2J_MANY_ISWRITE_MASK) && !(flags & A2J_JT_STREAMING))
+		flags |= A2J_JT_IDEMPOTENT;
+	return flags;
+}
+
+#ifdef A2J_BUDGET
+/** Returns the jumptable offset of the function executing the request for the function at \a off,
+i.e. the addressed #CMD_P_MANY function for requests of #a2jMany (and #a2jManyWindow). */
+static uint8_t a2jReqFunc(uint8_t off, const uint8_t* payload, uint8_t len){
+	if(a2jIsMany(off) && len >= A2J_MANY_HEADER && a2jManyReq_func(payload) < a2j_jt_elems)
+		return a2jManyReq_func(payload);
+	return off;
+}
+#endif // A2J_BUDGET
+#endif // A2J_JT_FLAGS
+
+#ifdef A2J_DIGEST
+#ifndef A2J_DIGEST_VALUE
+/** Adds \a data to the CRC-32 \a crc. */
+static uint32_t a2jCrc32(uint32_t crc, uint8_t data){
+	crc ^= data;
+	for(uint8_t i = 0; i < 8; i++)
+		crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320UL : 0);
+	return crc;
+}
+
+/** Adds \a len bytes from flash at \a src to the CRC-32 \a crc. */
+static uint32_t a2jCrc32_P(uint32_t crc, PGM_VOID_P src, uint32_t len){
+	const uint8_t* p = (const uint8_t*)src;
+	for(; len > 0; len--)
+		crc = a2jCrc32(crc, pgm_read_byte(p++));
+	return crc;
+}
+#endif // A2J_DIGEST_VALUE
+
+/** Returns a digest of the function mapping and the properties.
+A host may cache the mapping and properties (together with the digest) and
+skip fetching them again on the next connection if the digest has not changed.
+The digest covers the defaults of the properties in flash only, hence with A2J_PROPS_EE the properties
+(possibly overridden by #a2jSetProperty) are not cacheable and have to be fetched on every connection.
+
+The reply contains the digest as 4 byte little-endian integer.
+If #A2J_DIGEST_VALUE is defined (e.g. by the build system), it is returned as is.
+Otherwise the CRC-32 over the number of jumptable entries, the mapping strings and the properties
+is calculated on the first call and cached. */
+uint8_t a2jGetDigest(uint8_t *const lenp, uint8_t* *const datap){
+#ifdef A2J_DIGEST_VALUE
+	uint32_t digest = A2J_DIGEST_VALUE;
+#else // A2J_DIGEST_VALUE
+	static uint32_t digest;
+	static bool valid = false;
+	if(!valid){
+		uint32_t crc = a2jCrc32(0xFFFFFFFFUL, a2j_jt_elems);
+	#ifdef A2J_FMAP
+		for(uint8_t off = 0; off < a2j_jt_elems; off++){
+			PGM_P name = (PGM_P)pgm_read_word(&(a2j_jt[off].name));
+			crc = a2jCrc32_P(crc, name, strlen_P(name) + 1);
+		}
+	#endif // A2J_FMAP
+	#ifdef A2J_JT_FLAGS
+		for(uint8_t off = 0; off < a2j_jt_elems; off++)
+			crc = a2jCrc32(crc, a2jJtFlags(off));
+	#endif // A2J_JT_FLAGS
+	#ifdef A2J_PROPS
+		crc = a2jCrc32_P(crc, a2j_props, a2j_props_size);
+	#endif // A2J_PROPS
+		digest = ~crc;
+		valid = true;
+	}
+#endif // A2J_DIGEST_VALUE
+	a2jPutU32(*datap, digest);
+	*lenp = sizeof(digest);
+	return 0;
+}
+#endif // A2J_DIGEST
+
+#ifdef A2J_TIME
+/** Synchronizes the clocks of host and device in the style of NTP.
+
+The host notes its time t1 before sending the request and t4 after receiving the reply.
+The reply contains the device time t2 the request was received completely and the device time t3 the reply was built
+(4 byte little-endian integers each, in ticks of the device clock) followed by the frequency of the device clock in Hz (4 bytes).
+After converting t2 and t3 to the host's unit, the clock offset is ((t2 - t1) + (t3 - t4)) / 2
+and the round trip delay (t4 - t1) - (t3 - t2).
+
+If the request contains a byte with bit 0 set, all following frames (replies, error frames and SIFs) carry two timestamps
+between the payload and the checksum: the time the request was received completely (for SIFs: the time #a2jSendSif was called)
+and the time the transmission of the frame started (4 byte little-endian integers each).
+They are covered by the checksum but not counted in the length field.
+A request with bit 0 cleared disables the timestamps. Changes take effect after the reply has been sent. */
+uint8_t a2jTimeSync(uint8_t *const lenp, uint8_t* *const datap){
+	uint32_t now = a2jTime();
+	if(*lenp > 0)
+		stampsNext = (*datap)[0] & 0x01;
+	uint8_t* p = *datap;
+	a2jPutU32(p, stampTime);
+	a2jPutU32(p + 4, now);
+	a2jPutU32(p + 8, A2J_TIME_HZ);
+	*lenp = 12;
+	return 0;
+}
+#endif // A2J_TIME
+
+#ifdef A2J_BENCH
+/** @name Link benchmark functions
+Besides these, #a2jEcho can be used as loopback as it replies with the unchanged payload of the request. */
+//@{
+/** Converts ticks of the device clock to CPU cycles. */
+#define a2jTicksToCycles(t) ((t) * (uint32_t)(F_CPU / A2J_TIME_HZ))
+
+/** @name Layouts of the benchmark commands (see #A2J_LAYOUT) */
+//@{
+#define A2J_BENCH_SOURCE_REQ(F, L) F(L, pattern, U8, 0) F(L, len, U8, 1)
+#define A2J_BENCH_MANY_REQ(F, L) F(L, pattern, U8, 0) F(L, size, U32, 1)
+#define A2J_BENCH_STATS(F, L) F(L, rx, U32, 0) F(L, exec, U32, 4) F(L, tx, U32, 8) F(L, reqLen, U8, 12) F(L, replyLen, U8, 13)
+A2J_LAYOUT(a2jBenchSourceReq, A2J_BENCH_SOURCE_REQ)
+A2J_LAYOUT(a2jBenchManyReq, A2J_BENCH_MANY_REQ)
+A2J_LAYOUT(a2jBenchStatsReply, A2J_BENCH_STATS)
+//@}
+
+/** Fills \a len bytes at \a data with the benchmark pattern \a pattern starting at position \a pos of the pattern. */
+static void a2jBenchFill(uint8_t* data, uint32_t pos, uint8_t len, uint8_t pattern){
+	static const uint8_t esc[] = {A2J_SOF, A2J_SOS, A2J_ESC};
+	for(uint8_t i = 0; i < len; i++, pos++){
+		switch(pattern){
+			case A2J_BENCH_COUNT:
+				data[i] = (uint8_t)pos;
+				break;
+			case A2J_BENCH_ESC:
+				data[i] = esc[pos % sizeof(esc)];
+				break;
+			case A2J_BENCH_RAMP:{
+				uint16_t sample = 1000 + (uint16_t)(pos / 16) * 3;
+				data[i] = (pos & 1) ? sample >> 8 : sample;
+				break;
+			}
+			default:
+				data[i] = 0;
+				break;
+		}
+	}
+}
+
+/** Discards the payload of the request. The reply is empty. */
+uint8_t a2jBenchSink(uint8_t *const lenp, uint8_t* *const datap){
+	(void)datap;
+	*lenp = 0;
+	return 0;
+}
+
+/** Generates a reply of the length given in the second byte of the request (up to #A2J_MAX_PAYLOAD),
+filled with the pattern given in the first byte (e.g. #A2J_BENCH_ESC). */
+uint8_t a2jBenchSource(uint8_t *const lenp, uint8_t* *const datap){
+	if(*lenp < 2)
+		return -1;
+	uint8_t pattern = a2jBenchSourceReq_pattern(*datap);
+	uint8_t len = a2jBenchSourceReq_len(*datap);
+	a2jBenchFill(*datap, 0, len, pattern);
+	*lenp = len;
+	return 0;
+}
+
+/**@ingroup j2amany
+Sink and source of arbitrary amounts of data via a2jMany.
+Writes are discarded. Read requests have to contain the pattern (1 byte, e.g. #A2J_BENCH_ESC)
+and the total size of the block (4 byte little-endian integer).*/
+uint8_t a2jBenchMany(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	if(isWrite){
+		*lenp = 0;
+		return 0;
+	}
+	if(*lenp < 5)
+		return -1;
+	uint8_t pattern = a2jBenchManyReq_pattern(*datap);
+	uint32_t size = a2jBenchManyReq_size(*datap);
+	if(*offset >= size)
+		return -1;
+	// keep the samples of A2J_BENCH_RAMP aligned to the chunks for the delta encoding
+	uint8_t len = min(size - *offset, pattern == A2J_BENCH_RAMP ? (A2J_MANY_PAYLOAD & ~1) : A2J_MANY_PAYLOAD);
+	a2jBenchFill(*datap, *offset, len, pattern);
+	*lenp = len;
+	*isLastp = (*offset + len) == size;
+	return 0;
+}
+
+/** Reports the timing of the previous frame in CPU cycles, measured by the device clock.
+The reply contains the cycles spent receiving the request (from its start byte until its checksum),
+executing the command and sending the reply (4 byte little-endian integers each),
+followed by the length of the request's and the reply's payload (1 byte each). */
+uint8_t a2jBenchStats(uint8_t *const lenp, uint8_t* *const datap){
+	uint8_t* p = *datap;
+	a2jBenchStatsReply_set_rx(p, a2jTicksToCycles(bench.rx));
+	a2jBenchStatsReply_set_exec(p, a2jTicksToCycles(bench.exec));
+	a2jBenchStatsReply_set_tx(p, a2jTicksToCycles(bench.tx));
+	a2jBenchStatsReply_set_reqLen(p, bench.reqLen);
+	a2jBenchStatsReply_set_replyLen(p, bench.replyLen);
+	*lenp = 14;
+	return 0;
+}
+//@}
+#endif // A2J_BENCH
+
+#ifdef A2J_CAPS
+/** \ref caps "Features" compiled in. */
+static const uint32_t capsFeatures = 0
+#ifdef A2J_FMAP
+	| A2J_CAP_FMAP
+#endif
+#ifdef A2J_DBG
+	| A2J_CAP_DBG
+#endif
+#ifdef A2J_PROPS
+	| A2J_CAP_PROPS
+#endif
+#ifdef A2J_PROPS_EE
+	| A2J_CAP_PROPS_EE
+#endif
+#ifdef A2J_SIF
+	| A2J_CAP_SIF
+#endif
+#ifdef A2J_MANY_WIN
+	| A2J_CAP_MANY_WIN
+#endif
+#ifdef A2J_CRC16
+	| A2J_CAP_CRC16
+#endif
+#ifdef A2J_MANY_RLE
+	| A2J_CAP_MANY_RLE
+#endif
+#ifdef A2J_DIGEST
+	| A2J_CAP_DIGEST
+#endif
+#ifdef A2J_REGIONS
+	| A2J_CAP_REGIONS
+#endif
+#ifdef A2J_FWUPDATE
+	| A2J_CAP_FWUPDATE
+#endif
+#ifdef A2J_MEMINFO
+	| A2J_CAP_MEMINFO
+#endif
+#ifdef A2J_JT_FLAGS
+	| A2J_CAP_JT_FLAGS
+#endif
+#ifdef A2J_FASTPATH
+	| A2J_CAP_FASTPATH
+#endif
+#ifdef A2J_TIME
+	| A2J_CAP_TIME
+#endif
+#ifdef A2J_PROF
+	| A2J_CAP_PROF
+#endif
+#ifdef A2J_BENCH
+	| A2J_CAP_BENCH
+#endif
+#ifdef A2J_CAPTURE
+	| A2J_CAP_CAPTURE
+#endif
+#ifdef A2J_SUBS
+	| A2J_CAP_SUBS
+#endif
+#ifdef A2J_PREFETCH
+	| A2J_CAP_PREFETCH
+#endif
+#ifdef A2J_BUDGET
+	| A2J_CAP_BUDGET
+#endif
+	;
+
+/** Reports the capabilities and limits of the firmware, which are fixed at build time.
+It is always found at #A2J_CAPS_OFFSET, hence a host can adapt its settings with a single round trip.
+The reply (version #A2J_CAPS_VERSION) consists of:
+- version of the record (1 byte)
+- number of jumptable entries (1 byte)
+- \ref caps "feature bitmap" (4 byte little-endian)
+- #A2J_MAX_PAYLOAD and #A2J_MANY_PAYLOAD (1 byte each)
+- #A2J_MANY_WINDOW (1 byte, 0 without A2J_MANY_WIN)
+- #A2J_FAST_PAYLOAD (1 byte, 0 without A2J_FASTPATH)
+- bitmap of the supported checksums (1 byte, bit i set if #a2jSetChecksum accepts i)
+- #A2J_TIME_HZ (4 byte little-endian, 0 without A2J_TIME)
+- the properties of the link (see #a2j_link_caps)
+
+Later versions only append fields. */
+uint8_t a2jGetCaps(uint8_t *const lenp, uint8_t* *const datap){
+	uint8_t* p = *datap;
+	p[0] = A2J_CAPS_VERSION;
+	p[1] = a2j_jt_elems;
+	a2jPutU32(p + 2, capsFeatures);
+	p[6] = A2J_MAX_PAYLOAD;
+	p[7] = A2J_MANY_PAYLOAD;
+#ifdef A2J_MANY_WIN
+	p[8] = A2J_MANY_WINDOW;
+#else
+	p[8] = 0;
+#endif
+#ifdef A2J_FASTPATH
+	p[9] = A2J_FAST_PAYLOAD;
+#else
+	p[9] = 0;
+#endif
+	p[10] = 1 << A2J_CSUM_XOR;
+#ifdef A2J_CRC16
+	p[10] |= 1 << A2J_CSUM_CRC16;
+#endif
+#ifdef A2J_TIME
+	a2jPutU32(p + 11, A2J_TIME_HZ);
+#else
+	a2jPutU32(p + 11, 0);
+#endif
+	memcpy_P(p + 15, a2j_link_caps, A2J_LINK_CAPS_LEN);
+	*lenp = 15 + A2J_LINK_CAPS_LEN;
+	return 0;
+}
+#endif // A2J_CAPS
+
+#ifdef A2J_MEMINFO
+/** @name Stack high-water probe */
+//@{
+extern uint8_t _end;
+extern uint8_t __stack;
+
+void a2jStackPaint(void) __attribute__((naked, used, section(".init1")));
+/** Paints the RAM between the end of .bss/.noinit and the top of the stack with #A2J_STACK_CANARY.
+Runs before the stack pointer is set up, hence it is written in assembler. */
+void a2jStackPaint(void){
+	__asm volatile (
+		"    ldi r30, lo8(_end)\n"
+		"    ldi r31, hi8(_end)\n"
+		"    ldi r24, %0\n"
+		"    ldi r25, hi8(__stack)\n"
+		"    rjmp 2f\n"
+		"1:  st Z+, r24\n"
+		"2:  cpi r30, lo8(__stack)\n"
+		"    cpc r31, r25\n"
+		"    brlo 1b\n"
+		"    breq 1b\n"
+		:: "M" (A2J_STACK_CANARY));
+}
+
+/** Returns the number of bytes above .bss/.noinit (and the heap) that have never been touched since reset. */
+static uint16_t a2jStackUnused(void){
+	const uint8_t* p = &_end;
+	while(p <= &__stack && *p == A2J_STACK_CANARY)
+		p++;
+	return p - &_end;
+}
+//@}
+
+/** Reports the RAM usage of arduino2j.
+The reply consists of the following 2 byte little-endian integers:
+- bytes between .bss and the stack that have never been used (stack high-water mark)
+- bytes currently unused between .bss and the stack pointer
+- total size of #a2j_arena
+- frame buffer, debug buffer, firmware update buffers, fast path buffer, profiler buffer, capture buffer, subscriptions and prefetch buffer (see a2j_arena.h)*/
+uint8_t a2jMemInfo(uint8_t *const lenp, uint8_t* *const datap){
+	uint8_t* p = *datap;
+	a2jPutU16(p, a2jStackUnused());
+	a2jPutU16(p + 2, SP - (uint16_t)&_end);
+	a2jPutU16(p + 4, sizeof(a2j_arena));
+	a2jPutU16(p + 6, A2J_ARENA_FRAME);
+	a2jPutU16(p + 8, A2J_ARENA_DBG);
+	a2jPutU16(p + 10, A2J_ARENA_FW);
+	a2jPutU16(p + 12, A2J_ARENA_FAST);
+	a2jPutU16(p + 14, A2J_ARENA_PROF);
+	a2jPutU16(p + 16, A2J_ARENA_CAPTURE);
+	a2jPutU16(p + 18, A2J_ARENA_SUBS);
+	a2jPutU16(p + 20, A2J_ARENA_PREFETCH);
+	*lenp = 22;
+	return 0;
+}
+#endif // A2J_MEMINFO
+
 #ifdef A2J_DBG
 /** Retrieves available characters from the debug buffer and puts them into memory starting at *datap.
 @see debug.c#buf */
@@ -137,24 +895,377 @@ uint8_t a2jManyReadFlash(bool* isLastp, bool isWrite, uint32_t *const offset, ui
 }
 
 #ifdef A2J_PROPS
-/** Fetches the property strings from flash.
+#ifdef A2J_PROPS_EE
+/** Appends the part of a piece of the property stream that lies in the chunk read by #a2jGetProperties.
+The piece consists of \a n bytes at \a src (an EEPROM address if \a ee, else an offset in #a2j_props)
+and starts at position \a *posp of the stream, which is advanced past it.
+The chunk starts at position \a offset of the stream and \a *lenp bytes of it have been stored at \a data so far. */
+static void a2jPropsPiece(uint8_t* data, uint32_t offset, uint8_t *const lenp, uint32_t *const posp, uint16_t src, uint16_t n, bool ee){
+	uint32_t need = offset + *lenp;
+	if(*posp <= need && *posp + n > need){
+		uint16_t skip = need - *posp;
+		uint8_t cnt = min(n - skip, A2J_MANY_PAYLOAD - *lenp);
+		if(ee)
+			eeprom_read_block(data + *lenp, (const void*)(src + skip), cnt);
+		else
+			memcpy_P(data + *lenp, a2j_props + src + skip, cnt);
+		*lenp += cnt;
+	}
+	*posp += n;
+}
+#endif // A2J_PROPS_EE
+
+/** Fetches the property strings.
 The properties are stored in pairs as consecutive C-strings in flash.
 This method retrieves them using a2jMany in the most obvious way,
 namely by sliding the a2jMany window over the string as requested.
-Writes are currently not possible. */
+With A2J_PROPS_EE values overridden by #a2jSetProperty replace the defaults in the stream
+(which is assembled from the pairs for every chunk then). Writes are not possible. */
 uint8_t a2jGetProperties(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+#ifdef A2J_PROPS_EE
+	if(isWrite)
+		return -1;
+	uint32_t pos = 0;
+	uint8_t len = 0;
+	uint16_t off = 0;
+	while(off < a2j_props_size && len < A2J_MANY_PAYLOAD){
+		uint16_t voff = off + strlen_P(a2j_props + off) + 1;
+		uint16_t vlen = strlen_P(a2j_props + voff);
+		a2jPropsPiece(*datap, *offset, &len, &pos, off, voff - off, false); // key and its '\0'
+		uint8_t eelen;
+		uint16_t eeaddr = a2jPropsEeGet(voff, &eelen);
+		if(eeaddr != 0)
+			a2jPropsPiece(*datap, *offset, &len, &pos, eeaddr, eelen, true);
+		else
+			a2jPropsPiece(*datap, *offset, &len, &pos, voff, vlen, false);
+		a2jPropsPiece(*datap, *offset, &len, &pos, voff + vlen, 1, false); // '\0' of the value
+		off = voff + vlen + 1;
+	}
+	if(*offset >= pos)
+		return -1;
+	*lenp = len;
+	*isLastp = off >= a2j_props_size && pos == *offset + len;
+	return 0;
+#else
 	return a2jManyReadFlash(isLastp, isWrite, offset, lenp, datap, a2j_props, a2j_props_size);
+#endif // A2J_PROPS_EE
+}
+
+#ifdef A2J_INDEX
+/** Index of the property keys (offsets into #a2j_props, see #a2jFindProp). */
+static uint16_t propIndex[A2J_INDEX_PROPS];
+static uint8_t propIndexCnt;
+static bool propIndexBuilt = false;
+static bool propIndexValid = false;
+
+/** Returns the key at \a off in #a2j_props. */
+static PGM_P a2jPropKey(uint16_t off){
+	return a2j_props + off;
+}
+#endif // A2J_INDEX
+
+/** Searches the properties for the key \a key of length \a len (without terminating '\\0').
+With A2J_INDEX the keys are sorted into an index on the first call and searched binary
+(unless there are more than #A2J_INDEX_PROPS properties), else they are scanned.
+@return the offset of the corresponding value in #a2j_props or #a2j_props_size if there is no such key */
+uint16_t a2jFindProp(const char* key, uint8_t len){
+#ifdef A2J_INDEX
+	if(!propIndexBuilt){
+		uint16_t cnt = 0;
+		for(uint16_t off = 0; off < a2j_props_size && cnt <= A2J_INDEX_PROPS; cnt++){
+			if(cnt < A2J_INDEX_PROPS)
+				propIndex[cnt] = off;
+			off += strlen_P(a2j_props + off) + 1;
+			off += strlen_P(a2j_props + off) + 1;
+		}
+		propIndexValid = cnt <= A2J_INDEX_PROPS;
+		if(propIndexValid){
+			propIndexCnt = cnt;
+			a2jIndexSort(propIndex, propIndexCnt, a2jPropKey);
+		}
+		propIndexBuilt = true;
+	}
+	if(propIndexValid){
+		uint16_t k = a2jIndexFind(propIndex, propIndexCnt, a2jPropKey, key, len);
+		return k == 0xFFFF ? a2j_props_size : k + strlen_P(a2j_props + k) + 1;
+	}
+#endif // A2J_INDEX
+	uint16_t off = 0;
+	while(off < a2j_props_size){
+		PGM_P k = a2j_props + off;
+		uint16_t voff = off + strlen_P(k) + 1;
+		if(voff - off - 1 == len && strncmp_P(key, k, len) == 0)
+			return voff;
+		off = voff + strlen_P(a2j_props + voff) + 1;
+	}
+	return a2j_props_size;
+}
+
+/** Fetches the value of a single property.
+The payload consists of the key (without terminating '\\0'),
+the reply contains the corresponding value (without terminating '\\0').
+Values stored by #a2jSetProperty take precedence over the defaults in flash.
+@return 0 on success, -1 if there is no such key or the value does not fit into a frame */
+uint8_t a2jGetProperty(uint8_t *const lenp, uint8_t* *const datap){
+	uint16_t voff = a2jFindProp((const char*)*datap, *lenp);
+	if(voff >= a2j_props_size){
+		*lenp = 0;
+		return -1;
+	}
+#ifdef A2J_PROPS_EE
+	uint8_t eelen;
+	uint16_t eeaddr = a2jPropsEeGet(voff, &eelen);
+	if(eeaddr != 0){
+		eeprom_read_block(*datap, (const void*)eeaddr, eelen);
+		*lenp = eelen;
+		return 0;
+	}
+#endif // A2J_PROPS_EE
+	uint16_t vlen = strlen_P(a2j_props + voff);
+	if(vlen > A2J_MAX_PAYLOAD){
+		*lenp = 0;
+		return -1;
+	}
+	memcpy_P(*datap, a2j_props + voff, vlen);
+	*lenp = vlen;
+	return 0;
+}
+
+#ifdef A2J_PROPS_EE
+/** Persistently overrides the value of a property.
+The payload consists of the key and the new value separated by '\\0'.
+Only properties defined in flash can be overridden.
+@return 0 on success, -1 if there is no such key, else the error returned by #a2jPropsEeSet */
+uint8_t a2jSetProperty(uint8_t *const lenp, uint8_t* *const datap){
+	const char* key = (const char*)*datap;
+	uint8_t len = *lenp;
+	*lenp = 0;
+	uint8_t klen = strnlen(key, len);
+	if(klen >= len)
+		return -1;
+	uint16_t voff = a2jFindProp(key, klen);
+	if(voff >= a2j_props_size)
+		return -1;
+	return a2jPropsEeSet(voff, key, klen, *datap + klen + 1, len - klen - 1);
 }
+#endif // A2J_PROPS_EE
 #endif // A2J_PROPS
 
-static uint8_t a2jSend_int(uint8_t start_byte, uint8_t cmd, uint8_t seq, uint8_t len, uint8_t* const data){
+#ifdef A2J_REGIONS
+/**@ingroup j2amany
+Fetches the descriptions of the memory regions via a2jMany.
+For every region (in the order of their indices) a record is returned consisting of
+its type, permissions, size (2 bytes, little-endian) and name (C-string).
+Writes are not possible. */
+uint8_t a2jGetRegions(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	if(isWrite)
+		return -1;
+
+	uint32_t pos = 0; // offset of the current record inside the block
+	uint8_t len = 0;
+	uint8_t r = 0;
+	for(; r < a2j_regions_elems && len < A2J_MANY_PAYLOAD; r++){
+		const a2j_region* reg = &a2j_regions[r];
+		PGM_P name = (PGM_P)pgm_read_word(&reg->name);
+		uint16_t size = pgm_read_word(&reg->size);
+		uint8_t hdr[4] = {pgm_read_byte(&reg->type), pgm_read_byte(&reg->perm), size & 0xFF, size >> 8};
+		uint8_t rlen = sizeof(hdr) + strlen_P(name) + 1;
+		for(uint8_t i = 0; i < rlen && len < A2J_MANY_PAYLOAD; i++){
+			if(pos + i < *offset)
+				continue;
+			(*datap)[len++] = (i < sizeof(hdr)) ? hdr[i] : pgm_read_byte(name + i - sizeof(hdr));
+		}
+		pos += rlen;
+	}
+
+	if(len == 0)
+		return -1;
+	*lenp = len;
+	*isLastp = (r == a2j_regions_elems) && (*offset + len == pos);
+	return 0;
+}
+
+/** Reads \a len bytes of memory \a type at \a addr into \a buf. @return 0 on success, -1 on unknown types */
+static uint8_t a2jMemRead(uint8_t type, const uint8_t* addr, uint8_t* buf, uint8_t len){
+	switch(type){
+		case A2J_REGION_RAM:
+			memcpy(buf, addr, len);
+			return 0;
+		case A2J_REGION_FLASH:
+			memcpy_P(buf, addr, len);
+			return 0;
+		case A2J_REGION_EEPROM:
+			eeprom_read_block(buf, addr, len);
+			return 0;
+		default:
+			return -1;
+	}
+}
+
+uint8_t a2jRegionRead(uint32_t offset, uint8_t* buf, uint8_t len){
+	uint8_t r = offset >> A2J_REGION_OFFSET_BITS;
+	uint32_t roff = offset & ((1UL << A2J_REGION_OFFSET_BITS) - 1);
+	if(r >= a2j_regions_elems)
+		return -1;
+
+	const a2j_region* reg = &a2j_regions[r];
+	uint16_t size = pgm_read_word(&reg->size);
+	if(roff + len > size || !(pgm_read_byte(&reg->perm) & A2J_REGION_R))
+		return -1;
+	return a2jMemRead(pgm_read_byte(&reg->type), (const uint8_t*)pgm_read_word(&reg->base) + roff, buf, len);
+}
+
+/**@ingroup j2amany
+Reads or writes the contents of a memory region via a2jMany.
+The upper 8 bits of the offset select the region (see #a2jGetRegions),
+the lower #A2J_REGION_OFFSET_BITS bits are the offset inside the region.
+The copies are done with the block functions of the respective memory type.
+@return 0 on success, -1 on invalid regions, offsets or missing permissions */
+uint8_t a2jRegion(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	uint8_t r = *offset >> A2J_REGION_OFFSET_BITS;
+	uint32_t roff = *offset & ((1UL << A2J_REGION_OFFSET_BITS) - 1);
+	if(r >= a2j_regions_elems)
+		return -1;
+
+	const a2j_region* reg = &a2j_regions[r];
+	uint8_t type = pgm_read_byte(&reg->type);
+	uint8_t perm = pgm_read_byte(&reg->perm);
+	uint16_t size = pgm_read_word(&reg->size);
+	uint8_t* addr = (uint8_t*)pgm_read_word(&reg->base) + roff;
+	if(roff >= size || !(perm & (isWrite ? A2J_REGION_W : A2J_REGION_R)))
+		return -1;
+
+	if(isWrite){
+		if(*lenp > size - roff)
+			return -1;
+		switch(type){
+			case A2J_REGION_RAM:
+				memcpy(addr, *datap, *lenp);
+				break;
+			case A2J_REGION_EEPROM:
+				eeprom_update_block(*datap, addr, *lenp);
+				break;
+			default:
+				return -1;
+		}
+		*isLastp = roff + *lenp == size;
+		*lenp = 0;
+		return 0;
+	}
+
+	uint8_t len = min(size - roff, A2J_MANY_PAYLOAD);
+	if(a2jMemRead(type, addr, *datap, len))
+		return -1;
+	*lenp = len;
+	*isLastp = roff + len == size;
+	return 0;
+}
+#endif // A2J_REGIONS
+
+#ifdef A2J_MANY_RLE
+/** @name a2jMany payload encodings
+The run-length encoding is done while sending the frame, hence no additional buffer is needed.
+@see A2J_MANY_RLE_MASK */
+//@{
+/** Number of raw bytes following the a2jMany header of the reply of #a2jMany that have to be run-length encoded.
+Handed over to #a2jExecute, which passes it to #a2jSend_int. */
+static uint8_t manyRleLen = 0;
+
+/** Run-length encodes \a len bytes at \a data.
+If \a csump is NULL the encoding is only measured,
+else the encoded bytes are written to the stream and added to the checksum at \a csump.
+@return the length of the encoded data */
+static uint8_t a2jRle(const uint8_t* data, uint8_t len, uint16_t* csump){
+	uint8_t out = 0;
+	uint8_t i = 0;
+	while(i < len){
+		uint8_t run = 1;
+		while(i + run < len && run < 130 && data[i + run] == data[i])
+			run++;
+
+		uint8_t ctrl;
+		uint8_t cnt;
+		uint8_t consumed;
+		if(run >= 3){
+			ctrl = 0x80 + run - 3;
+			cnt = 1;
+			consumed = run;
+		} else {
+			// collect literals until the next run of at least 3 bytes
+			uint8_t j = i + 1;
+			while(j < len && j - i < 128
+				&& !(j + 2 < len && data[j] == data[j + 1] && data[j] == data[j + 2]))
+				j++;
+			cnt = j - i;
+			ctrl = cnt - 1;
+			consumed = cnt;
+		}
+
+		out += 1 + cnt;
+		if(csump != NULL){
+			a2jWriteEscapedByte(ctrl);
+			*csump = a2jCsumAdd(*csump, ctrl);
+			for(uint8_t k = 0; k < cnt; k++){
+				a2jWriteEscapedByte(data[i + k]);
+				*csump = a2jCsumAdd(*csump, data[i + k]);
+			}
+		}
+		i += consumed;
+	}
+	return out;
+}
+
+/** Replaces every little-endian 16-bit word at \a data but the first by its difference to its predecessor. */
+static void a2jDelta16(uint8_t* data, uint8_t len){
+	for(uint8_t i = len - 2; i >= 2; i -= 2){
+		a2jPutU16(data + i, a2jGetU16(data + i) - a2jGetU16(data + i - 2));
+	}
+}
+
+/** Applies the encodings requested by \a flags to the \a *lenp bytes read into \a data.
+The run-length encoding is deferred to #a2jSend_int, which has to be passed \a *rleLenp (0 if not applied).
+@return the flags of the encodings applied, \a *lenp holds the length of the data on the wire afterwards */
+static uint8_t a2jManyPack(uint8_t flags, uint8_t* data, uint8_t *const lenp, uint8_t *const rleLenp){
+	uint8_t len = *lenp;
+	uint8_t applied = 0;
+	*rleLenp = 0;
+	if(len == 0)
+		return 0;
+
+	if((flags & A2J_MANY_DELTA_MASK) && !(len & 1)){
+		a2jDelta16(data, len);
+		applied |= A2J_MANY_DELTA_MASK;
+	}
+	if(flags & A2J_MANY_RLE_MASK){
+		uint8_t rlen = a2jRle(data, len, NULL);
+		if(rlen < len){
+			*rleLenp = len;
+			*lenp = rlen;
+			applied |= A2J_MANY_RLE_MASK;
+		}
+	}
+	return applied;
+}
+//@}
+#endif // A2J_MANY_RLE
+
+/** Sends a frame with the \a len bytes of payload at \a data.
+If \a rleLen is not 0, the payload consists of an a2jMany header followed by \a rleLen raw bytes,
+which are run-length encoded while sending (see #a2jManyPack). */
+static uint8_t a2jSend_int(uint8_t start_byte, uint8_t cmd, uint8_t seq, uint8_t len, uint8_t* const data, uint8_t rleLen){
 	uint16_t i = 1;
 	while(!a2jReady()){
 		a2jTask();
 		if(i-- == 0) {
+#ifdef A2J_BUDGET
+			a2jBudgetSendDrop();
+#endif // A2J_BUDGET
 			return 10;
 		}
 	}
+#ifdef A2J_TIME
+	uint32_t txTime = a2jTime();
+#endif // A2J_TIME
 
 	if(a2jWriteByte(start_byte)) {
 		return 11;
@@ -169,13 +1280,27 @@ static uint8_t a2jSend_int(uint8_t start_byte, uint8_t cmd, uint8_t seq, uint8_t
 	if(a2jWriteEscapedByte(len)){ // length
 		return 14;
 	}
-	uint8_t csum = (uint8_t)(seq ^ (cmd + A2J_CRC_CMD) ^ (len + A2J_CRC_LEN));
-	for(i = 0; i < len; i++){
+	uint16_t csum = a2jCsumStart(seq, cmd, len);
+	uint8_t plain = len;
+#ifdef A2J_MANY_RLE
+	if(rleLen)
+		plain = A2J_MANY_HEADER;
+#else
+	(void)rleLen;
+#endif // A2J_MANY_RLE
+	for(i = 0; i < plain; i++){
 		uint8_t tmp =  data[i];
 		a2jWriteEscapedByte(tmp);
-		csum ^= tmp;
+		csum = a2jCsumAdd(csum, tmp);
 	}
-	if(a2jWriteEscapedByte(csum)){ // checksum
+#ifdef A2J_MANY_RLE
+	if(rleLen)
+		a2jRle(data + A2J_MANY_HEADER, rleLen, &csum);
+#endif // A2J_MANY_RLE
+#ifdef A2J_TIME
+	csum = a2jWriteStamps(csum, txTime);
+#endif // A2J_TIME
+	if(a2jWriteCsum(csum)){ // checksum
 		return 15;
 	}
 	a2jFlush();
@@ -193,14 +1318,41 @@ uint8_t a2jSendSif(uint8_t cmd, uint8_t len, uint8_t* const data){
 		}
 		sif_mutex = 1;
 	}
+#ifdef A2J_TIME
+	stampTime = a2jTime();
+#endif // A2J_TIME
 	static uint8_t seq = 0;
-	uint8_t ret = a2jSend_int(A2J_SOS, cmd, seq, len, data);
+	uint8_t ret = a2jSend_int(A2J_SOS, cmd, seq, len, data, 0);
 	seq++;
 	sif_mutex = 0;
 	return ret;
 }
 #endif // A2J_SIF
 
+#ifdef A2J_CRC16
+/** Selects the checksum protecting all following frames of this session.
+The payload consists of one byte denoting the checksum (#A2J_CSUM_XOR or #A2J_CSUM_CRC16).
+The reply is still protected by the previous checksum, the new one is used starting with the next frame.
+Requests selecting #A2J_CSUM_XOR are the exception: they are always protected by #A2J_CSUM_XOR and answered with it,
+whatever the checksum of the session (see #a2jIsCsumReset).
+Serial links cannot detect a new connection (#a2jReset only runs at startup unless the board is reset by opening the port),
+so a host that does not know the checksum of the session has to send this request first.
+USB links fall back to #A2J_CSUM_XOR whenever the device is configured.
+@return 0 on success, -1 if the requested checksum is unknown */
+uint8_t a2jSetChecksum(uint8_t *const lenp, uint8_t* *const datap){
+	if(*lenp != 1 || (*datap)[0] > A2J_CSUM_CRC16)
+		return -1;
+	csumModeNext = (*datap)[0];
+	return 0;
+}
+
+/** Returns true if the request for the command \a off with the payload \a data of \a len bytes
+selects #A2J_CSUM_XOR by #a2jSetChecksum, i.e. it is protected by the XOR checksum in any session. */
+static bool a2jIsCsumReset(uint8_t off, uint8_t len, const uint8_t* data){
+	return len == 1 && data[0] == A2J_CSUM_XOR && off < a2j_jt_elems && (CMD_P)a2jJtCmd(off) == a2jSetChecksum;
+}
+#endif // A2J_CRC16
+
 /** Echoes back the data array sent over the stream. */
 uint8_t a2jEcho(uint8_t *const lenp, uint8_t* *const datap){
 	(void)datap;
@@ -209,15 +1361,92 @@ uint8_t a2jEcho(uint8_t *const lenp, uint8_t* *const datap){
 }
 
 /**@ingroup j2amany
-Echoes back the data sent over the stream. */
+Echoes back the data sent over the stream.
+Reads and writes are a loopback: the data following the a2jMany header is left in place, hence the reply
+carries it together with the offset and the last-chunk flag of the request (the return value is 0xBE). */
 uint8_t a2jEchoMany(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
 	(void)isLastp;
+	(void)isWrite;
 	(void)offset;
 	(void)lenp;
 	(void)datap;
 	return 0xBE;
 }
 
+#ifdef A2J_PREFETCH
+/** @name Read-ahead of sequential a2jMany reads
+If a read of a #CMD_P_MANY function starts where the previous read of the same function ended,
+the following chunk is prepared into #a2j_arena while #a2jProcess is idle (see #a2jPrefetch)
+and the request for it is served from there without calling the function again.
+Reads may carry up to #A2J_PREFETCH_ARGS bytes of payload (e.g. parameters), which have to match as well.
+Only functions flagged #A2J_JT_IDEMPOTENT and #A2J_JT_CACHEABLE (and not #A2J_JT_STREAMING) are read ahead,
+so a prepared chunk never differs from the one the request would return.
+Any other a2jMany request discards the prepared chunk. */
+//@{
+#define A2J_PREFETCH_NONE 0 /**< No read to continue. */
+#define A2J_PREFETCH_TRACK 1 /**< The previous read ended at \c next. */
+#define A2J_PREFETCH_PENDING 2 /**< The chunk at \c next has to be prepared. */
+#define A2J_PREFETCH_READY 3 /**< The chunk at \c next has been prepared. */
+
+/** State of the read-ahead. */
+static struct{
+	uint8_t state;
+	uint8_t func; /**< Jumptable offset of the function read. */
+	uint32_t next; /**< Offset following the previous read. */
+	uint32_t offset; /**< Offset returned for the prepared chunk. */
+	uint8_t len;
+	uint8_t ret;
+	bool isLast;
+	uint8_t argsLen;
+	uint8_t args[A2J_PREFETCH_ARGS]; /**< Payload of the requests. */
+}prefetch;
+
+/** Prepares the pending chunk. */
+static void a2jPrefetch(void){
+	if(prefetch.state != A2J_PREFETCH_PENDING)
+		return;
+
+	CMD_P_MANY cmd = (CMD_P_MANY)a2jJtCmd(prefetch.func);
+	bool isLast = false;
+	uint32_t offset = prefetch.next;
+	uint8_t len = prefetch.argsLen;
+	uint8_t* data = a2j_arena.prefetch;
+	memcpy(data, prefetch.args, len);
+	prefetch.ret = (*cmd)(&isLast, false, &offset, &len, &data);
+	// the callee may have pointed the data to a buffer of its own
+	if(data != a2j_arena.prefetch)
+		memcpy(a2j_arena.prefetch, data, len);
+	prefetch.isLast = isLast;
+	prefetch.offset = offset;
+	prefetch.len = len;
+	prefetch.state = A2J_PREFETCH_READY;
+}
+
+/** @return true if the read of \a func at \a offset with the payload \a args continues the previous one */
+static inline bool a2jPrefetchSeq(uint8_t func, uint32_t offset, const uint8_t* args, uint8_t argsLen){
+	return prefetch.state != A2J_PREFETCH_NONE && func == prefetch.func && offset == prefetch.next
+		&& argsLen == prefetch.argsLen && memcmp(args, prefetch.args, argsLen) == 0;
+}
+
+/** Updates the read-ahead after a request of \a func at \a offset with the payload \a args has been served.
+\a plain denotes a read with at most #A2J_PREFETCH_ARGS bytes of payload, \a seq if it continued the previous one. */
+static void a2jPrefetchUpdate(uint8_t func, uint32_t offset, const uint8_t* args, uint8_t argsLen, bool plain, bool seq,
+		uint8_t ret, bool isLast, uint8_t len){
+	if(!plain || ret != 0 || isLast || len == 0){
+		prefetch.state = A2J_PREFETCH_NONE;
+		return;
+	}
+	uint8_t flags = a2jJtFlags(func);
+	bool cacheable = (flags & (A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE | A2J_JT_STREAMING)) == (A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE);
+	prefetch.state = seq && cacheable ? A2J_PREFETCH_PENDING : A2J_PREFETCH_TRACK;
+	prefetch.func = func;
+	prefetch.next = offset + len;
+	prefetch.argsLen = argsLen;
+	memcpy(prefetch.args, args, argsLen);
+}
+//@}
+#endif // A2J_PREFETCH
+
 /**@ingroup j2amany
 Reads out the a2jMany-specific header from the start of \a *datap and 
 calls the #CMD_P_MANY method accordingly.
@@ -233,7 +1462,7 @@ uint8_t a2jMany(uint8_t *const lenp, uint8_t* *const datap){
 		return -1;
 
 	len -= A2J_MANY_HEADER;
-	uint8_t func = (*datap)[0];
+	uint8_t func = a2jManyReq_func(*datap);
 
 	// limit offset to the size of the jumptable
 	if(func >= a2j_jt_elems){
@@ -241,37 +1470,481 @@ uint8_t a2jMany(uint8_t *const lenp, uint8_t* *const datap){
 		return A2J_RET_OOB;
 	}
 
-	uint32_t offset = (uint32_t)(*datap)[2];
+	uint32_t offset = a2jManyReq_offset(*datap);
 	uint8_t* ndatap = *datap + A2J_MANY_HEADER;
 
-	#ifdef A2J_FMAP
-	CMD_P_MANY cmd = (CMD_P_MANY)pgm_read_word(&(a2j_jt[func].cmd)); 
-	#else
-	CMD_P_MANY cmd = (CMD_P_MANY)pgm_read_word(&a2j_jt[func]);
-	#endif
+	CMD_P_MANY cmd = (CMD_P_MANY)a2jJtCmd(func);
 
-	uint8_t flags = (*datap)[1];
+	uint8_t flags = a2jManyReq_flags(*datap);
 	bool isLast = flags & A2J_MANY_ISLAST_MASK;
 	bool isWrite = flags & A2J_MANY_ISWRITE_MASK;
-	(*datap)[0] = (*cmd)(&isLast, isWrite, &offset, &len, &ndatap);
+#ifdef A2J_PREFETCH
+	uint32_t reqOffset = offset;
+	uint8_t argsLen = len;
+	uint8_t args[A2J_PREFETCH_ARGS];
+	bool plain = !isWrite && !isLast && argsLen <= A2J_PREFETCH_ARGS;
+	if(plain)
+		memcpy(args, ndatap, argsLen);
+	bool seq = plain && a2jPrefetchSeq(func, offset, args, argsLen);
+	uint8_t ret;
+	if(seq && prefetch.state == A2J_PREFETCH_READY){
+		memcpy(ndatap, a2j_arena.prefetch, prefetch.len);
+		len = prefetch.len;
+		offset = prefetch.offset;
+		isLast = prefetch.isLast;
+		ret = prefetch.ret;
+	} else {
+		ret = (*cmd)(&isLast, isWrite, &offset, &len, &ndatap);
+	}
+	a2jPrefetchUpdate(func, reqOffset, args, argsLen, plain, seq, ret, isLast, len);
+#else
+	uint8_t ret = (*cmd)(&isLast, isWrite, &offset, &len, &ndatap);
+#endif // A2J_PREFETCH
+	// the callee may have pointed the data to a buffer of its own
+	if(ndatap != *datap + A2J_MANY_HEADER){
+		memmove(*datap + A2J_MANY_HEADER, ndatap, len);
+		ndatap = *datap + A2J_MANY_HEADER;
+	}
+	a2jManyReply_set_ret(*datap, ret);
+	uint8_t packed = 0;
+#ifdef A2J_MANY_RLE
+	if(!isWrite && ret == 0)
+		packed = a2jManyPack(flags, ndatap, &len, &manyRleLen);
+#endif // A2J_MANY_RLE
 	*lenp = len + A2J_MANY_HEADER;
-	(*datap)[1] = isLast << A2J_MANY_ISLAST_BIT;
+	a2jManyReply_set_flags(*datap, (isLast << A2J_MANY_ISLAST_BIT) | packed);
+	a2jManyReply_set_offset(*datap, offset);
 	return 0;
 }
+
+#ifdef A2J_MANY_WIN
+/**@ingroup j2amany
+Sends up to #A2J_MANY_WINDOW chunks of a #CMD_P_MANY read without waiting for a request per chunk.
+
+The request consists of the \ref manyheader "a2jMany header" (its offset denotes the start of the window)
+followed by one byte containing a bitmap: if bit i is set, the chunk at offset + i * #A2J_MANY_PAYLOAD is requested.
+Every requested chunk is sent immediately in a frame of its own carrying the sequence number of the request,
+the return value of the callee and an a2jMany header flagged with #A2J_MANY_ISCHUNK_MASK and the chunk's offset.
+The reply to the request itself contains the bitmap of the chunks actually sent.
+The host acknowledges by requesting the same window again with only the bits of the chunks it did not receive intact,
+or by moving the window on.
+
+The window ends early after the last chunk of the block, after a chunk shorter than #A2J_MANY_PAYLOAD
+and if the callee returns an error (which is then returned in the reply).
+The callee has to support arbitrary read offsets. Writes are not supported. */
+uint8_t a2jManyWindow(uint8_t *const lenp, uint8_t* *const datap){
+	if(*lenp < A2J_MANY_HEADER + 1)
+		return -1;
+
+	uint8_t* buf = *datap;
+	uint8_t func = a2jManyReq_func(buf);
+	if(func >= a2j_jt_elems){
+		*lenp = 0;
+		return A2J_RET_OOB;
+	}
+	uint8_t flags = a2jManyReq_flags(buf);
+	if(flags & A2J_MANY_ISWRITE_MASK)
+		return -1;
+
+	CMD_P_MANY cmd = (CMD_P_MANY)a2jJtCmd(func);
+	uint32_t base = a2jManyReq_offset(buf);
+	uint8_t req = buf[A2J_MANY_HEADER];
+	uint8_t sent = 0;
+	uint8_t ret = 0;
+
+	for(uint8_t i = 0; i < A2J_MANY_WINDOW; i++){
+		uint8_t bit = 1 << i;
+		if(!(req & bit))
+			continue;
+
+		uint32_t offset = base + (uint32_t)i * A2J_MANY_PAYLOAD;
+		uint8_t len = 0;
+		bool isLast = false;
+		uint8_t* ndatap = buf + A2J_MANY_HEADER;
+		ret = (*cmd)(&isLast, false, &offset, &len, &ndatap);
+		if(ret != 0)
+			break;
+		if(ndatap != buf + A2J_MANY_HEADER){
+			memmove(buf + A2J_MANY_HEADER, ndatap, len);
+			ndatap = buf + A2J_MANY_HEADER;
+		}
+
+		bool isShort = len < A2J_MANY_PAYLOAD;
+		uint8_t packed = 0;
+		uint8_t rleLen = 0;
+#ifdef A2J_MANY_RLE
+		packed = a2jManyPack(flags, ndatap, &len, &rleLen);
+#endif // A2J_MANY_RLE
+		a2jManyReq_set_func(buf, func);
+		a2jManyReply_set_flags(buf, (isLast << A2J_MANY_ISLAST_BIT) | A2J_MANY_ISCHUNK_MASK | packed);
+		a2jManyReply_set_offset(buf, offset);
+		if(a2jSend_int(A2J_SOF, ret, curSeq, len + A2J_MANY_HEADER, buf, rleLen))
+			break;
+		sent |= bit;
+		if(isLast || isShort)
+			break;
+	}
+
+	buf[0] = sent;
+	*lenp = 1;
+	return ret;
+}
+#endif // A2J_MANY_WIN
+//@}
+
+/** Executes the command at offset \a off with the \a len bytes of payload in the frame buffer and sends its reply.
+Used by #a2jProcess after a frame has been received completely. */
+static void a2jExecute(uint8_t seq, uint8_t off, uint8_t len){
+	uint8_t* payload = a2j_arena.frame;
+	uint8_t *const lenp = &len; // const pointer to len
+	uint8_t **bufp = &payload; // pointer to the data array
+	
+#ifdef A2J_JT_FLAGS
+	uint8_t flags = a2jReqFlags(off, payload, len);
+	// do not execute a streaming command twice if the host repeats a request whose reply got lost,
+	// repeated a2jMany requests are passed to the function, which recognizes them by their offset
+	if(lastValid && seq == lastSeq && off == lastOff && (flags & A2J_JT_STREAMING) && !a2jIsMany(off)){
+		a2jSendErrorFrame(A2J_RET_DUP, seq, __LINE__);
+		return;
+	}
+	lastSeq = seq;
+	lastOff = off;
+	lastValid = true;
+#endif // A2J_JT_FLAGS
+
+	// reading out the jump address from struct/pointer array in flash and calling it
+	CMD_P cmd = (CMD_P)a2jJtCmd(off);
+
+#ifdef A2J_BENCH
+	uint8_t reqLen = len;
+	uint32_t t0 = a2jTime();
+#endif // A2J_BENCH
+#ifdef A2J_BUDGET
+	a2jBudgetStart(a2jReqFunc(off, payload, len), flags);
+#endif // A2J_BUDGET
+	a2jTrace(A2J_TRACE_EXEC);
+	uint8_t ret = (*cmd)(lenp, bufp);
+	a2jTrace(A2J_TRACE_TX);
+#ifdef A2J_BUDGET
+	a2jBudgetStop();
+#endif // A2J_BUDGET
+	uint8_t rleLen = 0;
+#ifdef A2J_MANY_RLE
+	rleLen = manyRleLen;
+	manyRleLen = 0;
+#endif // A2J_MANY_RLE
+	if(ret == A2J_RET_OOB && (cmd == &a2jMany
+#ifdef A2J_MANY_WIN
+			|| cmd == &a2jManyWindow
+#endif
+			)){
+		a2jSendErrorFrame(A2J_RET_OOB, seq, __LINE__);
+		return;
+	}
+
+#ifdef A2J_BENCH
+	uint32_t t1 = a2jTime();
+#endif // A2J_BENCH
+	if (a2jSend_int(A2J_SOF, ret, seq, len, payload, rleLen))
+		return;
+#ifdef A2J_BENCH
+	bench.rx = stampTime - benchStart;
+	bench.exec = t1 - t0;
+	bench.tx = a2jTime() - t1;
+	bench.reqLen = reqLen;
+	bench.replyLen = len;
+#endif // A2J_BENCH
+
+#ifdef A2J_CRC16
+	csumMode = csumModeNext;
+#endif // A2J_CRC16
+#ifdef A2J_TIME
+	stamps = stampsNext;
+#endif // A2J_TIME
+#ifdef A2J_FWUPDATE
+	a2jFwPoll();
+#endif // A2J_FWUPDATE
+}
+
+#ifdef A2J_FASTPATH
+/** @name Interrupt driven receiver
+Frames are parsed byte by byte by #a2jRxByte, which may be called in interrupt context.
+Commands flagged #A2J_JT_ISR are executed as soon as their frame is complete,
+all others are left in the frame buffer for #a2jProcess. */
+//@{
+/** States of the receiver. */
+enum {
+	A2J_RX_IDLE, /**< Waiting for #A2J_SOF. */
+	A2J_RX_SEQ,
+	A2J_RX_OFF,
+	A2J_RX_LEN,
+	A2J_RX_PAYLOAD,
+	A2J_RX_CSUM,
+};
+
+/** States of the frame buffer. */
+enum {
+	A2J_FRAME_FREE, /**< May be filled by the receiver. */
+	A2J_FRAME_READY, /**< Contains a complete frame to be executed by #a2jProcess. */
+	A2J_FRAME_BUSY, /**< Being filled by the receiver or executed by #a2jProcess. */
+};
+
+/** State of the frame being received. */
+static struct{
+	uint8_t state;
+	bool esc; /**< The previous byte was #A2J_ESC. */
+	bool bad; /**< The checksum does not match. */
+	uint8_t seq;
+	uint8_t off;
+	uint8_t len;
+	uint8_t pos; /**< Number of payload bytes received. */
+	uint8_t csumCnt; /**< Number of checksum bytes still to be received. */
+	uint16_t csum;
+	uint8_t* dst; /**< Buffer the payload is stored in or NULL if the frame is ignored. */
+#ifdef A2J_BENCH
+	uint32_t start; /**< Time #A2J_SOF was received. */
+#endif // A2J_BENCH
+}rx;
+
+static volatile uint8_t frameState = A2J_FRAME_FREE;
+/** Header of the frame in the frame buffer (valid if #A2J_FRAME_READY). */
+static uint8_t frameSeq, frameOff, frameLen;
+#ifdef A2J_TIME
+/** Time the frame in the frame buffer was received completely. */
+static uint32_t frameTime;
+#ifdef A2J_BENCH
+/** Time the start of the frame in the frame buffer was received. */
+static uint32_t frameStart;
+#endif // A2J_BENCH
+#endif // A2J_TIME
+
+/** Reply of a command executed by the receiver waiting to be sent by #a2jProcess. */
+static volatile struct{
+	bool pending;
+	uint8_t ret;
+	uint8_t seq;
+	uint8_t len;
+	uint8_t* data;
+#ifdef A2J_TIME
+	uint32_t time; /**< Time the request was received completely. */
+#endif // A2J_TIME
+}fast;
+
+/** Error detected by the receiver waiting to be sent by #a2jProcess. */
+static volatile struct{
+	bool pending;
+	uint8_t ret;
+	uint8_t seq;
+	uint16_t line;
+#ifdef A2J_TIME
+	uint32_t time; /**< Time the error was detected. */
+#endif // A2J_TIME
+}rxErr;
 //@}
 
+/** Queues an error frame for #a2jProcess if no other error is pending. */
+static void a2jRxError(uint8_t err, uint8_t seq, uint16_t line){
+	if(rxErr.pending)
+		return;
+#ifdef A2J_TIME
+	rxErr.time = a2jTime();
+#endif // A2J_TIME
+	rxErr.ret = err;
+	rxErr.seq = seq;
+	rxErr.line = line;
+	rxErr.pending = true;
+}
+
+/** Selects the buffer for the payload of the frame whose header has just been received.
+Commands flagged #A2J_JT_ISR whose payload does not fit into #A2J_FAST_PAYLOAD bytes
+or that arrive while the previous reply of the receiver is pending are left for #a2jProcess like all others.
+@return NULL if the frame cannot be executed (see #a2jRxFrame) */
+static uint8_t* a2jRxDst(void){
+	if(rx.off >= a2j_jt_elems)
+		return NULL;
+#ifndef A2J_FMAP
+	if(rx.off == 0)
+		return NULL;
+#endif
+	if((a2jJtFlags(rx.off) & A2J_JT_ISR) && !fast.pending && rx.len <= A2J_FAST_PAYLOAD)
+		return a2j_arena.fast;
+	if(frameState != A2J_FRAME_FREE)
+		return NULL; // still executing the previous frame, answered with A2J_RET_BUSY
+	frameState = A2J_FRAME_BUSY;
+	return a2j_arena.frame;
+}
+
+/** Handles a completely received frame. */
+static void a2jRxFrame(void){
+	if(rx.dst == a2j_arena.frame){
+		if(rx.bad){
+			frameState = A2J_FRAME_FREE;
+		} else {
+			frameSeq = rx.seq;
+			frameOff = rx.off;
+			frameLen = rx.len;
+#ifdef A2J_TIME
+			frameTime = a2jTime();
+#endif // A2J_TIME
+#ifdef A2J_BENCH
+			frameStart = rx.start;
+#endif // A2J_BENCH
+			frameState = A2J_FRAME_READY;
+			return;
+		}
+	}
+	if(rx.bad){
+		a2jRxError(A2J_RET_CHKSUM, rx.seq, __LINE__);
+		return;
+	}
+	if(rx.dst == NULL){
+		if(rx.off >= a2j_jt_elems
+#ifndef A2J_FMAP
+				|| rx.off == 0
+#endif
+				)
+			a2jRxError(A2J_RET_OOB, rx.seq, __LINE__);
+		else
+			a2jRxError(A2J_RET_BUSY, rx.seq, __LINE__);
+		return;
+	}
+
+#ifdef A2J_TIME
+	fast.time = a2jTime();
+#endif // A2J_TIME
+	CMD_P cmd = (CMD_P)a2jJtCmd(rx.off);
+	uint8_t len = rx.len;
+	uint8_t* data = rx.dst;
+	fast.ret = (*cmd)(&len, &data);
+	fast.seq = rx.seq;
+	fast.len = len;
+	fast.data = data;
+	fast.pending = true;
+}
+
+/** Feeds the byte \a c received from the stream to the receiver.
+Has to be called for every received byte by the low level implementation (see #a2jRxPoll) and must not be reentered.
+Commands flagged #A2J_JT_ISR are executed by this function (i.e. possibly in interrupt context),
+but only if their payload fits into #A2J_FAST_PAYLOAD bytes and no reply of the receiver is pending,
+otherwise they are executed by #a2jProcess. Frames arriving while #a2jProcess still executes the previous one
+are answered with #A2J_RET_BUSY. */
+void a2jRxByte(uint8_t c){
+	if(rx.esc){
+		// the byte following A2J_ESC is never a delimiter (an escaped A2J_SOS is sent as A2J_SOF)
+		c += 1;
+		rx.esc = false;
+	} else if(c == A2J_SOF){
+		// (re)synchronize, an unfinished frame is discarded
+		if(rx.state != A2J_RX_IDLE && rx.dst == a2j_arena.frame)
+			frameState = A2J_FRAME_FREE;
+		rx.state = A2J_RX_SEQ;
+		a2jTrace(A2J_TRACE_RX);
+#ifdef A2J_BENCH
+		rx.start = a2jTime();
+#endif // A2J_BENCH
+		rx.dst = NULL;
+		return;
+	} else if(rx.state == A2J_RX_IDLE){
+		return;
+	} else if(c == A2J_SOS){
+		// unescaped delimiter character inside frame
+		if(rx.dst == a2j_arena.frame)
+			frameState = A2J_FRAME_FREE;
+		if(rx.state > A2J_RX_SEQ)
+			a2jRxError(A2J_RET_ESC, rx.seq, __LINE__);
+		rx.state = A2J_RX_IDLE;
+		return;
+	} else if(c == A2J_ESC){
+		rx.esc = true;
+		return;
+	}
+
+	switch(rx.state){
+		case A2J_RX_SEQ:
+			rx.seq = c;
+			rx.state = A2J_RX_OFF;
+			break;
+		case A2J_RX_OFF:
+			rx.off = c;
+			rx.state = A2J_RX_LEN;
+			break;
+		case A2J_RX_LEN:
+			rx.len = c;
+			rx.pos = 0;
+			rx.bad = false;
+			rx.csum = a2jCsumStart(rx.seq, rx.off, c);
+			rx.csumCnt = 1;
+#ifdef A2J_CRC16
+			if(csumMode == A2J_CSUM_CRC16)
+				rx.csumCnt = 2;
+#endif // A2J_CRC16
+			rx.dst = a2jRxDst();
+			rx.state = c ? A2J_RX_PAYLOAD : A2J_RX_CSUM;
+			break;
+		case A2J_RX_PAYLOAD:
+			if(rx.dst != NULL)
+				rx.dst[rx.pos] = c;
+			rx.csum = a2jCsumAdd(rx.csum, c);
+			if(++rx.pos == rx.len){
+				rx.state = A2J_RX_CSUM;
+#ifdef A2J_CRC16
+				// the session's checksum is switched when the frame is executed by a2jProcess
+				if(rx.csumCnt == 2 && rx.dst == a2j_arena.frame && a2jIsCsumReset(rx.off, rx.len, rx.dst)){
+					rx.csum = (uint8_t)(rx.seq ^ (rx.off + A2J_CRC_CMD) ^ (rx.len + A2J_CRC_LEN) ^ c);
+					rx.csumCnt = 1;
+				}
+#endif // A2J_CRC16
+			}
+			break;
+		case A2J_RX_CSUM:
+			if(c != (rx.csum & 0xFF))
+				rx.bad = true;
+			rx.csum >>= 8;
+			if(--rx.csumCnt == 0){
+				rx.state = A2J_RX_IDLE;
+				a2jRxFrame();
+			}
+			break;
+	}
+}
+#endif // A2J_FASTPATH
+
 /** Calls the method determined by the command field read from the stream and sends its reply back.
 This function tries to read a packet according to the \ref prot "java2arduino protocol".
-If this is successful the payload is read into the static array \c buf and
+If this is successful the payload is read into the frame buffer (see #a2j_arena) and
 the function pointer at the offset equal to the command field is read out from the jump table \c a2j_jt.
 
 The function pointer of type {@link #CMD_P} is then dereferenced with the properties of the payload as arguments.
 Afterwards the method sends the return value of the callee, the length of the reply data and optionally
 the reply data itself back and returns.
-In the case of an error a special packet (see \ref j2aerrors, #a2jSendErrorFrame) is sent if possible before returning.*/
+In the case of an error a special packet (see \ref j2aerrors, #a2jSendErrorFrame) is sent if possible before returning.
+
+With A2J_FASTPATH the frames are received by #a2jRxByte instead.
+This function then sends the replies queued by it and executes the frame left in the frame buffer, if any.*/
 void a2jProcess(){
-	if(!a2jReady() || !a2jAvailable())
+#ifdef A2J_SUBS
+	// before the SIF mutex is taken below
+	if(a2jReady())
+		a2jSubsPoll();
+#endif // A2J_SUBS
+#ifdef A2J_BUDGET
+	if(a2jReady())
+		a2jBudgetPoll();
+#endif // A2J_BUDGET
+#ifdef A2J_FASTPATH
+	if(!a2jReady())
 		return;
+	a2jRxPoll();
+#else
+	if(!a2jReady())
+		return;
+	if(!a2jAvailable()){
+#ifdef A2J_PREFETCH
+		a2jPrefetch();
+#endif // A2J_PREFETCH
+		return;
+	}
+#endif // A2J_FASTPATH
 
 #ifdef A2J_SIF
 	ATOMIC_BLOCK(ATOMIC_FORCEON) {
@@ -281,11 +1954,51 @@ void a2jProcess(){
 		sif_mutex = 1;
 	}
 #endif // A2J_SIF
+#ifdef A2J_FASTPATH
+	if(fast.pending){
+#ifdef A2J_TIME
+		stampTime = fast.time;
+#endif // A2J_TIME
+		a2jSend_int(A2J_SOF, fast.ret, fast.seq, fast.len, fast.data, 0);
+		fast.pending = false;
+	}
+	if(rxErr.pending){
+#ifdef A2J_TIME
+		stampTime = rxErr.time;
+#endif // A2J_TIME
+		a2jSendErrorFrame(rxErr.ret, rxErr.seq, rxErr.line);
+		rxErr.pending = false;
+	}
+	if(frameState == A2J_FRAME_READY){
+		frameState = A2J_FRAME_BUSY;
+		curSeq = frameSeq;
+#ifdef A2J_TIME
+		stampTime = frameTime;
+#endif // A2J_TIME
+#ifdef A2J_BENCH
+		benchStart = frameStart;
+#endif // A2J_BENCH
+#ifdef A2J_CRC16
+		if(a2jIsCsumReset(frameOff, frameLen, a2j_arena.frame))
+			csumMode = A2J_CSUM_XOR;
+#endif // A2J_CRC16
+		a2jExecute(frameSeq, frameOff, frameLen);
+		frameState = A2J_FRAME_FREE;
+	}
+#ifdef A2J_PREFETCH
+	else if(frameState == A2J_FRAME_FREE){
+		a2jPrefetch();
+	}
+#endif // A2J_PREFETCH
+#else // A2J_FASTPATH
 	if (a2jReadByte() != A2J_SOF)
 		goto out;
+	a2jTrace(A2J_TRACE_RX);
+#ifdef A2J_BENCH
+	benchStart = a2jTime();
+#endif // A2J_BENCH
 
-	static uint8_t buf[256];
-	uint8_t* payload = buf;
+	uint8_t* payload = a2j_arena.frame;
 
 	// sequence number
 	uint16_t tmp = a2jReadEscapedByte();
@@ -294,6 +2007,7 @@ void a2jProcess(){
 		goto out;
 	}
 	uint8_t seq = (uint8_t)tmp;
+	curSeq = seq;
 
 	 // function offset
 	tmp = a2jReadEscapedByte();
@@ -324,7 +2038,7 @@ void a2jProcess(){
 	}
 	uint8_t len = (uint8_t)tmp;
 
-	uint8_t csum = (uint8_t)(seq ^ (off + A2J_CRC_CMD) ^ (len + A2J_CRC_LEN));
+	uint16_t csum = a2jCsumStart(seq, off, len);
 	// read in payload // TODO 255B limit...?
 	for(uint16_t i = 0; i < len; i++){
 		tmp = a2jReadEscapedByte();
@@ -333,42 +2047,29 @@ void a2jProcess(){
 			goto out;
 		}
 		payload[i] = (uint8_t)tmp;
-		csum ^= (uint8_t)tmp;
+		csum = a2jCsumAdd(csum, (uint8_t)tmp);
 	}
-
-	// read and compare checksum
-	tmp = a2jReadEscapedByte();
-	if(tmp > 0xFF){
-		a2jSendErrorFrame(A2J_RET_TO, seq, __LINE__);
-		goto out;
+#ifdef A2J_CRC16
+	if(csumMode == A2J_CSUM_CRC16 && a2jIsCsumReset(off, len, payload)){
+		csumMode = A2J_CSUM_XOR;
+		csum = a2jCsumAdd(a2jCsumStart(seq, off, len), payload[0]);
 	}
+#endif // A2J_CRC16
 
-	uint8_t rsum = (uint8_t)tmp;
-	if(csum != rsum){
-		a2jSendErrorFrame(A2J_RET_CHKSUM, seq, __LINE__);
-		goto out;
-	}
-	
-	uint8_t *const lenp = &len; // const pointer to len
-	uint8_t **bufp = &payload; // pointer to the data array
-	
-	// reading out the jump address from struct/pointer array in flash and calling it
-	#ifdef A2J_FMAP
-	CMD_P cmd = (CMD_P)pgm_read_word(&(a2j_jt[off].cmd)); 
-	#else
-	CMD_P cmd = (CMD_P)pgm_read_word(&a2j_jt[off]);
-	#endif
-
-	uint8_t ret = (*cmd)(lenp, bufp);
-	if(ret == A2J_RET_OOB && cmd == &a2jMany){
-		a2jSendErrorFrame(A2J_RET_OOB, seq, __LINE__);
+	// read and compare checksum
+	tmp = a2jReadCsum(csum);
+#ifdef A2J_TIME
+	stampTime = a2jTime();
+#endif // A2J_TIME
+	if(tmp){
+		a2jSendErrorFrame(tmp, seq, __LINE__);
 		goto out;
 	}
 
-	if (a2jSend_int(A2J_SOF, ret, seq, len, payload))
-		goto out;
-
+	a2jExecute(seq, off, len);
 out:
+#endif // A2J_FASTPATH
+	a2jTrace(A2J_TRACE_IDLE);
 #ifdef A2J_SIF
 	sif_mutex = 0;
 #endif // A2J_SIF
@@ -378,6 +2079,9 @@ out:
 /** Sends a frame indicating, that an error occurred.
 @see arduino2jerrors*/
 static void a2jSendErrorFrame(uint8_t err, uint8_t seq, uint16_t line){
+#ifdef A2J_TIME
+	uint32_t txTime = a2jTime();
+#endif // A2J_TIME
 	if(a2jWriteByte(A2J_SOF))
 		return;
 	if(a2jWriteEscapedByte(seq)) // sequence number
@@ -393,7 +2097,13 @@ static void a2jSendErrorFrame(uint8_t err, uint8_t seq, uint16_t line){
 	uint8_t linel = line & 0xFF;
 	if(a2jWriteEscapedByte(linel)) // line
 		return;
-	if(a2jWriteEscapedByte((uint8_t)(seq ^ (A2J_CRC_CMD + err) ^ (A2J_CRC_LEN+len) ^ lineu ^ linel))) // checksum
+	uint16_t csum = a2jCsumStart(seq, err, len);
+	csum = a2jCsumAdd(csum, lineu);
+	csum = a2jCsumAdd(csum, linel);
+#ifdef A2J_TIME
+	csum = a2jWriteStamps(csum, txTime);
+#endif // A2J_TIME
+	if(a2jWriteCsum(csum)) // checksum
 		return;
 	a2jFlush();
 }
@@ -38,6 +38,10 @@ Has to be called in a timely manner depending on the underlying protocol:
 - Serial: not at all (equals nop)*/
 void a2jTask(void);
 
+#ifdef A2J_FASTPATH
+void a2jRxByte(uint8_t c);
+#endif // A2J_FASTPATH
+
 #ifdef A2J_SIF
 uint8_t a2jSendSif(uint8_t cmd, uint8_t len, uint8_t* const data);
 #endif // A2J_SIF
@@ -46,6 +50,8 @@ uint8_t a2jSendSif(uint8_t cmd, uint8_t len, uint8_t* const data);
 //@{
 #ifdef A2J_FMAP
 uint8_t a2jGetMapping(uint8_t *const lenp, uint8_t* *const datap);
+uint8_t a2jGetMappingMany(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+uint8_t a2jLookup(uint8_t *const lenp, uint8_t* *const datap);
 #endif
 
 #ifdef A2J_DBG
@@ -55,20 +61,520 @@ uint8_t a2jDebug(uint8_t *const lenp, uint8_t* *const datap);
 uint8_t a2jMany(uint8_t *const lenp, uint8_t* *const datap);
 uint8_t a2jManyReadFlash(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap, PGM_VOID_P src, uint32_t size);
 uint8_t a2jGetProperties(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+#ifdef A2J_PROPS
+uint16_t a2jFindProp(const char* key, uint8_t len);
+uint8_t a2jGetProperty(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_PROPS_EE
+uint8_t a2jSetProperty(uint8_t *const lenp, uint8_t* *const datap);
+#endif
 uint8_t a2jEcho(uint8_t *const,  uint8_t * *const);
 uint8_t a2jEchoMany(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+#ifdef A2J_MANY_WIN
+uint8_t a2jManyWindow(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_CRC16
+uint8_t a2jSetChecksum(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_DIGEST
+uint8_t a2jGetDigest(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_JT_FLAGS
+uint8_t a2jGetFlags(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_PROF
+uint8_t a2jProfile(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_TIME
+uint8_t a2jTimeSync(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_CAPTURE
+uint8_t a2jCapture(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_SUBS
+uint8_t a2jSubscribe(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_BUDGET
+uint8_t a2jBudgetStats(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_BENCH
+uint8_t a2jBenchSink(uint8_t *const lenp, uint8_t* *const datap);
+uint8_t a2jBenchSource(uint8_t *const lenp, uint8_t* *const datap);
+uint8_t a2jBenchMany(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+uint8_t a2jBenchStats(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_CAPS
+uint8_t a2jGetCaps(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_MEMINFO
+uint8_t a2jMemInfo(uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_FWUPDATE
+uint8_t a2jFwUpdate(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+#endif
+#ifdef A2J_REGIONS
+uint8_t a2jGetRegions(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+uint8_t a2jRegion(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap);
+#endif
+//@}
+
+#ifdef A2J_REGIONS
+/**	@name Memory regions
+@see STARTREGIONS */
+//@{
+#define A2J_REGION_RAM 0 /**< Region in RAM. */
+#define A2J_REGION_FLASH 1 /**< Region in flash (within the first 64kB). */
+#define A2J_REGION_EEPROM 2 /**< Region in EEPROM. */
+
+#define A2J_REGION_R (1<<0) /**< Region is readable. */
+#define A2J_REGION_W (1<<1) /**< Region is writable (not possible for #A2J_REGION_FLASH). */
+
+/** Number of bits of an a2jMany offset used to address the contents of a region.
+The remaining upper bits select the region. */
+#define A2J_REGION_OFFSET_BITS 24
+
+/** Struct type describing a memory region. */
+typedef struct{
+	const char* name; /**< Name of the region (in flash). */
+	const void* base; /**< Start address. */
+	uint16_t size; /**< Size in bytes. */
+	uint8_t type; /**< Memory type (e.g. #A2J_REGION_RAM). */
+	uint8_t perm; /**< Permissions (e.g. #A2J_REGION_R). */
+}a2j_region;
+//@}
+
+/** Reads \a len bytes at the a2jMany offset \a offset of #a2jRegion (region index and offset inside the region) into \a buf.
+@return 0 on success, -1 on invalid regions, ranges or missing read permission */
+uint8_t a2jRegionRead(uint32_t offset, uint8_t* buf, uint8_t len);
+#endif // A2J_REGIONS
+
+/**	@name Frame checksums
+Values accepted by #a2jSetChecksum. */
+//@{
+/** 8-bit XOR sum over the frame (default). */
+#define A2J_CSUM_XOR 0
+/** CRC-16-CCITT (reflected polynomial 0x8408, initial value 0xFFFF), sent least significant byte first. */
+#define A2J_CSUM_CRC16 1
+//@}
+
+#ifdef A2J_MANY_WIN
+/**@ingroup j2amany
+@name a2jMany window settings */
+//@{
+#ifndef A2J_MANY_WINDOW
+/** Maximum number of chunks sent in reply to one #a2jManyWindow request (1-8).*/
+#define A2J_MANY_WINDOW 8
+#endif
+#if A2J_MANY_WINDOW < 1 || A2J_MANY_WINDOW > 8
+	#error "A2J_MANY_WINDOW has to be in the range [1; 8]"
+#endif
+#ifndef A2J_MANY_ISCHUNK_BIT
+/** Flag bit set in the a2jMany header of chunk frames sent by #a2jManyWindow. */
+#define A2J_MANY_ISCHUNK_BIT 2
+#endif
+#define A2J_MANY_ISCHUNK_MASK (1<<A2J_MANY_ISCHUNK_BIT)
+//@}
+#endif // A2J_MANY_WIN
+
+#ifdef A2J_MANY_RLE
+/**@ingroup j2amany
+@name a2jMany payload encodings
+A host may set these flags in the \ref manyheader "a2jMany header" of read requests.
+The device sets them in the header of the reply if the data following the header has been encoded accordingly.
+If both are applied, the host has to undo the run-length encoding first.
+
+The run-length encoding consists of control bytes each followed by data:
+a control byte c < 0x80 is followed by c+1 literal bytes,
+a control byte c >= 0x80 is followed by one byte to be repeated c-0x80+3 times.
+Encoded data is only sent if it is shorter than the raw data.
+
+The delta encoding replaces every little-endian 16-bit word but the first
+by its difference to the preceding word (modulo 2^16). It is only applied to data of even length. */
+//@{
+#ifndef A2J_MANY_RLE_BIT
+#define A2J_MANY_RLE_BIT 3
+#endif
+#define A2J_MANY_RLE_MASK (1<<A2J_MANY_RLE_BIT)
+#ifndef A2J_MANY_DELTA_BIT
+#define A2J_MANY_DELTA_BIT 4
+#endif
+#define A2J_MANY_DELTA_MASK (1<<A2J_MANY_DELTA_BIT)
+//@}
+#endif // A2J_MANY_RLE
+
+/** @name Command flags
+\anchor jtflags
+Properties of a jumptable entry, declared by #ADDJTF/#ADDLJTF and stored in flash if A2J_JT_FLAGS is defined.
+The host retrieves them by #a2jGetFlags. */
+//@{
+/** Executing the command repeatedly with the same request has the same effect as executing it once.
+For #CMD_P_MANY functions this applies to writes; reads are considered idempotent unless #A2J_JT_STREAMING is set. */
+#define A2J_JT_IDEMPOTENT (1<<0)
+/** The reply depends on the request only (for a given firmware, see #a2jGetDigest), hence the host may cache it. */
+#define A2J_JT_CACHEABLE (1<<1)
+/** The command is short and may be executed in interrupt context (see #a2jRxByte).
+Its request and reply must not exceed #A2J_FAST_PAYLOAD bytes. */
+#define A2J_JT_ISR (1<<2)
+/** The command consumes or produces a stream (e.g. drains a buffer), hence its chunks have to be transferred in order exactly once.
+A repeated request of a #CMD_P command is answered with #A2J_RET_DUP instead of being executed (with A2J_JT_FLAGS),
+repeated a2jMany requests of a #CMD_P_MANY function are passed to it (the offset tells it the chunk was repeated). */
+#define A2J_JT_STREAMING (1<<3)
+/** Position of the execution budget class in the command flags (see #A2J_JT_BUDGET). */
+#define A2J_JT_BUDGET_SHIFT 4
+#define A2J_JT_BUDGET_MASK (0xF << A2J_JT_BUDGET_SHIFT)
+/** Declares an execution budget of at least \a ms milliseconds for the command (see a2j_budget.h).
+The budget is rounded up to a power of two between 1 ms and 16384 ms and stored as class
+(budget 2^(class - 1) ms, 0 for none) in the upper 4 bits of the command flags. */
+#define A2J_JT_BUDGET(ms) ((uint8_t)(A2J_JT_BUDGET_CLASS(ms) << A2J_JT_BUDGET_SHIFT))
+#define A2J_JT_BUDGET_CLASS(ms) ((ms) <= 1 ? 1 : (ms) <= 2 ? 2 : (ms) <= 4 ? 3 : (ms) <= 8 ? 4 : (ms) <= 16 ? 5 \
+	: (ms) <= 32 ? 6 : (ms) <= 64 ? 7 : (ms) <= 128 ? 8 : (ms) <= 256 ? 9 : (ms) <= 512 ? 10 : (ms) <= 1024 ? 11 \
+	: (ms) <= 2048 ? 12 : (ms) <= 4096 ? 13 : (ms) <= 8192 ? 14 : 15)
+//@}
+
+#ifdef A2J_FASTPATH
+#ifndef A2J_JT_FLAGS
+	#error "A2J_FASTPATH requires A2J_JT_FLAGS"
+#endif
+#ifndef A2J_FAST_PAYLOAD
+/** Maximum payload of requests and replies of commands executed by the receiver (see #a2jRxByte). */
+#define A2J_FAST_PAYLOAD 16
+#endif
+#endif // A2J_FASTPATH
+
+#ifdef A2J_PREFETCH
+#ifndef A2J_JT_FLAGS
+	#error "A2J_PREFETCH requires A2J_JT_FLAGS"
+#endif
+#ifndef A2J_PREFETCH_ARGS
+/** Maximum payload of a read request (e.g. parameters) for it to be read ahead (see #a2jPrefetch). */
+#define A2J_PREFETCH_ARGS 8
+#endif
+#endif // A2J_PREFETCH
+
+#ifdef A2J_INDEX
+/** @name Sorted name indices
+With A2J_INDEX the names of the functions and the keys of the properties are sorted into indices in RAM
+on the first #a2jLookup or #a2jFindProp and searched binary instead of being scanned linearly.
+Tables with more entries than the index holds are still scanned. */
+//@{
+#ifndef A2J_INDEX_FUNCS
+/** Maximum number of jumptable entries in the index of the function names (2 bytes of RAM each). */
+#define A2J_INDEX_FUNCS 64
+#endif
+#ifndef A2J_INDEX_PROPS
+/** Maximum number of properties in the index of the property keys (2 bytes of RAM each, at most 255). */
+#define A2J_INDEX_PROPS 32
+#endif
 //@}
+#endif // A2J_INDEX
+
+#ifdef A2J_BENCH
+#ifndef A2J_TIME
+	#error "A2J_BENCH requires A2J_TIME"
+#endif
+/** @name Benchmark patterns
+Data generated by #a2jBenchSource and #a2jBenchMany. */
+//@{
+#define A2J_BENCH_ZERO 0 /**< All bytes 0. */
+#define A2J_BENCH_COUNT 1 /**< Position in the block modulo 256. */
+#define A2J_BENCH_ESC 2 /**< Cycles through #A2J_SOF, #A2J_SOS and #A2J_ESC, i.e. every byte has to be escaped (worst case). */
+/** Little-endian 16-bit samples of a staircase rising by 3 every 8 samples, starting at 1000.
+#a2jBenchMany returns it in chunks of even length, so the \ref A2J_MANY_RLE_MASK "payload encodings" can be benchmarked. */
+#define A2J_BENCH_RAMP 3
+//@}
+#endif // A2J_BENCH
+
+#ifdef A2J_SIMAVR
+/** @name simavr tracing
+\anchor simavrtrace
+Markers written to #A2J_SIMAVR_REG while processing a frame.
+A simulator watching the register (see tools/a2jsimbench.c) gets the exact cycles spent in every phase. */
+//@{
+#ifndef A2J_SIMAVR_MCU
+/** MCU simulated by simavr. */
+#define A2J_SIMAVR_MCU "atmega328p"
+#endif
+#ifndef A2J_SIMAVR_REG
+/** Register the markers are written to. */
+#define A2J_SIMAVR_REG GPIOR0
+#endif
+#define A2J_TRACE_IDLE 0 /**< #a2jProcess returns. */
+#define A2J_TRACE_RX 1 /**< Start of a frame received. */
+#define A2J_TRACE_EXEC 2 /**< Command called. */
+#define A2J_TRACE_TX 3 /**< Command returned, sending the reply. */
+//@}
+#endif // A2J_SIMAVR
+
+#ifdef A2J_CAPS
+/** @name Capabilities
+\anchor caps
+Bits of the feature bitmap reported by #a2jGetCaps, one per compile flag. */
+//@{
+#define A2J_CAP_FMAP (1UL<<0)
+#define A2J_CAP_DBG (1UL<<1)
+#define A2J_CAP_PROPS (1UL<<2)
+#define A2J_CAP_PROPS_EE (1UL<<3)
+#define A2J_CAP_SIF (1UL<<4)
+#define A2J_CAP_MANY_WIN (1UL<<5)
+#define A2J_CAP_CRC16 (1UL<<6)
+#define A2J_CAP_MANY_RLE (1UL<<7)
+#define A2J_CAP_DIGEST (1UL<<8)
+#define A2J_CAP_REGIONS (1UL<<9)
+#define A2J_CAP_FWUPDATE (1UL<<10)
+#define A2J_CAP_MEMINFO (1UL<<11)
+#define A2J_CAP_JT_FLAGS (1UL<<12)
+#define A2J_CAP_FASTPATH (1UL<<13)
+#define A2J_CAP_TIME (1UL<<14)
+#define A2J_CAP_PROF (1UL<<15)
+#define A2J_CAP_BENCH (1UL<<16)
+#define A2J_CAP_CAPTURE (1UL<<17)
+#define A2J_CAP_SUBS (1UL<<18)
+#define A2J_CAP_PREFETCH (1UL<<19)
+#define A2J_CAP_BUDGET (1UL<<20)
+
+/** Version of the record sent by #a2jGetCaps. Fields are only ever appended. */
+#define A2J_CAPS_VERSION 1
+/** Offset of #a2jGetCaps in the jumptable, which is fixed so the host can call it before knowing anything else. */
+#define A2J_CAPS_OFFSET 2
+//@}
+
+/** @name Link types
+Reported by #a2jGetCaps. */
+//@{
+#define A2J_LINK_SERIAL 1
+#define A2J_LINK_USB 2
+#define A2J_LINK_HOST 3
+#define A2J_LINK_SIM 4
+//@}
+#endif // A2J_CAPS
+
+#ifndef A2J_RET_DUP
+/** Returned instead of executing a #CMD_P command flagged #A2J_JT_STREAMING a second time,
+if the host repeats the previous request (same sequence number and offset), e.g. after the reply was lost.
+All other commands are executed again. */
+#define A2J_RET_DUP 0xF4
+#endif
+
+#ifndef A2J_RET_BUSY
+/** Returned instead of executing a request that arrived while the previous one was still being executed
+(only with A2J_FASTPATH, where frames are received in the background). The host should repeat the request. */
+#define A2J_RET_BUSY 0xF5
+#endif
 
 /**\name Native endianess to byte array macros
 \anchor lilendianmacros */
 //@{
 /** Write a multibyte value of native endianess into a byte array. */
-#define toArray(type, source, destArray, offset) { type* ntoh_temp_var = (type*)(&(destArray)[offset]);ntoh_temp_var[0] = (source); }
+#define toArray(type, source, destArray, offset) { type ntoh_temp_var = (source); __builtin_memcpy(&(destArray)[offset], &ntoh_temp_var, sizeof(type)); }
 /** Read a multibyte value from a byte array. */
-#define fromArray(type, source, offset) *(type*)(&(source)[offset])
+#define fromArray(type, source, offset) ({ type ntoh_temp_var; __builtin_memcpy(&ntoh_temp_var, &(source)[offset], sizeof(type)); ntoh_temp_var; })
 // @}
 
+/**\name Little-endian byte array functions
+Read and write multibyte values in the byte order of the protocol (little-endian)
+independent of the alignment of the array and the endianess of the machine. */
+//@{
+static inline uint16_t a2jGetU16(const uint8_t* p){
+	return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t a2jGetU32(const uint8_t* p){
+	return a2jGetU16(p) | ((uint32_t)a2jGetU16(p + 2) << 16);
+}
+
+static inline void a2jPutU16(uint8_t* p, uint16_t val){
+	p[0] = val & 0xFF;
+	p[1] = val >> 8;
+}
+
+static inline void a2jPutU32(uint8_t* p, uint32_t val){
+	a2jPutU16(p, val & 0xFFFF);
+	a2jPutU16(p + 2, val >> 16);
+}
+//@}
+
+/**\name Fixed layouts
+Requests and replies with fields at fixed offsets are declared as X-macro lists of F(layout, name, type, offset)
+with \a type one of U8, U16 and U32 (little-endian, see above).
+#A2J_LAYOUT(layout, FIELDS) defines the accessors \a layout_name(p) and \a layout_set_name(p, val) of every field,
+hence handlers neither index raw bytes nor repeat offsets, e.g.
+\code
+#define FOO_REQ(F, L) F(L, id, U8, 0) F(L, period, U16, 1)
+A2J_LAYOUT(fooReq, FOO_REQ)
+
+uint8_t foo(uint8_t *const lenp, uint8_t* *const datap){
+	uint16_t period = fooReq_period(*datap);
+	...
+\endcode */
+//@{
+typedef uint8_t a2j_U8;
+typedef uint16_t a2j_U16;
+typedef uint32_t a2j_U32;
+
+static inline uint8_t a2jGetU8(const uint8_t* p){
+	return p[0];
+}
+
+static inline void a2jPutU8(uint8_t* p, uint8_t val){
+	p[0] = val;
+}
+
+#define A2J_LAYOUT_FIELD(layout, name, type, offset) \
+	static inline a2j_##type layout##_##name(const uint8_t* p){ return a2jGet##type(p + (offset)); } \
+	static inline void layout##_set_##name(uint8_t* p, a2j_##type val){ a2jPut##type(p + (offset), val); }
+/** Defines the accessors of the fields of \a layout listed by the X-macro \a FIELDS. */
+#define A2J_LAYOUT(layout, FIELDS) FIELDS(A2J_LAYOUT_FIELD, layout)
+//@}
+
+/**@ingroup j2amany
+@name a2jMany header layouts
+The \ref manyheader "a2jMany header" (#A2J_MANY_HEADER bytes) of requests and of replies,
+whose first byte carries the return value of the #CMD_P_MANY function instead of its offset. */
+//@{
+#define A2J_MANY_REQ(F, L) F(L, func, U8, 0) F(L, flags, U8, 1) F(L, offset, U32, 2)
+#define A2J_MANY_REPLY(F, L) F(L, ret, U8, 0) F(L, flags, U8, 1) F(L, offset, U32, 2)
+A2J_LAYOUT(a2jManyReq, A2J_MANY_REQ)
+A2J_LAYOUT(a2jManyReply, A2J_MANY_REPLY)
+//@}
+
 #ifdef A2J
+#if defined(A2J_PROPS_EE) && !defined(A2J_PROPS)
+	#error "A2J_PROPS_EE requires A2J_PROPS"
+#endif
+
+/** @name Default function lists
+Lists of (optional) default functions together with their \ref jtflags "command flags", depending on the compile flags.
+\a CMD is applied to every #CMD_P and \a LCMD to every #CMD_P_MANY function (see #ADDJTF/#ADDLJTF). */
+//@{
+#ifdef A2J_PROPS_EE
+	/* the overrides are not covered by the digest */
+	#define A2J_CMDS_GETPROPS(CMD, LCMD) LCMD(a2jGetProperties, A2J_JT_IDEMPOTENT)
+#elif defined(A2J_PROPS)
+	#define A2J_CMDS_GETPROPS(CMD, LCMD) LCMD(a2jGetProperties, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE)
+#else
+	#define A2J_CMDS_GETPROPS(CMD, LCMD)
+#endif
+#ifdef A2J_DBG
+	#define A2J_CMDS_DBG(CMD, LCMD) CMD(a2jDebug, A2J_JT_STREAMING)
+#else
+	#define A2J_CMDS_DBG(CMD, LCMD)
+#endif
+#ifdef A2J_MANY_WIN
+	#define A2J_CMDS_MANY_WIN(CMD, LCMD) CMD(a2jManyWindow, 0)
+#else
+	#define A2J_CMDS_MANY_WIN(CMD, LCMD)
+#endif
+#ifdef A2J_CRC16
+	#define A2J_CMDS_CRC16(CMD, LCMD) CMD(a2jSetChecksum, A2J_JT_IDEMPOTENT)
+#else
+	#define A2J_CMDS_CRC16(CMD, LCMD)
+#endif
+#ifdef A2J_FMAP
+	#define A2J_CMDS_FMAP(CMD, LCMD) \
+		LCMD(a2jGetMappingMany, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE) \
+		CMD(a2jLookup, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE)
+#else
+	#define A2J_CMDS_FMAP(CMD, LCMD)
+#endif
+#ifdef A2J_DIGEST
+	#define A2J_CMDS_DIGEST(CMD, LCMD) CMD(a2jGetDigest, A2J_JT_IDEMPOTENT)
+#else
+	#define A2J_CMDS_DIGEST(CMD, LCMD)
+#endif
+#ifdef A2J_PROPS_EE
+	#define A2J_CMDS_PROPS(CMD, LCMD) CMD(a2jGetProperty, A2J_JT_IDEMPOTENT) CMD(a2jSetProperty, A2J_JT_IDEMPOTENT)
+#elif defined(A2J_PROPS)
+	#define A2J_CMDS_PROPS(CMD, LCMD) CMD(a2jGetProperty, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE)
+#else
+	#define A2J_CMDS_PROPS(CMD, LCMD)
+#endif
+#ifdef A2J_REGIONS
+	#define A2J_CMDS_REGIONS(CMD, LCMD) \
+		LCMD(a2jGetRegions, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE) \
+		LCMD(a2jRegion, A2J_JT_IDEMPOTENT)
+#else
+	#define A2J_CMDS_REGIONS(CMD, LCMD)
+#endif
+#ifdef A2J_FWUPDATE
+	#define A2J_CMDS_FWUPDATE(CMD, LCMD) LCMD(a2jFwUpdate, A2J_JT_STREAMING)
+#else
+	#define A2J_CMDS_FWUPDATE(CMD, LCMD)
+#endif
+#ifdef A2J_CAPS
+	#define A2J_CMDS_CAPS(CMD, LCMD) CMD(a2jGetCaps, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE)
+#else
+	#define A2J_CMDS_CAPS(CMD, LCMD)
+#endif
+#ifdef A2J_MEMINFO
+	#define A2J_CMDS_MEMINFO(CMD, LCMD) CMD(a2jMemInfo, A2J_JT_IDEMPOTENT)
+#else
+	#define A2J_CMDS_MEMINFO(CMD, LCMD)
+#endif
+#ifdef A2J_TIME
+	#define A2J_CMDS_TIME(CMD, LCMD) CMD(a2jTimeSync, A2J_JT_IDEMPOTENT)
+#else
+	#define A2J_CMDS_TIME(CMD, LCMD)
+#endif
+#ifdef A2J_PROF
+	#define A2J_CMDS_PROF(CMD, LCMD) LCMD(a2jProfile, A2J_JT_STREAMING)
+#else
+	#define A2J_CMDS_PROF(CMD, LCMD)
+#endif
+#ifdef A2J_CAPTURE
+	#define A2J_CMDS_CAPTURE(CMD, LCMD) LCMD(a2jCapture, A2J_JT_STREAMING)
+#else
+	#define A2J_CMDS_CAPTURE(CMD, LCMD)
+#endif
+#ifdef A2J_SUBS
+	#define A2J_CMDS_SUBS(CMD, LCMD) CMD(a2jSubscribe, A2J_JT_IDEMPOTENT)
+#else
+	#define A2J_CMDS_SUBS(CMD, LCMD)
+#endif
+#ifdef A2J_BUDGET
+	#define A2J_CMDS_BUDGET(CMD, LCMD) CMD(a2jBudgetStats, A2J_JT_IDEMPOTENT)
+#else
+	#define A2J_CMDS_BUDGET(CMD, LCMD)
+#endif
+#ifdef A2J_BENCH
+	#define A2J_CMDS_BENCH(CMD, LCMD) \
+		CMD(a2jBenchSink, A2J_JT_IDEMPOTENT) \
+		CMD(a2jBenchSource, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE) \
+		LCMD(a2jBenchMany, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE) \
+		CMD(a2jBenchStats, A2J_JT_IDEMPOTENT)
+#else
+	#define A2J_CMDS_BENCH(CMD, LCMD)
+#endif
+#ifdef A2J_JT_FLAGS
+	#define A2J_CMDS_JT_FLAGS(CMD, LCMD) CMD(a2jGetFlags, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE)
+#else
+	#define A2J_CMDS_JT_FLAGS(CMD, LCMD)
+#endif
+/** All default functions following the first jumptable entry (in this order).
+#a2jGetCaps has to stay at #A2J_CAPS_OFFSET. */
+#define A2J_CMDS_DEFAULT(CMD, LCMD) \
+	CMD(a2jMany, 0) \
+	A2J_CMDS_CAPS(CMD, LCMD) \
+	A2J_CMDS_GETPROPS(CMD, LCMD) \
+	A2J_CMDS_DBG(CMD, LCMD) \
+	CMD(a2jEcho, A2J_JT_IDEMPOTENT | A2J_JT_ISR) \
+	LCMD(a2jEchoMany, A2J_JT_IDEMPOTENT) \
+	A2J_CMDS_MANY_WIN(CMD, LCMD) \
+	A2J_CMDS_CRC16(CMD, LCMD) \
+	A2J_CMDS_FMAP(CMD, LCMD) \
+	A2J_CMDS_DIGEST(CMD, LCMD) \
+	A2J_CMDS_PROPS(CMD, LCMD) \
+	A2J_CMDS_REGIONS(CMD, LCMD) \
+	A2J_CMDS_FWUPDATE(CMD, LCMD) \
+	A2J_CMDS_MEMINFO(CMD, LCMD) \
+	A2J_CMDS_JT_FLAGS(CMD, LCMD) \
+	A2J_CMDS_TIME(CMD, LCMD) \
+	A2J_CMDS_PROF(CMD, LCMD) \
+	A2J_CMDS_BENCH(CMD, LCMD) \
+	A2J_CMDS_CAPTURE(CMD, LCMD) \
+	A2J_CMDS_SUBS(CMD, LCMD) \
+	A2J_CMDS_BUDGET(CMD, LCMD)
+//@}
+
 #ifdef A2J_PROPS
 /** @name arduino2j properties macros
 Arduino2j properties are a mapping between string pairs readable by the host computer.
@@ -95,11 +601,43 @@ ADDPROPEXP(MACRO, MACRO)
 //@}
 #endif // A2J_PROPS
 
+#ifdef A2J_REGIONS
+/** @name arduino2j memory region macros
+Memory regions make variables and other memory areas (RAM, flash or EEPROM) accessible by the host
+without the need for specific functions (see #a2jRegion).
+The regions are described by a table in flash, which is created by calling the macros below in succession.
+The expanded output of #REGIONMAP has to be in scope of #ADDREGION and #ADDREGIONVAR respectively.*/
+//@{
+/** Creates a string \a "name" in flash accessible by variable \a name_region */
+#define REGIONMAP(name) static const char PROGMEM name##_region[] = #name;
+/** Header for the region table. Needs to be called first.*/
+#define STARTREGIONS const a2j_region PROGMEM a2j_regions[] = {
+/** Adds a region named \a name of memory \a type (e.g. #A2J_REGION_RAM) spanning \a size bytes at \a base
+with the permissions \a perm (e.g. #A2J_REGION_R | #A2J_REGION_W). */
+#define ADDREGION(name, type, base, size, perm) {name##_region, (const void*)(base), (size), (type), (perm)},
+/** Adds the variable \a var as region. */
+#define ADDREGIONVAR(var, type, perm) ADDREGION(var, type, &(var), sizeof(var), perm)
+/** Finalizes the region table. */
+#define ENDREGIONS }; const uint8_t a2j_regions_elems = sizeof(a2j_regions)/sizeof(a2j_region);
+//@}
+#endif // A2J_REGIONS
+
+#ifdef A2J_JT_FLAGS
+	/** Initializer of the flags of a jumptable entry. */
+	#define A2J_JT_FL(flags) , (flags)
+	/** Member of #jt_entry holding the \ref jtflags "command flags". */
+	#define A2J_JT_FLAGS_MEMBER uint8_t flags;
+#else
+	#define A2J_JT_FL(flags)
+	#define A2J_JT_FLAGS_MEMBER
+#endif // A2J_JT_FLAGS
+
 #ifdef A2J_FMAP
 	/** Struct type that stores a function pointer together with a string to enable function name mapping. */
 	typedef struct{
 		const CMD_P cmd; /**< Function pointer.*/
 		const char* name; /**< Function name.*/
+		A2J_JT_FLAGS_MEMBER
 	}jt_entry;
 
 /** @name arduino2j function mapping macros
@@ -109,120 +647,80 @@ These macros are used to add the function's name together with its offset to the
 This enables the host computer to create a mapping between function names and offsets,
 making function calls potentially independent from the concrete offsets.
 The expanded output of #FUNCMAP has to be in scope of #ADDJT and #ADDLJT respectively.
-#STARTJT, #ADDJT/#ADDLJT and #ENDJT have to be called in succession.*/
+#STARTJT, #ADDJT/#ADDLJT and #ENDJT have to be called in succession (or #DEFINEJT may be used instead).*/
 //@{
 	/** Creates a string \a "alias" in flash accessible by variable \a FuncName_map */
 	#define FUNCMAP(funcName, alias) static const char PROGMEM funcName##_map[] = #alias;
-	/** Appends an entry to the jumptable */
-	#define ADDJT(funcName) , {&funcName, funcName##_map}
-	/** Appends an entry to the jumptable, to be used for a2jMany functions. @see CMD_P_MANY */
-	#define ADDLJT(funcName) , {(CMD_P)&funcName, funcName##_map}
-	/** Finalizes the jumptable/function mapping */
-	#define ENDJT }; const uint8_t a2j_jt_elems = sizeof(a2j_jt)/sizeof(jt_entry);
-
-	#ifdef A2J_DBG
-		#ifdef A2J_PROPS
-			/** Start of the jumptable including entries for various (default) arduino2j functions.*/
-			#define STARTJT \
-			FUNCMAP(a2jGetMapping, a2jGetMapping) \
-			FUNCMAP(a2jMany, a2jMany) \
-			FUNCMAP(a2jGetProperties, a2jGetProperties) \
-			FUNCMAP(a2jDebug, a2jDebug) \
-			FUNCMAP(a2jEcho, a2jEcho) \
-			FUNCMAP(a2jEchoMany, a2jEchoMany) \
-			const jt_entry PROGMEM a2j_jt[] = { \
-			{&a2jGetMapping, a2jGetMapping_map} \
-			ADDJT(a2jMany) \
-			ADDLJT(a2jGetProperties) \
-			ADDJT(a2jDebug) \
-			ADDJT(a2jEcho)\
-			ADDLJT(a2jEchoMany)
-		#else // A2J_PROPS
-			#define STARTJT \
-			FUNCMAP(a2jGetMapping, a2jGetMapping) \
-			FUNCMAP(a2jMany, a2jMany) \
-			FUNCMAP(a2jDebug, a2jDebug) \
-			FUNCMAP(a2jEcho, a2jEcho) \
-			FUNCMAP(a2jEchoMany, a2jEchoMany) \
-			const jt_entry PROGMEM a2j_jt[] = { \
-			{&a2jGetMapping, a2jGetMapping_map} \
-			ADDJT(a2jMany) \
-			ADDJT(a2jDebug) \
-			ADDJT(a2jEcho)\
-			ADDLJT(a2jEchoMany)
-		#endif // A2J_PROPS
-	#else // A2J_DBG
-		#ifdef A2J_PROPS
-			#define STARTJT \
-			FUNCMAP(a2jGetMapping, a2jGetMapping) \
-			FUNCMAP(a2jMany, a2jMany) \
-			FUNCMAP(a2jGetProperties, a2jGetProperties) \
-			FUNCMAP(a2jEcho, a2jEcho) \
-			FUNCMAP(a2jEchoMany, a2jEchoMany) \
-			const jt_entry PROGMEM a2j_jt[] = { \
-			{&a2jGetMapping, a2jGetMapping_map} \
-			ADDJT(a2jMany) \
-			ADDLJT(a2jGetProperties) \
-			ADDJT(a2jEcho)\
-			ADDLJT(a2jEchoMany)
-		#else // A2J_PROPS
-			#define STARTJT \
-			FUNCMAP(a2jGetMapping, a2jGetMapping) \
-			FUNCMAP(a2jMany, a2jMany) \
-			FUNCMAP(a2jEcho, a2jEcho) \
-			FUNCMAP(a2jEchoMany, a2jEchoMany) \
-			const jt_entry PROGMEM a2j_jt[] = { \
-			{&a2jGetMapping, a2jGetMapping_map} \
-			ADDJT(a2jMany) \
-			ADDJT(a2jEcho)\
-			ADDLJT(a2jEchoMany)
-		#endif // A2J_PROPS
-	#endif // A2J_DBG
+	/** Appends an entry with the \ref jtflags "command flags" \a flags to the jumptable.
+	The flags are only stored if A2J_JT_FLAGS is defined. */
+	#define ADDJTF(funcName, flags) , {&funcName, funcName##_map A2J_JT_FL(flags)}
+	/** Appends an entry with the \ref jtflags "command flags" \a flags to the jumptable, to be used for a2jMany functions. @see CMD_P_MANY */
+	#define ADDLJTF(funcName, flags) , {(CMD_P)&funcName, funcName##_map A2J_JT_FL(flags)}
+
+	/** Maps a function to its own name. Used by #DEFINEJT. */
+	#define A2J_FM_CMDF(funcName, flags) FUNCMAP(funcName, funcName)
+	/** The first entry of the jumptable (including its mapping). */
+	#define A2J_FM_FIRST FUNCMAP(a2jGetMapping, a2jGetMapping)
+	#define A2J_JT_FIRST {&a2jGetMapping, a2jGetMapping_map A2J_JT_FL(A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE)}
 //@}
 
 #else // A2J_FMAP
 
+#ifdef A2J_JT_FLAGS
+	typedef struct{
+		const CMD_P cmd;
+		A2J_JT_FLAGS_MEMBER
+	}jt_entry;
+
+	#define ADDJTF(funcName, flags) , {&funcName, (flags)}
+	#define ADDLJTF(funcName, flags) , {(CMD_P)&funcName, (flags)}
+	/* Offset 0 is rejected by a2jProcess without function mapping. */
+	#define A2J_JT_FIRST {&a2jEcho, 0}
+#else
 	typedef CMD_P jt_entry;
 
+	#define ADDJTF(funcName, flags) , &funcName
+	#define ADDLJTF(funcName, flags) , (CMD_P)&funcName
+	/* Offset 0 is rejected by a2jProcess without function mapping. */
+	#define A2J_JT_FIRST &a2jEcho
+#endif // A2J_JT_FLAGS
+
 	#define FUNCMAP(ignored, ignored2) ;
-	#define ADDJT(funcName) , &funcName
-	#define ADDLJT(funcName) , (CMD_P)&funcName
-	#define ENDJT }; const uint8_t a2j_jt_elems = sizeof(a2j_jt)/sizeof(jt_entry);
-
-	#ifdef A2J_DBG
-		#ifdef A2J_PROPS
-			#define STARTJT const CMD_P PROGMEM a2j_jt[] = { \
-				&a2jEcho \
-				ADDJT(a2jMany) \
-				ADDLJT(a2jGetProperties) \
-				ADDJT(a2jDebug) \
-				ADDJT(a2jEcho) \
-				ADDLJT(a2jEchoMany)
-		#else // A2J_PROPS
-			#define STARTJT const CMD_P PROGMEM a2j_jt[] = { \
-				&a2jEcho \
-				ADDJT(a2jMany) \
-				ADDJT(a2jDebug) \
-				ADDJT(a2jEcho) \
-				ADDLJT(a2jEchoMany)
-		#endif // A2J_PROPS
-	#else // A2J_DBG
-		#ifdef A2J_PROPS
-			#define STARTJT const CMD_P PROGMEM a2j_jt[] = { \
-				&a2jEcho \
-				ADDJT(a2jMany) \
-				ADDLJT(a2jGetProperties) \
-				ADDJT(a2jEcho) \
-				ADDLJT(a2jEchoMany)
-		#else // A2J_PROPS
-			#define STARTJT const CMD_P PROGMEM a2j_jt[] = { \
-				&a2jEcho \
-				ADDJT(a2jMany) \
-				ADDJT(a2jEcho) \
-				ADDLJT(a2jEchoMany)
-		#endif // A2J_PROPS
-	#endif // A2J_DBG
+
+	#define A2J_FM_CMDF(funcName, flags)
+	#define A2J_FM_FIRST
 #endif // A2J_FMAP
+
+/** Appends an entry without flags to the jumptable */
+#define ADDJT(funcName) ADDJTF(funcName, 0)
+/** Appends an entry without flags to the jumptable, to be used for a2jMany functions. @see CMD_P_MANY */
+#define ADDLJT(funcName) ADDLJTF(funcName, 0)
+
+/** @name arduino2j jumptable macros */
+//@{
+/** Start of the jumptable including entries for various (default) arduino2j functions.*/
+#define STARTJT \
+	A2J_FM_FIRST \
+	A2J_CMDS_DEFAULT(A2J_FM_CMDF, A2J_FM_CMDF) \
+	const jt_entry PROGMEM a2j_jt[] = { \
+	A2J_JT_FIRST \
+	A2J_CMDS_DEFAULT(ADDJTF, ADDLJTF)
+/** Finalizes the jumptable/function mapping */
+#define ENDJT }; const uint8_t a2j_jt_elems = sizeof(a2j_jt)/sizeof(jt_entry);
+/** Defines the complete jumptable (and function mapping) from a declarative list of functions.
+\a cmds has to be a function-like macro that takes two arguments (\a CMD and \a LCMD) and applies
+\a CMD to every #CMD_P and \a LCMD to every #CMD_P_MANY function to be appended after the default functions,
+each together with its \ref jtflags "command flags", e.g.:
+\code
+#define MY_CMDS(CMD, LCMD) CMD(setLed, A2J_JT_IDEMPOTENT) LCMD(readSamples, A2J_JT_STREAMING)
+DEFINEJT(MY_CMDS)
+\endcode */
+#define DEFINEJT(cmds) \
+	cmds(A2J_FM_CMDF, A2J_FM_CMDF) \
+	STARTJT \
+	cmds(ADDJTF, ADDLJTF) \
+	ENDJT
+//@}
 #else // A2J
 	void a2jProcess(void){};
 	void a2jInit(void){};
@@ -0,0 +1,499 @@
+/** \file
+Asynchronous arduino2j host client (see a2j_client.h).
+
+Build e.g. with
+\code
+g++ -std=c++14 -I<j2arduino>/common -c host/a2j_client.cpp
+\endcode */
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "a2j_client.h"
+#include "j2a_const.h"
+
+namespace a2j {
+
+/* keep in sync with arduino2j.h */
+static const uint8_t CSUM_CRC16 = 1;
+static const uint8_t MANY_ISCHUNK_MASK = 1 << 2;
+static const uint8_t RET_DUP = 0xF4;
+static const uint8_t RET_BUSY = 0xF5;
+static const size_t STAMPS_LEN = 8;
+static const uint8_t CAPS_OFFSET = 2;
+static const size_t CAPS_LEN = 25;
+
+/** CRC-16-CCITT as computed by _crc_ccitt_update of avr-libc. */
+static uint16_t crcCcitt(uint16_t crc, uint8_t data){
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+/** Checksum of a frame, see a2jCsumStart and a2jCsumAdd in arduino2j.c. */
+static uint16_t checksum(uint8_t mode, uint8_t seq, uint8_t cmd, uint8_t len, const uint8_t* data, size_t n){
+	if(mode == CSUM_CRC16){
+		uint16_t crc = crcCcitt(0xFFFF, seq);
+		crc = crcCcitt(crc, cmd);
+		crc = crcCcitt(crc, len);
+		for(size_t i = 0; i < n; i++)
+			crc = crcCcitt(crc, data[i]);
+		return crc;
+	}
+	uint8_t csum = seq ^ (uint8_t)(cmd + A2J_CRC_CMD) ^ (uint8_t)(len + A2J_CRC_LEN);
+	for(size_t i = 0; i < n; i++)
+		csum ^= data[i];
+	return csum;
+}
+
+static uint32_t getU32(const uint8_t* p){
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool Frame::isError() const {
+	return ret >= A2J_RET_OOB && ret <= RET_BUSY && data.size() == 2;
+}
+
+/* see a2jManyPack and a2jRle in arduino2j.c */
+bool decodeMany(const Frame& reply, std::vector<uint8_t>& data){
+	if(reply.isError() || reply.data.size() < A2J_MANY_HEADER)
+		return false;
+	uint8_t flags = reply.data[1];
+	auto it = reply.data.begin() + A2J_MANY_HEADER;
+	data.clear();
+	if(flags & MANY_RLE){
+		while(it != reply.data.end()){
+			uint8_t ctrl = *it++;
+			size_t n = ctrl < 0x80 ? ctrl + 1 : 1;
+			if((size_t)(reply.data.end() - it) < n)
+				return false;
+			if(ctrl < 0x80)
+				data.insert(data.end(), it, it + n);
+			else
+				data.insert(data.end(), ctrl - 0x80 + 3, *it);
+			it += n;
+		}
+	} else {
+		data.assign(it, reply.data.end());
+	}
+	if(flags & MANY_DELTA){
+		if(data.size() & 1)
+			return false;
+		for(size_t i = 2; i < data.size(); i += 2){
+			uint16_t w = (data[i] | (data[i + 1] << 8)) + (data[i - 2] | (data[i - 1] << 8));
+			data[i] = w & 0xFF;
+			data[i + 1] = w >> 8;
+		}
+	}
+	return true;
+}
+
+/* see a2jGetCaps in arduino2j.c */
+bool Caps::parse(const Frame& reply){
+	const std::vector<uint8_t>& d = reply.data;
+	if(reply.ret != 0 || d.size() < CAPS_LEN || d[0] < 1)
+		return false;
+	version = d[0];
+	jtElems = d[1];
+	features = getU32(&d[2]);
+	maxPayload = d[6];
+	manyPayload = d[7];
+	manyWindow = d[8];
+	fastPayload = d[9];
+	checksums = d[10];
+	timeHz = getU32(&d[11]);
+	link = d[15];
+	window = d[16];
+	rxPacket = d[17] | (d[18] << 8);
+	txPacket = d[19] | (d[20] << 8);
+	baud = getU32(&d[21]);
+	return true;
+}
+
+/* ---- Loop ---- */
+
+Loop::Loop(){
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(epfd < 0)
+		throw std::system_error(errno, std::generic_category(), "epoll_create1");
+}
+
+Loop::~Loop(){
+	::close(epfd);
+}
+
+void Loop::add(Link* link){
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.ptr = link;
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, link->fd, &ev) < 0)
+		throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+	links.push_back(link);
+}
+
+void Loop::remove(Link* link){
+	epoll_ctl(epfd, EPOLL_CTL_DEL, link->fd, nullptr);
+	links.erase(std::remove(links.begin(), links.end(), link), links.end());
+}
+
+void Loop::watch(Link* link, bool out){
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	if(out)
+		ev.events |= EPOLLOUT;
+	ev.data.ptr = link;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, link->fd, &ev);
+}
+
+void Loop::stop(){
+	stopped = true;
+}
+
+void Loop::run(){
+	stopped = false;
+	while(!stopped){
+		bool busy = false;
+		for(Link* l : links)
+			busy |= l->outstanding() > 0;
+		if(!busy)
+			break;
+		runOnce(std::chrono::milliseconds(-1));
+	}
+}
+
+bool Loop::runOnce(std::chrono::milliseconds timeout){
+	using clock = Link::clock;
+	if(links.empty())
+		return false;
+	clock::time_point next = clock::time_point::max();
+	for(Link* l : links)
+		next = std::min(next, l->nextDeadline());
+
+	int ms = timeout.count() < 0 ? -1 : (int)timeout.count();
+	if(next != clock::time_point::max()){
+		auto left = std::chrono::duration_cast<std::chrono::milliseconds>(next - clock::now()).count() + 1;
+		left = std::max<decltype(left)>(left, 0);
+		if(ms < 0 || left < ms)
+			ms = (int)left;
+	}
+
+	epoll_event evs[16];
+	int n = epoll_wait(epfd, evs, 16, ms);
+	if(n < 0 && errno != EINTR)
+		throw std::system_error(errno, std::generic_category(), "epoll_wait");
+	for(int i = 0; i < n; i++){
+		Link* l = static_cast<Link*>(evs[i].data.ptr);
+		// the link may have been closed by a callback of a previous event
+		if(std::find(links.begin(), links.end(), l) == links.end())
+			continue;
+		if(evs[i].events & EPOLLOUT)
+			l->flush();
+		if(evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			l->readable();
+	}
+
+	auto now = clock::now();
+	std::vector<Link*> cur(links);
+	for(Link* l : cur){
+		if(std::find(links.begin(), links.end(), l) != links.end())
+			l->expire(now);
+	}
+	return true;
+}
+
+/* ---- Link ---- */
+
+Link::Link(Loop& loop, int fd, Options opts) : loop(loop), fd(fd), opts(opts){
+	if(opts.window < 1 || opts.window > 128)
+		throw std::invalid_argument("window has to be in the range [1; 128]");
+	int fl = fcntl(fd, F_GETFL);
+	if(fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0)
+		throw std::system_error(errno, std::generic_category(), "fcntl");
+	loop.add(this);
+}
+
+Link::~Link(){
+	close();
+}
+
+void Link::call(uint8_t off, const std::vector<uint8_t>& data, ReplyHandler done){
+	submit(Request{off, data, std::move(done), nullptr, {}});
+}
+
+void Link::callWindow(uint8_t off, const std::vector<uint8_t>& data, ChunkHandler chunk, ReplyHandler done){
+	submit(Request{off, data, std::move(done), std::move(chunk), {}});
+}
+
+Status Link::callSync(uint8_t off, const std::vector<uint8_t>& data, Frame& reply){
+	bool done = false;
+	Status res = Status::Closed;
+	call(off, data, [&](Status st, const Frame& f){
+		done = true;
+		res = st;
+		if(st == Status::Ok)
+			reply = f;
+	});
+	while(!done)
+		loop.runOnce(std::chrono::milliseconds(-1));
+	return res;
+}
+
+Status Link::handshake(Caps& caps){
+	Frame reply;
+	Status res = callSync(CAPS_OFFSET, {}, reply);
+	if(res != Status::Ok)
+		return res;
+	if(!caps.parse(reply))
+		throw std::runtime_error("malformed reply to a2jGetCaps");
+	setWindow(std::min<unsigned>(std::max<unsigned>(caps.window, 1), 128));
+	return res;
+}
+
+void Link::setWindow(unsigned window){
+	if(window < 1 || window > 128)
+		throw std::invalid_argument("window has to be in the range [1; 128]");
+	opts.window = window;
+	fill();
+}
+
+void Link::onSif(SifHandler handler){
+	sifHandler = std::move(handler);
+}
+
+void Link::setChecksum(uint8_t mode){
+	opts.checksum = mode;
+}
+
+void Link::setStamps(bool on){
+	opts.stamps = on;
+}
+
+void Link::submit(Request&& req){
+	if(req.data.size() > A2J_MAX_PAYLOAD)
+		throw std::invalid_argument("payload exceeds A2J_MAX_PAYLOAD");
+	if(fd < 0){
+		req.done(Status::Closed, Frame());
+		return;
+	}
+	queue.push_back(std::move(req));
+	fill();
+}
+
+/** Sends queued requests while the window is not full. */
+void Link::fill(){
+	bool sent = false;
+	while(fd >= 0 && !queue.empty() && pending.size() < opts.window){
+		// skip sequence numbers still in flight (possible after timeouts)
+		while(pending.count(nextSeq))
+			nextSeq++;
+		uint8_t seq = nextSeq++;
+		Request& req = pending[seq] = std::move(queue.front());
+		queue.pop_front();
+		req.deadline = clock::now() + opts.timeout;
+		send(seq, req);
+		st.requests++;
+		sent = true;
+	}
+	if(sent)
+		flush();
+}
+
+void Link::put(uint8_t c){
+	if(c == A2J_SOF || c == A2J_SOS || c == A2J_ESC){
+		out.push_back(A2J_ESC);
+		out.push_back(c - 1);
+	} else {
+		out.push_back(c);
+	}
+}
+
+void Link::send(uint8_t seq, const Request& req){
+	uint8_t len = req.data.size();
+	out.push_back(A2J_SOF);
+	put(seq);
+	put(req.off);
+	put(len);
+	for(uint8_t c : req.data)
+		put(c);
+	uint16_t csum = checksum(opts.checksum, seq, req.off, len, req.data.data(), len);
+	put(csum & 0xFF);
+	if(opts.checksum == CSUM_CRC16)
+		put(csum >> 8);
+}
+
+void Link::flush(){
+	size_t done = 0;
+	while(done < out.size()){
+		ssize_t n = ::write(fd, out.data() + done, out.size() - done);
+		if(n < 0){
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN)
+				break;
+			close();
+			return;
+		}
+		done += n;
+	}
+	out.erase(out.begin(), out.begin() + done);
+	bool wantOut = !out.empty();
+	if(wantOut != watchingOut){
+		loop.watch(this, wantOut);
+		watchingOut = wantOut;
+	}
+}
+
+void Link::readable(){
+	uint8_t buf[512];
+	while(fd >= 0){
+		ssize_t n = ::read(fd, buf, sizeof(buf));
+		if(n < 0){
+			if(errno == EINTR)
+				continue;
+			if(errno != EAGAIN)
+				close();
+			return;
+		}
+		if(n == 0){
+			close();
+			return;
+		}
+		for(ssize_t i = 0; i < n && fd >= 0; i++)
+			rxByte(buf[i]);
+	}
+}
+
+/** Feeds one byte of the stream to the receiver (see a2jRxByte in arduino2j.c for the device side). */
+void Link::rxByte(uint8_t c){
+	if(rx.esc){
+		// the byte following A2J_ESC is never a delimiter (an escaped A2J_SOS is sent as A2J_SOF)
+		c += 1;
+		rx.esc = false;
+	} else if(c == A2J_SOF || c == A2J_SOS){
+		if(rx.active)
+			st.badFrames++; // unfinished frame
+		rx.active = true;
+		rx.sif = c == A2J_SOS;
+		rx.raw.clear();
+		return;
+	} else if(!rx.active){
+		return;
+	} else if(c == A2J_ESC){
+		rx.esc = true;
+		return;
+	}
+	rx.raw.push_back(c);
+	if(rx.raw.size() < 3)
+		return;
+	size_t csumLen = opts.checksum == CSUM_CRC16 ? 2 : 1;
+	size_t stampsLen = opts.stamps ? STAMPS_LEN : 0;
+	if(rx.raw.size() == 3 + (size_t)rx.raw[2] + stampsLen + csumLen){
+		rx.active = false;
+		frame();
+	}
+}
+
+/** Handles a completely received frame in #rx. */
+void Link::frame(){
+	const std::vector<uint8_t>& raw = rx.raw;
+	uint8_t len = raw[2];
+	size_t stampsLen = opts.stamps ? STAMPS_LEN : 0;
+	size_t body = 3 + len + stampsLen;
+	uint16_t csum = checksum(opts.checksum, raw[0], raw[1], len, raw.data() + 3, len + stampsLen);
+	uint16_t recv = raw[body];
+	if(opts.checksum == CSUM_CRC16)
+		recv |= raw[body + 1] << 8;
+	if(recv != csum){
+		st.badFrames++;
+		return;
+	}
+
+	Frame f;
+	f.sif = rx.sif;
+	f.seq = raw[0];
+	f.ret = raw[1];
+	f.data.assign(raw.begin() + 3, raw.begin() + 3 + len);
+	if(opts.stamps){
+		f.stamped = true;
+		f.rxTime = getU32(&raw[3 + len]);
+		f.txTime = getU32(&raw[3 + len + 4]);
+	}
+
+	if(f.sif){
+		st.sifs++;
+		if(sifHandler)
+			sifHandler(f);
+		return;
+	}
+	reply(f);
+}
+
+/** Passes the reply \a f to the request with the same sequence number. */
+void Link::reply(Frame& f){
+	auto it = pending.find(f.seq);
+	if(it == pending.end()){
+		st.strayFrames++;
+		return;
+	}
+	Request& req = it->second;
+	if(req.chunk && !f.isError() && f.data.size() >= A2J_MANY_HEADER && (f.data[1] & MANY_ISCHUNK_MASK)){
+		req.deadline = clock::now() + opts.timeout;
+		req.chunk(f);
+		return;
+	}
+	ReplyHandler done = std::move(req.done);
+	pending.erase(it);
+	st.replies++;
+	fill();
+	done(Status::Ok, f);
+}
+
+/** Fails all requests in flight whose deadline has passed. */
+void Link::expire(clock::time_point now){
+	std::vector<ReplyHandler> expired;
+	for(auto it = pending.begin(); it != pending.end();){
+		if(it->second.deadline <= now){
+			expired.push_back(std::move(it->second.done));
+			it = pending.erase(it);
+			st.timeouts++;
+		} else {
+			++it;
+		}
+	}
+	if(expired.empty())
+		return;
+	fill();
+	for(ReplyHandler& done : expired)
+		done(Status::Timeout, Frame());
+}
+
+Link::clock::time_point Link::nextDeadline() const {
+	clock::time_point next = clock::time_point::max();
+	for(const auto& p : pending)
+		next = std::min(next, p.second.deadline);
+	return next;
+}
+
+/** Detaches from the file descriptor and fails all outstanding requests. */
+void Link::close(){
+	if(fd < 0)
+		return;
+	loop.remove(this);
+	fd = -1;
+	std::vector<ReplyHandler> failed;
+	for(auto& p : pending)
+		failed.push_back(std::move(p.second.done));
+	for(auto& r : queue)
+		failed.push_back(std::move(r.done));
+	pending.clear();
+	queue.clear();
+	out.clear();
+	for(ReplyHandler& done : failed)
+		done(Status::Closed, Frame());
+}
+
+}
@@ -0,0 +1,238 @@
+/** \file
+Asynchronous arduino2j host client.
+
+Implements the \ref prot "java2arduino protocol" as seen from the host over any file descriptor (tty, pty, pipe or socket).
+Every #a2j::Link keeps up to a configurable number of requests in flight (the window) and matches the replies
+by their sequence numbers, hence the throughput of a link is not limited by its round trip time.
+Service initiated frames are passed to a callback.
+
+All links of a process are driven by one #a2j::Loop based on epoll, so one thread can serve dozens of devices.
+The classes are not thread-safe: all calls have to be made from the thread running the loop (e.g. from the callbacks).
+
+Example:
+\code
+a2j::Loop loop;
+a2j::Link link(loop, fd);
+link.onSif([](const a2j::Frame& f){ ... });
+for(int i = 0; i < 100; i++)
+	link.call(offEcho, data, [](a2j::Status st, const a2j::Frame& reply){ ... });
+loop.run();
+\endcode */
+
+#ifndef A2J_CLIENT_H
+#define A2J_CLIENT_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace a2j {
+
+/** Outcome of a request. */
+enum class Status {
+	Ok, /**< A reply was received (its return value may still be an error, see #a2j::Frame::isError). */
+	Timeout, /**< No reply was received within #a2j::Link::Options::timeout. */
+	Closed, /**< The link was closed before a reply was received. */
+};
+
+/** A frame received from the device. */
+struct Frame {
+	bool sif = false; /**< Service initiated frame (started by #A2J_SOS). */
+	uint8_t seq = 0;
+	uint8_t ret = 0; /**< Return value of the command or SIF command. */
+	std::vector<uint8_t> data;
+	bool stamped = false; /**< The frame carries the timestamps below (see #a2jTimeSync). */
+	uint32_t rxTime = 0; /**< Device time the request was received. */
+	uint32_t txTime = 0; /**< Device time the frame was sent. */
+
+	/** Returns true if the frame is an \ref j2aerrors "error frame" of the protocol layer. */
+	bool isError() const;
+};
+
+/** Capabilities of a device reported by #a2jGetCaps. */
+struct Caps {
+	uint8_t version = 0;
+	uint8_t jtElems = 0; /**< Number of jumptable entries. */
+	uint32_t features = 0; /**< \ref caps "Feature bitmap". */
+	uint8_t maxPayload = 0;
+	uint8_t manyPayload = 0;
+	uint8_t manyWindow = 0; /**< Chunks per #a2jManyWindow request (0 if not supported). */
+	uint8_t fastPayload = 0; /**< Payload limit of commands executed by the receiver (0 without A2J_FASTPATH). */
+	uint8_t checksums = 0; /**< Bit i is set if checksum i is supported. */
+	uint32_t timeHz = 0; /**< Frequency of the device clock (0 without A2J_TIME). */
+	uint8_t link = 0; /**< Link type, e.g. #A2J_LINK_USB. */
+	uint8_t window = 0; /**< Requests the host may have in flight. */
+	uint16_t rxPacket = 0; /**< Size of the packets received by the device (0 if not packet based). */
+	uint16_t txPacket = 0; /**< Size of the packets sent by the device (0 if not packet based). */
+	uint32_t baud = 0; /**< Baud rate (0 if not applicable). */
+
+	/** Parses the reply of #a2jGetCaps. @return false if it is malformed */
+	bool parse(const Frame& reply);
+};
+
+/** Payload encodings a host may request in the \ref manyheader "a2jMany header" of reads
+(see #A2J_MANY_RLE_MASK and #A2J_MANY_DELTA_MASK, keep in sync with arduino2j.h). */
+enum ManyEncoding : uint8_t {
+	MANY_RLE = 1 << 3,
+	MANY_DELTA = 1 << 4,
+};
+
+/** Decodes the data of the reply \a reply of an a2jMany read into \a data, undoing the encodings flagged in its header.
+@return false if the reply is an error, has no a2jMany header or its encoded data is malformed */
+bool decodeMany(const Frame& reply, std::vector<uint8_t>& data);
+
+/** Called with the outcome of a request. \a reply is only valid if \a st is #Status::Ok. */
+using ReplyHandler = std::function<void(Status st, const Frame& reply)>;
+/** Called for every service initiated frame. */
+using SifHandler = std::function<void(const Frame& sif)>;
+/** Called for every chunk frame sent in reply to an #a2jManyWindow request (see #a2j::Link::callWindow). */
+using ChunkHandler = std::function<void(const Frame& chunk)>;
+
+class Link;
+
+/** Event loop driving any number of links. */
+class Loop {
+public:
+	Loop();
+	~Loop();
+	Loop(const Loop&) = delete;
+	Loop& operator=(const Loop&) = delete;
+
+	/** Runs until no link has requests in flight or queued, or #stop is called. */
+	void run();
+	/** Waits up to \a timeout (forever if negative) for events and handles them.
+	To keep receiving service initiated frames while idle, call this in a loop.
+	@return false if no link is open */
+	bool runOnce(std::chrono::milliseconds timeout);
+	/** Makes #run return after the current iteration. */
+	void stop();
+
+private:
+	friend class Link;
+	void add(Link* link);
+	void remove(Link* link);
+	void watch(Link* link, bool out);
+
+	int epfd;
+	bool stopped = false;
+	std::vector<Link*> links;
+};
+
+/** Connection to one device. */
+class Link {
+public:
+	struct Options {
+		/** Maximum number of requests in flight (1-128). Further requests are queued.
+		The device buffers the requests in its receive buffer while executing one.
+		Devices built with A2J_FASTPATH answer requests arriving meanwhile with #A2J_RET_BUSY, use a window of 1 for them. */
+		unsigned window = 4;
+		/** Time to wait for a reply to a request after it has been sent. */
+		std::chrono::milliseconds timeout{1000};
+		/** Checksum of the frames, #A2J_CSUM_XOR or #A2J_CSUM_CRC16 (see #setChecksum). */
+		uint8_t checksum = 0;
+		/** The device appends timestamps to its frames (see #setStamps). */
+		bool stamps = false;
+	};
+
+	/** Statistics of a link. */
+	struct Stats {
+		uint64_t requests = 0;
+		uint64_t replies = 0;
+		uint64_t sifs = 0;
+		uint64_t timeouts = 0;
+		uint64_t badFrames = 0; /**< Frames with a wrong checksum or unescaped delimiters. */
+		uint64_t strayFrames = 0; /**< Replies without matching request (e.g. after a timeout). */
+	};
+
+	/** Attaches to \a fd, which is switched to non-blocking mode but not closed by the link. */
+	Link(Loop& loop, int fd, Options opts);
+	Link(Loop& loop, int fd) : Link(loop, fd, Options()) {}
+	~Link();
+	Link(const Link&) = delete;
+	Link& operator=(const Link&) = delete;
+
+	/** Calls the function at offset \a off with \a data as payload (upto #A2J_MAX_PAYLOAD bytes).
+	\a done is called exactly once, also if the link is closed or destroyed. */
+	void call(uint8_t off, const std::vector<uint8_t>& data, ReplyHandler done);
+	/** Calls #a2jManyWindow at offset \a off. The chunks are passed to \a chunk, the final reply to \a done. */
+	void callWindow(uint8_t off, const std::vector<uint8_t>& data, ChunkHandler chunk, ReplyHandler done);
+	/** Calls the function at offset \a off and runs the loop until the reply has been received.
+	Other links keep being served meanwhile. */
+	Status callSync(uint8_t off, const std::vector<uint8_t>& data, Frame& reply);
+
+	/** Queries the capabilities of the device (built with A2J_CAPS) by one round trip
+	and applies them, i.e. the window is set to the one reported by the device.
+	Requests already queued are sent with the new window. */
+	Status handshake(Caps& caps);
+	/** Sets the maximum number of requests in flight (see #Options::window). */
+	void setWindow(unsigned window);
+
+	/** Sets the handler of service initiated frames. */
+	void onSif(SifHandler handler);
+	/** Sets the checksum of the following frames.
+	Has to be called after the reply to #a2jSetChecksum has been received and before further requests are sent,
+	i.e. the window should be drained first. Requests selecting #A2J_CSUM_XOR are the exception, they are always
+	protected by #A2J_CSUM_XOR and answered with it, so switch before sending them (this also recovers a session
+	whose checksum is unknown, e.g. after reopening a serial port). */
+	void setChecksum(uint8_t mode);
+	/** Sets whether the device appends timestamps to its frames (see #setChecksum for when to call it). */
+	void setStamps(bool on);
+
+	/** Returns the number of requests in flight. */
+	size_t inFlight() const { return pending.size(); }
+	/** Returns the number of requests in flight or queued. */
+	size_t outstanding() const { return pending.size() + queue.size(); }
+	bool isOpen() const { return fd >= 0; }
+	const Stats& stats() const { return st; }
+
+private:
+	friend class Loop;
+	using clock = std::chrono::steady_clock;
+
+	struct Request {
+		uint8_t off;
+		std::vector<uint8_t> data;
+		ReplyHandler done;
+		ChunkHandler chunk;
+		clock::time_point deadline;
+	};
+
+	void submit(Request&& req);
+	void fill();
+	void send(uint8_t seq, const Request& req);
+	void put(uint8_t c);
+	void flush();
+	void readable();
+	void rxByte(uint8_t c);
+	void frame();
+	void reply(Frame& f);
+	void expire(clock::time_point now);
+	clock::time_point nextDeadline() const;
+	void close();
+
+	Loop& loop;
+	int fd;
+	Options opts;
+	Stats st;
+	SifHandler sifHandler;
+	uint8_t nextSeq = 0;
+	std::deque<Request> queue;
+	std::map<uint8_t, Request> pending;
+	std::vector<uint8_t> out;
+	bool watchingOut = false;
+
+	/** State of the frame being received. */
+	struct {
+		bool active = false; /**< Between a start byte and the checksum. */
+		bool esc = false;
+		bool sif = false;
+		std::vector<uint8_t> raw; /**< seq, ret, len, payload, timestamps and checksum after de-escaping. */
+	} rx;
+};
+
+}
+
+#endif // A2J_CLIENT_H
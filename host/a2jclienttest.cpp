@@ -0,0 +1,432 @@
+/** \file
+Tests host/a2j_client.h against host-native devices (host/a2jdevice.c).
+
+Every device is spawned as a child process connected by a socket pair. The test covers
+- echoes of payloads containing the delimiters (escaping),
+- service initiated frames,
+- switching to CRC-16 and back (if the device supports #a2jSetChecksum),
+- a firmware update chunk repeated with the same sequence number after its reply was lost (if supported),
+- overridden properties in the stream of #a2jGetProperties (if supported),
+- reads of properties and 16-bit samples through the \ref A2J_MANY_RLE_MASK "payload encodings" (if supported),
+- pipelining (the time of 5000 echoes with a window of 1 and 8 is reported),
+- 24 devices served by one loop,
+- timeouts (followed by the stray reply) and links closed by the device.
+
+Build the device with A2J_SIF and A2J_CAPS (and A2J_CRC16 to test the checksum switch, A2J_MANY_RLE and A2J_PROPS to test the encodings,
+A2J_JT_FLAGS and A2J_FWUPDATE with a2j_fwupdate.c to test repeated chunks,
+A2J_PROPS_EE with a2j_props_ee.c and an A2J_PROPS_EE_SIZE of 1024 to test overridden properties), e.g.
+\code
+gcc -std=gnu99 -DA2J -DA2J_HOST -DA2J_OPTS -DA2J_FMAP -DA2J_SIF -DA2J_CAPS -DA2J_CRC16 -DA2J_MANY_RLE -DA2J_PROPS -I. -Ihost/compat -Icommon \
+	-o a2jdevice host/a2jdevice.c arduino2j.c a2j_lowlevel_host.c a2j_debug.c a2j_time.c
+g++ -std=c++14 -Icommon -o a2jclienttest host/a2jclienttest.cpp host/a2j_client.cpp
+\endcode
+
+usage: a2jclienttest device-executable
+
+Exits with 1 if any check failed. */
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "a2j_client.h"
+#include "j2a_const.h"
+
+/* keep in sync with arduino2j.h and host/a2jdevice.c */
+static const uint8_t CSUM_XOR = 0;
+static const uint8_t CSUM_CRC16 = 1;
+static const uint8_t DEVICE_SIF = 0x5F;
+static const uint8_t ECHO_RET = 0xBA;
+static const uint8_t ECHO_MANY_RET = 0xBE;
+static const uint8_t MANY_ISLAST = 1 << 0;
+static const uint8_t MANY_ISWRITE = 1 << 1;
+static const uint32_t CAP_MANY_RLE = 1UL << 7;
+static const uint32_t CAP_FWUPDATE = 1UL << 10;
+static const uint32_t CAP_JT_FLAGS = 1UL << 12;
+
+using clk = std::chrono::steady_clock;
+
+static const char* device;
+static int failures = 0;
+
+/** Prints the outcome of a check. */
+static void check(bool ok, const char* what){
+	printf("%-40s %s\n", what, ok ? "ok" : "FAIL");
+	if(!ok)
+		failures++;
+}
+
+/** Spawns the device connected to the returned descriptor (-1 on errors). Its pid is stored in \a pid. */
+static int spawn(pid_t& pid){
+	int sv[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+		return -1;
+	pid = fork();
+	if(pid < 0)
+		return -1;
+	if(pid == 0){
+		dup2(sv[1], 0);
+		dup2(sv[1], 1);
+		close(sv[0]);
+		close(sv[1]);
+		execl(device, device, (char*)NULL);
+		_exit(127);
+	}
+	close(sv[1]);
+	return sv[0];
+}
+
+/** Returns the offset of the function \a name in the function mapping or -1. */
+static int lookup(a2j::Link& link, const char* name){
+	a2j::Frame f;
+	if(link.callSync(0, {}, f) != a2j::Status::Ok || f.isError())
+		return -1;
+	int off = 0;
+	for(size_t i = 0; i < f.data.size(); off++){
+		std::string n(reinterpret_cast<const char*>(&f.data[i]), strnlen(reinterpret_cast<const char*>(&f.data[i]), f.data.size() - i));
+		if(n == name)
+			return off;
+		i += n.size() + 1;
+	}
+	return -1;
+}
+
+/** @return true if the echo of \a data by the function at \a off succeeds */
+static bool echo(a2j::Link& link, uint8_t off, const std::vector<uint8_t>& data){
+	a2j::Frame f;
+	return link.callSync(off, data, f) == a2j::Status::Ok && f.ret == ECHO_RET && f.data == data;
+}
+
+/** Sends a request with the sequence number \a seq on the blocking descriptor \a fd and receives its reply,
+bypassing #a2j::Link (which never repeats a sequence number). Only the XOR checksum without timestamps is supported.
+@return true if a reply with a matching checksum was received */
+static bool rawCall(int fd, uint8_t seq, uint8_t off, const std::vector<uint8_t>& data, a2j::Frame& reply){
+	std::vector<uint8_t> raw = {seq, off, (uint8_t)data.size()};
+	raw.insert(raw.end(), data.begin(), data.end());
+	uint8_t csum = seq ^ (uint8_t)(off + A2J_CRC_CMD) ^ (uint8_t)(data.size() + A2J_CRC_LEN);
+	for(uint8_t b : data)
+		csum ^= b;
+	raw.push_back(csum);
+	std::vector<uint8_t> buf = {A2J_SOF};
+	for(uint8_t b : raw){
+		if(b == A2J_SOF || b == A2J_SOS || b == A2J_ESC){
+			buf.push_back(A2J_ESC);
+			buf.push_back(b - 1);
+		} else {
+			buf.push_back(b);
+		}
+	}
+	if(write(fd, buf.data(), buf.size()) != (ssize_t)buf.size())
+		return false;
+
+	raw.clear();
+	bool started = false, esc = false;
+	uint8_t c;
+	while(!(raw.size() >= 3 && raw.size() == 4u + raw[2])){
+		if(read(fd, &c, 1) != 1)
+			return false;
+		if(esc){
+			raw.push_back(c + 1);
+			esc = false;
+		} else if(c == A2J_SOF){
+			started = true;
+			raw.clear();
+		} else if(c == A2J_SOS){
+			started = false; // service initiated frames are ignored
+		} else if(started && c == A2J_ESC){
+			esc = true;
+		} else if(started){
+			raw.push_back(c);
+		}
+	}
+	csum = 0;
+	for(size_t i = 3; i < raw.size() - 1; i++)
+		csum ^= raw[i];
+	csum ^= raw[0] ^ (uint8_t)(raw[1] + A2J_CRC_CMD) ^ (uint8_t)(raw[2] + A2J_CRC_LEN);
+	reply = a2j::Frame();
+	reply.seq = raw[0];
+	reply.ret = raw[1];
+	reply.data.assign(raw.begin() + 3, raw.end() - 1);
+	return csum == raw.back();
+}
+
+/** Writes \a len bytes at \a off of a firmware image by #a2jFwUpdate at \a offFw via #a2jMany at \a offMany,
+sending the request with the sequence number \a seq. @return true if the chunk was acknowledged */
+static bool fwChunk(int fd, uint8_t seq, uint8_t offMany, uint8_t offFw, uint32_t off, uint8_t len){
+	std::vector<uint8_t> req = {offFw, MANY_ISWRITE, (uint8_t)off, (uint8_t)(off >> 8), (uint8_t)(off >> 16), (uint8_t)(off >> 24)};
+	for(uint8_t i = 0; i < len; i++)
+		req.push_back((uint8_t)(off + i));
+	a2j::Frame f;
+	return rawCall(fd, seq, offMany, req, f) && f.seq == seq && !f.isError() && f.ret == 0 && !f.data.empty() && f.data[0] == 0;
+}
+
+/** Reads the block of the #CMD_P_MANY function at \a func into \a data requesting the encodings \a enc.
+\a wire is set to the bytes received after the a2jMany headers, \a applied to the encodings applied to any chunk.
+@return true on success */
+static bool readMany(a2j::Link& link, uint8_t offMany, uint8_t func, uint8_t enc, std::vector<uint8_t>& data, size_t& wire, uint8_t& applied){
+	data.clear();
+	wire = 0;
+	applied = 0;
+	for(uint32_t off = 0; ; ){
+		a2j::Frame f;
+		std::vector<uint8_t> chunk;
+		if(link.callSync(offMany, {func, enc, (uint8_t)off, (uint8_t)(off >> 8), (uint8_t)(off >> 16), (uint8_t)(off >> 24)}, f) != a2j::Status::Ok
+			|| f.ret != 0 || !a2j::decodeMany(f, chunk) || f.data[0] != 0)
+			return false;
+		data.insert(data.end(), chunk.begin(), chunk.end());
+		wire += f.data.size() - A2J_MANY_HEADER;
+		applied |= f.data[1] & (a2j::MANY_RLE | a2j::MANY_DELTA);
+		off += chunk.size();
+		if(f.data[1] & MANY_ISLAST)
+			return true;
+		if(chunk.empty())
+			return false;
+	}
+}
+
+/** Sends \a n echoes of 32 bytes with a window of \a window. @return the time taken in ms or -1 on failures */
+static double pipeline(a2j::Loop& loop, uint8_t offEcho, unsigned window, int n){
+	pid_t pid;
+	int fd = spawn(pid);
+	a2j::Link::Options opts;
+	opts.window = window;
+	a2j::Link link(loop, fd, opts);
+	int ok = 0;
+	auto t0 = clk::now();
+	for(int i = 0; i < n; i++){
+		std::vector<uint8_t> data(32, (uint8_t)i);
+		link.call(offEcho, data, [&ok, data](a2j::Status st, const a2j::Frame& f){
+			if(st == a2j::Status::Ok && f.data == data)
+				ok++;
+		});
+	}
+	loop.run();
+	double ms = std::chrono::duration<double, std::milli>(clk::now() - t0).count();
+	close(fd);
+	waitpid(pid, NULL, 0);
+	return ok == n ? ms : -1;
+}
+
+int main(int argc, char** argv){
+	if(argc != 2){
+		fprintf(stderr, "usage: %s device-executable\n", argv[0]);
+		return 1;
+	}
+	device = argv[1];
+	signal(SIGPIPE, SIG_IGN);
+
+	a2j::Loop loop;
+	pid_t pid;
+	int fd = spawn(pid);
+	if(fd < 0){
+		perror("spawn");
+		return 1;
+	}
+	a2j::Link link(loop, fd);
+	a2j::Caps caps;
+	check(link.handshake(caps) == a2j::Status::Ok, "handshake");
+	int offEcho = lookup(link, "a2jEcho");
+	int offSif = lookup(link, "deviceSif");
+	int offDelay = lookup(link, "deviceDelay");
+	int offCsum = lookup(link, "a2jSetChecksum");
+	if(offEcho < 0 || offSif < 0 || offDelay < 0){
+		fprintf(stderr, "a2jEcho, deviceSif or deviceDelay not found, build the device with A2J_FMAP and A2J_SIF\n");
+		return 1;
+	}
+
+	a2j::Frame f;
+	int offLookup = lookup(link, "a2jLookup");
+	if(offLookup >= 0){
+		// unsorted names, a missing one and a prefix of an existing one
+		const char* names[] = {"deviceSif", "a2jEcho", "noSuchFunction", "a2jLookup", "a2j", "deviceDelay"};
+		std::vector<uint8_t> req;
+		for(const char* n : names)
+			req.insert(req.end(), n, n + strlen(n) + 1);
+		bool ok = link.callSync(offLookup, req, f) == a2j::Status::Ok && f.ret == 0 && f.data.size() == 6;
+		for(size_t i = 0; ok && i < 6; i++){
+			int off = lookup(link, names[i]);
+			ok = f.data[i] == (off < 0 ? 0xFF : off);
+		}
+		check(ok, "a2jLookup");
+	}
+
+	std::vector<uint8_t> delims = {A2J_SOF, A2J_SOS, A2J_ESC, A2J_ESC - 1, A2J_SOF - 1, 0, 0xFF};
+	check(echo(link, offEcho, delims), "echo of delimiters");
+	std::vector<uint8_t> full(A2J_MAX_PAYLOAD);
+	for(size_t i = 0; i < full.size(); i++)
+		full[i] = (uint8_t)i;
+	check(echo(link, offEcho, full), "echo of the maximum payload");
+
+	std::vector<a2j::Frame> sifs;
+	link.onSif([&sifs](const a2j::Frame& f){ sifs.push_back(f); });
+	link.callSync(offSif, delims, f);
+	for(auto end = clk::now() + std::chrono::milliseconds(500); sifs.empty() && clk::now() < end; )
+		loop.runOnce(std::chrono::milliseconds(10));
+	check(sifs.size() == 1 && sifs[0].ret == DEVICE_SIF && sifs[0].data == delims, "service initiated frame");
+
+	if(offCsum >= 0 && (caps.checksums & (1 << CSUM_CRC16))){
+		bool ok = link.callSync(offCsum, {CSUM_CRC16}, f) == a2j::Status::Ok && f.ret == 0;
+		link.setChecksum(CSUM_CRC16);
+		ok = ok && echo(link, offEcho, delims) && echo(link, offEcho, full);
+		// requests selecting XOR are protected by XOR, as by a host that does not know the session's checksum
+		link.setChecksum(CSUM_XOR);
+		ok = ok && link.callSync(offCsum, {CSUM_XOR}, f) == a2j::Status::Ok && f.ret == 0;
+		ok = ok && echo(link, offEcho, delims);
+		check(ok && link.stats().badFrames == 0, "checksum switch to CRC-16 and back");
+	} else {
+		printf("%-40s skipped (no A2J_CRC16)\n", "checksum switch to CRC-16 and back");
+	}
+
+	int offMany = lookup(link, "a2jMany");
+	int offEchoMany = lookup(link, "a2jEchoMany");
+	if(offMany >= 0 && offEchoMany >= 0){
+		bool ok = true;
+		for(uint8_t flags : {(uint8_t)0, (uint8_t)(MANY_ISLAST | MANY_ISWRITE)}){
+			std::vector<uint8_t> req = {(uint8_t)offEchoMany, flags, 0x78, 0x56, 0x34, 0x12};
+			req.insert(req.end(), delims.begin(), delims.end());
+			ok = ok && link.callSync(offMany, req, f) == a2j::Status::Ok && f.ret == 0 && f.data.size() == req.size()
+				&& f.data[0] == ECHO_MANY_RET && f.data[1] == (flags & MANY_ISLAST)
+				&& std::equal(req.begin() + 2, req.end(), f.data.begin() + 2);
+		}
+		check(ok, "a2jEchoMany loopback");
+	}
+	int offProps = lookup(link, "a2jGetProperties");
+	int offSamples = lookup(link, "deviceSamples");
+	if(offMany >= 0 && offSamples >= 0 && (caps.features & CAP_MANY_RLE)){
+		std::vector<uint8_t> plain, enc;
+		size_t plainWire, encWire;
+		uint8_t applied;
+		bool ok = readMany(link, offMany, offSamples, 0, plain, plainWire, applied) && plain.size() == 2 * 1024;
+		static const uint8_t encs[] = {a2j::MANY_RLE, a2j::MANY_DELTA, a2j::MANY_RLE | a2j::MANY_DELTA};
+		for(uint8_t e : encs){
+			ok = ok && readMany(link, offMany, offSamples, e, enc, encWire, applied) && enc == plain
+				&& (!(e & a2j::MANY_DELTA) || applied == e); // the raw samples hardly contain runs
+			if(e == (a2j::MANY_RLE | a2j::MANY_DELTA))
+				printf("  samples: %zu bytes, %zu on the wire with RLE and delta\n", plainWire, encWire);
+		}
+		check(ok, "round trip of samples through RLE/delta");
+		if(offProps >= 0){
+			ok = readMany(link, offMany, offProps, 0, plain, plainWire, applied) && !plain.empty();
+			for(uint8_t e : encs)
+				ok = ok && readMany(link, offMany, offProps, e, enc, encWire, applied) && enc == plain;
+			check(ok, "round trip of properties through RLE/delta");
+		}
+	} else {
+		printf("%-40s skipped (no A2J_MANY_RLE)\n", "round trip through RLE/delta");
+	}
+
+	int offGetProp = lookup(link, "a2jGetProperty");
+	if(offGetProp >= 0){
+		// keys out of order, a missing one and a prefix of an existing one
+		const std::pair<std::string, std::string> props[] = {{"serial", std::string(32, '0')}, {"board", "host"}, {"device", "host"}};
+		bool ok = true;
+		for(const auto& p : props)
+			ok = ok && link.callSync(offGetProp, std::vector<uint8_t>(p.first.begin(), p.first.end()), f) == a2j::Status::Ok
+				&& f.ret == 0 && std::string(f.data.begin(), f.data.end()) == p.second;
+		for(std::string key : {"noSuchKey", "dev"})
+			ok = ok && link.callSync(offGetProp, std::vector<uint8_t>(key.begin(), key.end()), f) == a2j::Status::Ok && f.ret == 0xFF;
+		check(ok, "a2jGetProperty");
+	}
+
+	int offSetProp = lookup(link, "a2jSetProperty");
+	if(offMany >= 0 && offProps >= 0 && offSetProp >= 0){
+		std::vector<uint8_t> before, after;
+		size_t wire;
+		uint8_t applied;
+		// shifts the following properties into the next chunk (needs banks of more than 250 bytes)
+		std::string value(240, 'v');
+		std::string req = std::string("device") + '\0' + value;
+		bool ok = readMany(link, offMany, offProps, 0, before, wire, applied)
+			&& link.callSync(offSetProp, std::vector<uint8_t>(req.begin(), req.end()), f) == a2j::Status::Ok && f.ret == 0
+			&& readMany(link, offMany, offProps, 0, after, wire, applied);
+		std::string s(before.begin(), before.end());
+		std::string def = std::string("device") + '\0' + "host" + '\0';
+		size_t pos = s.find(def);
+		ok = ok && pos != std::string::npos
+			&& std::string(after.begin(), after.end()) == s.replace(pos, def.size(), req + '\0');
+		check(ok, "overridden property in a2jGetProperties");
+	} else {
+		printf("%-40s skipped (no A2J_PROPS_EE)\n", "overridden property in a2jGetProperties");
+	}
+
+	int offFw = lookup(link, "a2jFwUpdate");
+	if(offMany >= 0 && offFw >= 0 && (caps.features & CAP_FWUPDATE) && (caps.features & CAP_JT_FLAGS)){
+		pid_t p;
+		int fdr = spawn(p);
+		// the reply to the second chunk is lost, the host repeats it with the same sequence number
+		bool ok = fwChunk(fdr, 1, offMany, offFw, 0, 200) && fwChunk(fdr, 2, offMany, offFw, 200, 200)
+			&& fwChunk(fdr, 2, offMany, offFw, 200, 200) && fwChunk(fdr, 3, offMany, offFw, 400, 200);
+		check(ok, "repeated firmware update chunk");
+		close(fdr);
+		kill(p, SIGTERM);
+		waitpid(p, NULL, 0);
+	} else {
+		printf("%-40s skipped (no A2J_FWUPDATE or A2J_JT_FLAGS)\n", "repeated firmware update chunk");
+	}
+
+	double ms1 = pipeline(loop, offEcho, 1, 5000);
+	double ms8 = pipeline(loop, offEcho, 8, 5000);
+	check(ms1 >= 0 && ms8 >= 0, "5000 echoes with a window of 1 and 8");
+	printf("  window 1: %.1f ms, window 8: %.1f ms\n", ms1, ms8);
+
+	{
+		std::vector<std::unique_ptr<a2j::Link>> links;
+		std::vector<pid_t> pids;
+		int ok = 0;
+		for(int i = 0; i < 24; i++){
+			pid_t p;
+			int fdn = spawn(p);
+			if(fdn < 0)
+				break;
+			pids.push_back(p);
+			links.emplace_back(new a2j::Link(loop, fdn));
+			for(int k = 0; k < 50; k++){
+				links.back()->call(offEcho, {(uint8_t)i, (uint8_t)k}, [&ok](a2j::Status st, const a2j::Frame& r){
+					ok += st == a2j::Status::Ok && r.ret == ECHO_RET;
+				});
+			}
+		}
+		loop.run();
+		check(ok == 24 * 50, "24 devices in one loop");
+		links.clear();
+		for(pid_t p : pids){
+			kill(p, SIGTERM);
+			waitpid(p, NULL, 0);
+		}
+	}
+
+	{
+		a2j::Link::Options opts;
+		opts.timeout = std::chrono::milliseconds(50);
+		pid_t p;
+		int fdt = spawn(p);
+		a2j::Link slow(loop, fdt, opts);
+		a2j::Status st = a2j::Status::Ok;
+		slow.call(offDelay, {200}, [&st](a2j::Status s, const a2j::Frame&){ st = s; });
+		loop.run();
+		check(st == a2j::Status::Timeout && slow.stats().timeouts == 1, "timeout");
+		// the late reply is discarded and the link stays usable
+		usleep(250000);
+		check(echo(slow, offEcho, delims) && slow.stats().strayFrames == 1, "stray reply after a timeout");
+
+		slow.call(offDelay, {200}, [&st](a2j::Status s, const a2j::Frame&){ st = s; });
+		kill(p, SIGKILL);
+		waitpid(p, NULL, 0);
+		loop.run();
+		check(st == a2j::Status::Closed && !slow.isOpen(), "link closed by the device");
+		close(fdt);
+	}
+
+	close(fd);
+	waitpid(pid, NULL, 0);
+	printf("%d failures\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+/** \file
+Host-native arduino2j device.
+
+Runs #a2jProcess as a native process, which serves the default functions and a few test functions below.
+It is used to test host software (e.g. host/a2j_client.h) and to benchmark the protocol code without hardware.
+
+usage: a2jdevice [-p]
+
+Without options the frames are read from stdin and written to stdout (e.g. to be spawned with a socket pair).
+With -p a pseudo terminal is created and the path of its slave is printed to stdout.
+
+Build e.g. with the options of the firmware under test:
+\code
+gcc -std=gnu99 -DA2J -DA2J_HOST -DA2J_OPTS -DA2J_FMAP -DA2J_SIF -DA2J_PROPS -I. -Ihost/compat -Icommon \
+	-o a2jdevice host/a2jdevice.c arduino2j.c a2j_lowlevel_host.c a2j_debug.c a2j_props_ee.c a2j_time.c
+\endcode
+With -DA2J_FWUPDATE add a2j_fwupdate.c, the flash is then emulated below. Activating an update ends the process
+(the device would be reset by the watchdog). */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include "arduino2j.h"
+#include "a2j_lowlevel_host.h"
+#include "a2j_fwupdate.h"
+
+#ifdef A2J_SIF
+/** @name Pending service initiated frame */
+//@{
+static uint8_t sifBuf[A2J_MAX_PAYLOAD];
+static uint8_t sifLen;
+static bool sifPending = false;
+//@}
+
+/** Replies with an empty payload and sends the payload back as service initiated frame with the command 0x5F afterwards
+(SIFs cannot be sent while #a2jProcess is running). */
+uint8_t deviceSif(uint8_t *const lenp, uint8_t* *const datap){
+	memcpy(sifBuf, *datap, *lenp);
+	sifLen = *lenp;
+	sifPending = true;
+	*lenp = 0;
+	return 0;
+}
+
+/** Sends the SIF requested by #deviceSif, if any. */
+static void deviceSendSif(void){
+	if(sifPending){
+		sifPending = false;
+		a2jSendSif(0x5F, sifLen, sifBuf);
+	}
+}
+	#define DEVICE_CMDS_SIF(CMD, LCMD) CMD(deviceSif, 0)
+#else
+	#define DEVICE_CMDS_SIF(CMD, LCMD)
+#endif // A2J_SIF
+
+/** Sleeps for the number of milliseconds in the first byte of the payload and echoes it (to test pipelining, timeouts and execution budgets). */
+uint8_t deviceDelay(uint8_t *const lenp, uint8_t* *const datap){
+	if(*lenp > 0)
+		usleep((*datap)[0] * 1000);
+	return 0;
+}
+
+/** Size of the block read by #deviceSlowMany. */
+#define DEVICE_SLOW_SIZE 1024
+
+/**@ingroup j2amany
+Reads a block of #DEVICE_SLOW_SIZE bytes (the offset modulo 256) and sleeps for the number of milliseconds
+in the first byte of the payload per chunk (to test the read-ahead of sequential reads).
+The chunks are returned from a buffer of its own by repointing \a *datap. */
+uint8_t deviceSlowMany(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	if(isWrite || *lenp < 1 || *offset >= DEVICE_SLOW_SIZE)
+		return -1;
+	usleep((*datap)[0] * 1000);
+	uint32_t rest = DEVICE_SLOW_SIZE - *offset;
+	uint8_t len = rest < A2J_MANY_PAYLOAD ? rest : A2J_MANY_PAYLOAD;
+	static uint8_t chunk[A2J_MANY_PAYLOAD];
+	for(uint8_t i = 0; i < len; i++)
+		chunk[i] = *offset + i;
+	*datap = chunk;
+	*lenp = len;
+	*isLastp = len == rest;
+	return 0;
+}
+
+/** Number of 16-bit samples read by #deviceSamples. */
+#define DEVICE_SAMPLES 1024
+
+/**@ingroup j2amany
+Reads #DEVICE_SAMPLES little-endian 16-bit samples of a staircase (every value is repeated 8 times)
+in chunks of even length (to test the \ref A2J_MANY_RLE_MASK "payload encodings"). */
+uint8_t deviceSamples(bool* isLastp, bool isWrite, uint32_t *const offset, uint8_t *const lenp, uint8_t* *const datap){
+	if(isWrite || *offset >= 2 * DEVICE_SAMPLES || (*offset & 1))
+		return -1;
+	uint32_t rest = 2 * DEVICE_SAMPLES - *offset;
+	uint8_t len = rest < (A2J_MANY_PAYLOAD & ~1) ? rest : (A2J_MANY_PAYLOAD & ~1);
+	for(uint8_t i = 0; i < len; i += 2){
+		uint16_t sample = 1000 + (uint16_t)((*offset + i) / 16) * 3;
+		(*datap)[i] = sample & 0xFF;
+		(*datap)[i + 1] = sample >> 8;
+	}
+	*lenp = len;
+	*isLastp = len == rest;
+	return 0;
+}
+
+#define DEVICE_CMDS(CMD, LCMD) \
+	CMD(deviceDelay, A2J_JT_IDEMPOTENT | A2J_JT_BUDGET(50)) \
+	LCMD(deviceSlowMany, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE) \
+	LCMD(deviceSamples, A2J_JT_IDEMPOTENT | A2J_JT_CACHEABLE) \
+	DEVICE_CMDS_SIF(CMD, LCMD)
+
+DEFINEJT(DEVICE_CMDS)
+
+#ifdef A2J_PROPS
+STARTPROPS
+ADDPROP(device, host)
+ADDPROP(serial, 00000000000000000000000000000000)
+ADDPROP(board, host)
+ENDPROPS
+#endif // A2J_PROPS
+
+#ifdef A2J_REGIONS
+static uint8_t deviceBuf[256];
+REGIONMAP(deviceBuf)
+STARTREGIONS
+ADDREGIONVAR(deviceBuf, A2J_REGION_RAM, A2J_REGION_R | A2J_REGION_W)
+ENDREGIONS
+#endif // A2J_REGIONS
+
+#ifdef A2J_FWUPDATE
+/** Emulated flash up to the end of the staging area of the firmware update, erased at startup. */
+static uint8_t deviceFlash[A2J_FW_START + A2J_FW_SIZE];
+
+void a2jFwProgramPage(uint32_t addr, const uint8_t* data){
+	memcpy(deviceFlash + addr, data, SPM_PAGESIZE);
+}
+
+uint8_t a2jFwReadByte(uint32_t addr){
+	return deviceFlash[addr];
+}
+
+/** The emulated flash holds no application image. */
+uint32_t a2jFwImageEnd(void){
+	return 0;
+}
+#endif // A2J_FWUPDATE
+
+/** Creates a pseudo terminal in raw mode and returns its master or -1. */
+static int openPty(void){
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if(fd < 0 || grantpt(fd) || unlockpt(fd))
+		return -1;
+	struct termios t;
+	if(tcgetattr(fd, &t) == 0){
+		cfmakeraw(&t);
+		tcsetattr(fd, TCSANOW, &t);
+	}
+	// keep the slave open, otherwise reading the master fails until the first client connects
+	if(open(ptsname(fd), O_RDWR | O_NOCTTY) < 0)
+		return -1;
+	printf("%s\n", ptsname(fd));
+	fflush(stdout);
+	return fd;
+}
+
+int main(int argc, char** argv){
+	int opt;
+	int fd = -1;
+	while((opt = getopt(argc, argv, "p")) != -1){
+		switch(opt){
+			case 'p':
+				if((fd = openPty()) < 0){
+					perror("pty");
+					return 1;
+				}
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-p]\n", argv[0]);
+				return 1;
+		}
+	}
+
+#ifdef A2J_FWUPDATE
+	memset(deviceFlash, 0xFF, sizeof(deviceFlash));
+#endif // A2J_FWUPDATE
+	a2jInit();
+	if(fd >= 0)
+		a2jHostOpen(fd, fd);
+	while(a2jHostWait(-1)){
+		a2jProcess();
+#ifdef A2J_SIF
+		deviceSendSif();
+#endif // A2J_SIF
+		// idle like the main loop of a device if no further frame is pending (e.g. to read ahead),
+		// which processes the frame if it was not complete before
+		a2jProcess();
+#ifdef A2J_SIF
+		deviceSendSif();
+#endif // A2J_SIF
+	}
+	// replies to the frames received completely before the input was closed
+	a2jProcess();
+	return 0;
+}
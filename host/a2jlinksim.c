@@ -0,0 +1,377 @@
+/** \file
+Protocol efficiency model of arduino2j links.
+
+Runs the unmodified #a2jProcess against the link simulator (see a2j_lowlevel_sim.h) and a simulated host,
+which keeps a window of requests in flight, checks the replies and retransmits lost or corrupted requests.
+For every link configuration given on the command line one line is printed with the requests per second,
+the mean latency, the payload throughput and the efficiency, i.e. the payload throughput relative to the raw bandwidth
+of the link in the direction of the payload (baud/10 for UART, packet slots times endpoint size for USB).
+
+Scenarios:
+- rpc: #a2jEcho with a payload of the given size, i.e. small round trips.
+- bulk: sequential reads of #a2jBenchMany via #a2jMany, i.e. a large transfer split into frames of #A2J_MANY_PAYLOAD bytes.
+
+Link configurations:
+- uart:BAUD[:RXBUF[:TXBUF]]
+- usb:EP[:BANKS[:PACKETS-PER-FRAME[:SOF-ALIGNED]]]
+
+Built with the same options as the firmware under test, plus A2J_TIME and A2J_BENCH, e.g.:
+\code
+gcc -std=gnu99 -O2 -DA2J -DA2J_LINKSIM -DA2J_OPTS -DA2J_TIME -DA2J_BENCH -I. -Ihost/compat -Icommon \
+	-o a2jlinksim host/a2jlinksim.c arduino2j.c a2j_lowlevel_sim.c a2j_debug.c a2j_props_ee.c a2j_time.c -lm
+\endcode
+
+usage: a2jlinksim [-m rpc|bulk] [-w window] [-p payload] [-d duration-ms] [-c cpu-hz] [-b byte-cycles] [-f frame-cycles]
+[-e ber] [-s seed] [-l host-latency-us] [-t timeout-ms] link... */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "arduino2j.h"
+#include "a2j_lowlevel_sim.h"
+
+#ifndef A2J_BENCH
+	#error "a2jlinksim needs A2J_BENCH"
+#endif
+
+#define DEVICE_CMDS(CMD, LCMD)
+DEFINEJT(DEVICE_CMDS)
+
+#define NS_PER_MS 1000000ULL
+/** Return value of #a2jEcho. */
+#define A2J_ECHO_RET 0xBA
+/** Size of the block read by the bulk scenario (wraps around). */
+#define BULK_SIZE 0x40000000UL
+
+/** @name Scenario */
+//@{
+static bool bulk = false;
+static unsigned window = 4;
+static uint8_t payload = 16;
+static uint64_t hostLatency = 0;
+static uint64_t timeout = 200 * NS_PER_MS;
+static uint8_t offEcho, offMany, offBenchMany;
+//@}
+
+/** A request of the host. */
+static struct{
+	bool active;
+	uint32_t offset; /**< bulk: offset of the chunk. */
+	uint64_t sent;
+	uint64_t deadline;
+}pending[256];
+static unsigned inFlight;
+static uint8_t nextSeq;
+static uint32_t nextOffset;
+/** Times the host sends the next requests. */
+static uint64_t sendAt[256];
+static unsigned sendCnt;
+/** Chunks to be requested again. */
+static uint32_t retry[256];
+static unsigned retryCnt;
+
+/** @name Results */
+//@{
+static uint64_t replies, retransmits, badFrames, bytes, latency;
+//@}
+
+/** State of the frame being received. */
+static struct{
+	bool active;
+	bool esc;
+	uint8_t raw[3 + A2J_MAX_PAYLOAD + 1];
+	uint16_t len;
+}rx;
+
+/** Returns the jumptable offset of \a cmd or exits. */
+static uint8_t findCmd(CMD_P cmd, const char* name){
+	for(uint8_t off = 1; off < a2j_jt_elems; off++){
+#if defined(A2J_FMAP) || defined(A2J_JT_FLAGS)
+		if(a2j_jt[off].cmd == cmd)
+#else
+		if(a2j_jt[off] == cmd)
+#endif
+			return off;
+	}
+	fprintf(stderr, "%s is not in the jumptable\n", name);
+	exit(1);
+}
+
+static uint16_t put(uint8_t* buf, uint16_t n, uint8_t c){
+	if(c == A2J_SOF || c == A2J_SOS || c == A2J_ESC){
+		buf[n++] = A2J_ESC;
+		c -= 1;
+	}
+	buf[n++] = c;
+	return n;
+}
+
+/** Sends a new request (or a retransmission) at time \a t. */
+static void sendRequest(uint64_t t){
+	uint8_t data[A2J_MAX_PAYLOAD];
+	uint8_t cmd, len;
+	uint32_t offset = 0;
+	if(bulk){
+		if(retryCnt > 0){
+			offset = retry[--retryCnt];
+		} else {
+			offset = nextOffset;
+			nextOffset = (nextOffset + A2J_MANY_PAYLOAD) % (BULK_SIZE / A2J_MANY_PAYLOAD * A2J_MANY_PAYLOAD);
+		}
+		cmd = offMany;
+		data[0] = offBenchMany;
+		data[1] = 0;
+		memcpy(data + 2, &offset, 4);
+		data[6] = 0;
+		uint32_t size = BULK_SIZE;
+		memcpy(data + 7, &size, 4);
+		len = 11;
+	} else {
+		cmd = offEcho;
+		len = payload;
+		for(uint8_t i = 0; i < len; i++)
+			data[i] = i;
+	}
+
+	while(pending[nextSeq].active)
+		nextSeq++;
+	uint8_t seq = nextSeq++;
+	pending[seq].active = true;
+	pending[seq].offset = offset;
+	pending[seq].sent = t;
+	pending[seq].deadline = t + timeout;
+	inFlight++;
+
+	uint8_t buf[2 * (A2J_MAX_PAYLOAD + 4) + 1];
+	uint16_t n = 0;
+	uint8_t csum = seq ^ (uint8_t)(cmd + A2J_CRC_CMD) ^ (uint8_t)(len + A2J_CRC_LEN);
+	buf[n++] = A2J_SOF;
+	n = put(buf, n, seq);
+	n = put(buf, n, cmd);
+	n = put(buf, n, len);
+	for(uint8_t i = 0; i < len; i++){
+		n = put(buf, n, data[i]);
+		csum ^= data[i];
+	}
+	n = put(buf, n, csum);
+	a2jSimSend(buf, n, t);
+}
+
+/** Ends the request \a seq and schedules the next one. */
+static void finish(uint8_t seq, uint64_t t, bool ok){
+	pending[seq].active = false;
+	inFlight--;
+	if(!ok){
+		retransmits++;
+		if(bulk)
+			retry[retryCnt++] = pending[seq].offset;
+	}
+	sendAt[sendCnt++] = t + hostLatency;
+}
+
+/** Handles a completely received frame in #rx at time \a t. */
+static void frame(uint64_t t){
+	uint8_t seq = rx.raw[0];
+	uint8_t ret = rx.raw[1];
+	uint8_t len = rx.raw[2];
+	uint8_t csum = seq ^ (uint8_t)(ret + A2J_CRC_CMD) ^ (uint8_t)(len + A2J_CRC_LEN);
+	for(uint8_t i = 0; i < len; i++)
+		csum ^= rx.raw[3 + i];
+	if(csum != rx.raw[3 + len]){
+		// the request is retransmitted after its timeout
+		badFrames++;
+		return;
+	}
+	if(!pending[seq].active)
+		return;
+	bool ok;
+	if(bulk)
+		ok = ret == 0 && len > A2J_MANY_HEADER && rx.raw[3] == 0;
+	else
+		ok = ret == A2J_ECHO_RET && len == payload;
+	if(ok){
+		replies++;
+		bytes += bulk ? len - A2J_MANY_HEADER : len;
+		latency += t - pending[seq].sent;
+	}
+	finish(seq, t, ok);
+}
+
+static void hostRx(uint8_t c, uint64_t t){
+	if(rx.esc){
+		c += 1;
+		rx.esc = false;
+	} else if(c == A2J_SOF || c == A2J_SOS){
+		if(rx.active)
+			badFrames++;
+		rx.active = true;
+		rx.len = 0;
+		return;
+	} else if(!rx.active){
+		return;
+	} else if(c == A2J_ESC){
+		rx.esc = true;
+		return;
+	}
+	rx.raw[rx.len++] = c;
+	if(rx.len >= 3 && rx.len == 3 + rx.raw[2] + 1){
+		rx.active = false;
+		frame(t);
+	}
+}
+
+static uint64_t hostStep(uint64_t t){
+	uint64_t next = UINT64_MAX;
+	for(unsigned i = 0; i < 256; i++){
+		if(!pending[i].active)
+			continue;
+		if(pending[i].deadline <= t)
+			finish(i, t, false);
+		else if(pending[i].deadline < next)
+			next = pending[i].deadline;
+	}
+	for(unsigned i = 0; i < sendCnt; ){
+		if(sendAt[i] <= t){
+			sendRequest(t);
+			sendAt[i] = sendAt[--sendCnt];
+		} else {
+			if(sendAt[i] < next)
+				next = sendAt[i];
+			i++;
+		}
+	}
+	return next;
+}
+
+/** Parses a link configuration. @return false if it is malformed */
+static bool parseLink(const char* s, a2j_sim_link* link){
+	unsigned long v[4];
+	int n;
+	if(strncmp(s, "uart:", 5) == 0){
+		n = sscanf(s + 5, "%lu:%lu:%lu", &v[0], &v[1], &v[2]);
+		if(n < 1 || v[0] == 0)
+			return false;
+		link->type = A2J_SIM_UART;
+		link->baud = v[0];
+		link->rxBuf = n > 1 ? v[1] : 64;
+		link->txBuf = n > 2 ? v[2] : 64;
+		return link->rxBuf > 0 && link->txBuf > 0;
+	}
+	if(strncmp(s, "usb:", 4) == 0){
+		n = sscanf(s + 4, "%lu:%lu:%lu:%lu", &v[0], &v[1], &v[2], &v[3]);
+		if(n < 1 || v[0] == 0 || v[0] > 1023)
+			return false;
+		link->type = A2J_SIM_USB;
+		link->epSize = v[0];
+		link->banks = n > 1 ? v[1] : 1;
+		link->perFrame = n > 2 ? v[2] : 19;
+		link->sofAlign = n > 3 ? v[3] : true;
+		return link->banks > 0 && link->perFrame > 0;
+	}
+	return false;
+}
+
+/** Returns the raw bandwidth of \a link in bytes per second and direction. */
+static double rawBandwidth(const a2j_sim_link* link){
+	if(link->type == A2J_SIM_UART)
+		return link->baud / 10.0;
+	return (double)link->epSize * link->perFrame * 1000;
+}
+
+static void usage(const char* name){
+	fprintf(stderr, "usage: %s [-m rpc|bulk] [-w window] [-p payload] [-d duration-ms] [-c cpu-hz] [-b byte-cycles] [-f frame-cycles]\n"
+		"\t[-e ber] [-s seed] [-l host-latency-us] [-t timeout-ms] link...\n"
+		"link: uart:BAUD[:RXBUF[:TXBUF]] or usb:EP[:BANKS[:PACKETS-PER-FRAME[:SOF-ALIGNED]]]\n", name);
+	exit(1);
+}
+
+int main(int argc, char** argv){
+	a2j_sim_link link = {
+		.cpuHz = 16000000,
+		.byteCycles = 60,
+		.frameCycles = 2000,
+	};
+	uint64_t duration = 1000 * NS_PER_MS;
+	int opt;
+	while((opt = getopt(argc, argv, "m:w:p:d:c:b:f:e:s:l:t:")) != -1){
+		switch(opt){
+			case 'm':
+				if(strcmp(optarg, "bulk") == 0)
+					bulk = true;
+				else if(strcmp(optarg, "rpc") != 0)
+					usage(argv[0]);
+				break;
+			case 'w':
+				window = atoi(optarg);
+				if(window < 1 || window > 128)
+					usage(argv[0]);
+				break;
+			case 'p':
+				payload = atoi(optarg);
+				break;
+			case 'd':
+				duration = strtoull(optarg, NULL, 0) * NS_PER_MS;
+				break;
+			case 'c':
+				link.cpuHz = strtoul(optarg, NULL, 0);
+				break;
+			case 'b':
+				link.byteCycles = atoi(optarg);
+				break;
+			case 'f':
+				link.frameCycles = atoi(optarg);
+				break;
+			case 'e':
+				link.ber = atof(optarg);
+				break;
+			case 's':
+				link.seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'l':
+				hostLatency = strtoull(optarg, NULL, 0) * 1000;
+				break;
+			case 't':
+				timeout = strtoull(optarg, NULL, 0) * NS_PER_MS;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(optind >= argc || link.cpuHz == 0)
+		usage(argv[0]);
+
+	offEcho = findCmd(&a2jEcho, "a2jEcho");
+	offMany = findCmd(&a2jMany, "a2jMany");
+	offBenchMany = findCmd((CMD_P)&a2jBenchMany, "a2jBenchMany");
+
+	a2jInit();
+	printf("%-24s %10s %10s %12s %6s %8s %8s %8s\n", "link", "req/s", "lat/us", "bytes/s", "eff%", "retrans", "overrun", "corrupt");
+	for(int i = optind; i < argc; i++){
+		if(!parseLink(argv[i], &link)){
+			fprintf(stderr, "invalid link: %s\n", argv[i]);
+			return 1;
+		}
+		memset(pending, 0, sizeof(pending));
+		memset(&rx, 0, sizeof(rx));
+		inFlight = sendCnt = retryCnt = 0;
+		nextSeq = 0;
+		nextOffset = 0;
+		replies = retransmits = badFrames = bytes = latency = 0;
+		for(unsigned w = 0; w < window; w++)
+			sendAt[sendCnt++] = 0;
+
+		a2j_sim_host host = {.rx = hostRx, .step = hostStep};
+		a2jSimOpen(&link, &host);
+		a2jSimRun(duration);
+
+		const a2j_sim_stats* st = a2jSimStats();
+		double secs = duration / 1e9;
+		double rate = bytes / secs;
+		printf("%-24s %10.0f %10.1f %12.0f %6.1f %8llu %8lu %8lu\n", argv[i],
+			replies / secs, replies ? latency / 1e3 / replies : 0.0, rate, 100 * rate / rawBandwidth(&link),
+			(unsigned long long)retransmits, (unsigned long)st->overruns, (unsigned long)st->corrupted);
+	}
+	return 0;
+}
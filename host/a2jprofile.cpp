@@ -0,0 +1,187 @@
+/** \file
+Drains the samples of the PC-sampling profiler of a device (built with A2J_PROF) into a sample file.
+
+Starts the sampling with #a2jProfile, drains the samples periodically until the duration has elapsed
+or the tool is interrupted, stops the sampling and writes the sample words (2 byte little-endian word addresses,
+without the dropped-samples byte of every chunk) to the sample file, which is symbolized by tools/a2jprof.py.
+The offset of #a2jProfile is looked up in the function mapping (A2J_FMAP, which has to fit into a single frame)
+unless given by -p.
+
+Build e.g. with
+\code
+g++ -std=c++14 -I<j2arduino>/common -o a2jprofile host/a2jprofile.cpp host/a2j_client.cpp
+\endcode
+
+usage: a2jprofile [-b baud] [-p profile-offset] [-d seconds] [-i interval-ms] device samples-file */
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "a2j_client.h"
+#include "j2a_const.h"
+
+/* keep in sync with arduino2j.h */
+static const uint8_t MANY_OFFSET = 1;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int){
+	interrupted = 1;
+}
+
+/** Opens the tty at \a path in raw mode with the termios \a speed (unchanged if 0). */
+static int openTty(const char* path, speed_t speed){
+	int fd = open(path, O_RDWR | O_NOCTTY);
+	if(fd < 0)
+		return -1;
+	struct termios t;
+	if(tcgetattr(fd, &t) == 0){
+		cfmakeraw(&t);
+		if(speed){
+			cfsetispeed(&t, speed);
+			cfsetospeed(&t, speed);
+		}
+		tcsetattr(fd, TCSANOW, &t);
+	}
+	return fd;
+}
+
+/** Maps baud rates to the constants of termios. */
+static speed_t ttySpeed(unsigned long baud){
+	switch(baud){
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 500000: return B500000;
+		case 1000000: return B1000000;
+		default: return 0;
+	}
+}
+
+/** Returns the offset of the function \a name in the function mapping or -1. */
+static int lookup(a2j::Link& link, const char* name){
+	a2j::Frame f;
+	if(link.callSync(0, {}, f) != a2j::Status::Ok || f.isError())
+		return -1;
+	int off = 0;
+	for(size_t i = 0; i < f.data.size(); off++){
+		std::string n(reinterpret_cast<const char*>(&f.data[i]), strnlen(reinterpret_cast<const char*>(&f.data[i]), f.data.size() - i));
+		if(n == name)
+			return off;
+		i += n.size() + 1;
+	}
+	return -1;
+}
+
+/** Calls #a2jProfile via a2jMany and stores the payload following the a2jMany header in \a reply. @return false on errors */
+static bool callProfile(a2j::Link& link, uint8_t off, bool write, const std::vector<uint8_t>& data, std::vector<uint8_t>& reply, bool& isLast){
+	std::vector<uint8_t> req = {off, (uint8_t)(write ? A2J_MANY_ISWRITE_MASK : 0), 0, 0, 0, 0};
+	req.insert(req.end(), data.begin(), data.end());
+	a2j::Frame f;
+	if(link.callSync(MANY_OFFSET, req, f) != a2j::Status::Ok || f.isError() || f.data.size() < A2J_MANY_HEADER || f.data[0] != 0)
+		return false;
+	isLast = f.data[1] & A2J_MANY_ISLAST_MASK;
+	reply.assign(f.data.begin() + A2J_MANY_HEADER, f.data.end());
+	return true;
+}
+
+/** Appends all samples recorded so far to \a samples. @return false on errors */
+static bool drain(a2j::Link& link, uint8_t off, std::vector<uint8_t>& samples, unsigned long& lost){
+	bool isLast = false;
+	while(!isLast){
+		std::vector<uint8_t> reply;
+		if(!callProfile(link, off, false, {}, reply, isLast) || reply.empty())
+			return false;
+		lost += reply[0];
+		samples.insert(samples.end(), reply.begin() + 1, reply.end());
+	}
+	return true;
+}
+
+static void usage(const char* name){
+	fprintf(stderr, "usage: %s [-b baud] [-p profile-offset] [-d seconds] [-i interval-ms] device samples-file\n", name);
+	exit(1);
+}
+
+int main(int argc, char** argv){
+	speed_t speed = 0;
+	int off = -1;
+	double duration = 0;
+	int interval = 20;
+	int opt;
+	while((opt = getopt(argc, argv, "b:p:d:i:")) != -1){
+		switch(opt){
+			case 'b':
+				if((speed = ttySpeed(strtoul(optarg, NULL, 0))) == 0){
+					fprintf(stderr, "unsupported baud rate: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'p':
+				off = atoi(optarg);
+				break;
+			case 'd':
+				duration = atof(optarg);
+				break;
+			case 'i':
+				interval = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(argc - optind != 2)
+		usage(argv[0]);
+
+	int fd = openTty(argv[optind], speed);
+	if(fd < 0){
+		perror(argv[optind]);
+		return 1;
+	}
+	a2j::Loop loop;
+	a2j::Link link(loop, fd);
+	if(off < 0 && (off = lookup(link, "a2jProfile")) < 0){
+		fprintf(stderr, "a2jProfile not found, use -p\n");
+		return 1;
+	}
+
+	std::vector<uint8_t> reply;
+	bool isLast;
+	if(!callProfile(link, off, true, {1}, reply, isLast)){
+		fprintf(stderr, "starting the profiler failed\n");
+		return 1;
+	}
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	std::vector<uint8_t> samples;
+	unsigned long lost = 0;
+	bool ok = true;
+	// the ring buffer holds A2J_PROF_CNT samples only (64 ms at 1 kHz by default), hence the short interval
+	auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(duration);
+	while(ok && !interrupted && (duration <= 0 || std::chrono::steady_clock::now() < end)){
+		loop.runOnce(std::chrono::milliseconds(interval));
+		ok = drain(link, off, samples, lost);
+	}
+	ok = ok && callProfile(link, off, true, {0}, reply, isLast) && drain(link, off, samples, lost);
+	if(!ok)
+		fprintf(stderr, "draining the profiler failed, the samples are incomplete\n");
+
+	FILE* out = fopen(argv[optind + 1], "wb");
+	if(!out || fwrite(samples.data(), 1, samples.size(), out) != samples.size() || fclose(out)){
+		perror(argv[optind + 1]);
+		return 1;
+	}
+	fprintf(stderr, "%zu samples, %lu samples lost\n", samples.size() / 2, lost);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,381 @@
+/** \file
+Replays a captured trace against a host-native arduino2j build.
+
+Spawns the command (e.g. host/a2jdevice built with the options of the firmware in the field),
+writes the bytes of the \ref capturetrace "trace file" to its standard input at the recorded times,
+scaled by the speed factor, and reads the replies from its standard output.
+The requests are found by their start bytes and matched with the replies by their sequence numbers.
+The processing time of a frame is measured from the moment its request has been written completely
+(or the reply to the previous frame has been received, if that was later) until its reply has been received.
+
+For every frame (with -v) and in total the processing times are printed.
+The reply stream is written to the file given by -o, e.g. to compare builds.
+The frame format of the replies (checksum and timestamps) cannot be learned from the trace and has to be given by -x and -t.
+
+usage: a2jreplay [-s speed] [-x] [-t] [-o reply-file] [-v] trace-file command [arguments...]
+
+The speed 1 replays at the recorded rate (default), 10 ten times faster and 0 as fast as possible.
+The exit status is 2 if not all requests have been answered.*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "j2a_const.h"
+
+/* keep in sync with a2j_capture.h and arduino2j.h */
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER 9
+#define STAMPS_LEN 8
+
+/** Time to wait for outstanding replies after the last request, in ms. */
+#define REPLY_TIMEOUT 1000
+
+/** The inbound bytes and the times they were received (in ns since the first one). */
+static uint8_t* bytes;
+static uint64_t* times;
+static size_t count;
+
+/** A request found in the trace. */
+typedef struct{
+	size_t end; /**< Index following the last byte. */
+	uint8_t seq, cmd, len;
+	uint64_t written; /**< Time the request was written completely. */
+	bool answered;
+	uint8_t ret, replyLen;
+	uint64_t proc; /**< Processing time. */
+}request;
+static request* reqs;
+static size_t reqCnt;
+
+/** State of the reply being received. */
+static struct{
+	bool active;
+	bool esc;
+	bool sif;
+	uint8_t raw[3 + A2J_MAX_PAYLOAD + STAMPS_LEN + 2];
+	uint16_t len;
+}rx;
+static size_t csumLen = 1;
+static size_t stampsLen = 0;
+static uint64_t lastReply;
+static size_t replies, sifs, stray, firstOpen;
+static bool verbose = false;
+
+static uint64_t monotonic(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Reads the trace file at \a path. @return false if it is malformed */
+static bool readTrace(const char* path){
+	FILE* f = fopen(path, "rb");
+	if(!f)
+		return false;
+	uint8_t hdr[CAPTURE_HEADER];
+	if(fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || memcmp(hdr, "A2JC", 4) || hdr[4] != CAPTURE_VERSION){
+		fclose(f);
+		return false;
+	}
+	uint32_t hz = hdr[5] | (hdr[6] << 8) | (hdr[7] << 16) | ((uint32_t)hdr[8] << 24);
+	if(hz == 0){
+		fclose(f);
+		return false;
+	}
+
+	size_t cap = 4096;
+	bytes = malloc(cap);
+	times = malloc(cap * sizeof(*times));
+	uint64_t units = 0, delta = 0;
+	unsigned shift = 0;
+	int c;
+	bool inTime = true;
+	while((c = fgetc(f)) != EOF){
+		if(inTime){
+			delta |= (uint64_t)(c & 0x7F) << shift;
+			shift += 7;
+			if(!(c & 0x80))
+				inTime = false;
+			continue;
+		}
+		if(count == cap){
+			cap *= 2;
+			bytes = realloc(bytes, cap);
+			times = realloc(times, cap * sizeof(*times));
+		}
+		units += delta;
+		bytes[count] = c;
+		times[count] = units * 1000000000ULL / hz;
+		count++;
+		delta = 0;
+		shift = 0;
+		inTime = true;
+	}
+	fclose(f);
+	if(count > 0){
+		uint64_t t0 = times[0];
+		for(size_t i = 0; i < count; i++)
+			times[i] -= t0;
+	}
+	return inTime && shift == 0;
+}
+
+/** Splits the inbound bytes into requests at the start bytes. */
+static void findRequests(void){
+	reqs = calloc(count + 1, sizeof(*reqs));
+	size_t start = count;
+	bool esc = false;
+	for(size_t i = 0; i <= count; i++){
+		if(i < count){
+			// the byte following A2J_ESC is never a delimiter
+			bool delim = !esc && bytes[i] == A2J_SOF;
+			esc = !esc && bytes[i] == A2J_ESC;
+			if(!delim)
+				continue;
+		}
+		if(start < count){
+			// de-escape the header
+			uint8_t hdr[3];
+			size_t n = 0;
+			for(size_t j = start + 1; j < i && n < 3; j++){
+				if(bytes[j] == A2J_ESC){
+					if(++j == i)
+						break;
+					hdr[n++] = bytes[j] + 1;
+				} else {
+					hdr[n++] = bytes[j];
+				}
+			}
+			if(n == 3){
+				request* r = &reqs[reqCnt++];
+				r->end = i;
+				r->seq = hdr[0];
+				r->cmd = hdr[1];
+				r->len = hdr[2];
+			}
+		}
+		start = i;
+	}
+}
+
+/** Handles a completely received reply at time \a t. */
+static void reply(uint64_t t){
+	if(rx.sif){
+		sifs++;
+		return;
+	}
+	// the oldest unanswered request with the same sequence number
+	for(size_t i = firstOpen; i < reqCnt; i++){
+		request* r = &reqs[i];
+		if(r->answered || r->written == 0 || r->seq != rx.raw[0])
+			continue;
+		r->answered = true;
+		r->ret = rx.raw[1];
+		r->replyLen = rx.raw[2];
+		uint64_t start = r->written > lastReply ? r->written : lastReply;
+		r->proc = t > start ? t - start : 0;
+		lastReply = t;
+		replies++;
+		while(firstOpen < reqCnt && reqs[firstOpen].answered)
+			firstOpen++;
+		return;
+	}
+	stray++;
+}
+
+static void rxByte(uint8_t c, uint64_t t){
+	if(rx.esc){
+		c += 1;
+		rx.esc = false;
+	} else if(c == A2J_SOF || c == A2J_SOS){
+		rx.active = true;
+		rx.sif = c == A2J_SOS;
+		rx.len = 0;
+		return;
+	} else if(!rx.active){
+		return;
+	} else if(c == A2J_ESC){
+		rx.esc = true;
+		return;
+	}
+	rx.raw[rx.len++] = c;
+	if(rx.len >= 3 && rx.len == 3 + rx.raw[2] + stampsLen + csumLen){
+		rx.active = false;
+		reply(t);
+	}
+}
+
+static int cmpU64(const void* a, const void* b){
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char* name){
+	fprintf(stderr, "usage: %s [-s speed] [-x] [-t] [-o reply-file] [-v] trace-file command [arguments...]\n", name);
+	exit(1);
+}
+
+int main(int argc, char** argv){
+	double speed = 1;
+	const char* outPath = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "+s:xto:v")) != -1){
+		switch(opt){
+			case 's':
+				speed = atof(optarg);
+				break;
+			case 'x':
+				csumLen = 2;
+				break;
+			case 't':
+				stampsLen = STAMPS_LEN;
+				break;
+			case 'o':
+				outPath = optarg;
+				break;
+			case 'v':
+				verbose = true;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(argc - optind < 2 || speed < 0)
+		usage(argv[0]);
+	if(!readTrace(argv[optind])){
+		fprintf(stderr, "%s: not a valid trace file\n", argv[optind]);
+		return 1;
+	}
+	findRequests();
+	FILE* out = NULL;
+	if(outPath && !(out = fopen(outPath, "wb"))){
+		perror(outPath);
+		return 1;
+	}
+
+	int toChild[2], fromChild[2];
+	if(pipe(toChild) || pipe(fromChild)){
+		perror("pipe");
+		return 1;
+	}
+	pid_t pid = fork();
+	if(pid < 0){
+		perror("fork");
+		return 1;
+	}
+	if(pid == 0){
+		dup2(toChild[0], 0);
+		dup2(fromChild[1], 1);
+		close(toChild[0]);
+		close(toChild[1]);
+		close(fromChild[0]);
+		close(fromChild[1]);
+		execvp(argv[optind + 1], argv + optind + 1);
+		perror(argv[optind + 1]);
+		_exit(127);
+	}
+	close(toChild[0]);
+	close(fromChild[1]);
+	signal(SIGPIPE, SIG_IGN);
+	int wfd = toChild[1], rfd = fromChild[0];
+	fcntl(wfd, F_SETFL, O_NONBLOCK);
+
+	uint64_t start = monotonic();
+	size_t written = 0, due = 0, nextReq = 0;
+	uint64_t idleSince = 0;
+	while(rfd >= 0){
+		uint64_t now = monotonic();
+		while(due < count && (speed == 0 || start + times[due] / speed <= now))
+			due++;
+		if(written < due){
+			ssize_t n = write(wfd, bytes + written, due - written);
+			if(n < 0 && errno != EAGAIN && errno != EINTR)
+				break;
+			if(n > 0){
+				written += n;
+				now = monotonic();
+				while(nextReq < reqCnt && reqs[nextReq].end <= written)
+					reqs[nextReq++].written = now;
+			}
+		}
+		if(written == count && wfd >= 0 && (firstOpen == reqCnt || (idleSince && now - idleSince > REPLY_TIMEOUT * 1000000ULL))){
+			// the device exits at the end of its input
+			close(wfd);
+			wfd = -1;
+		}
+
+		int timeout = 100;
+		if(due < count && speed > 0){
+			uint64_t next = start + times[due] / speed;
+			timeout = next > now ? (int)((next - now) / 1000000) : 0;
+		}
+		struct pollfd pfd[2] = {
+			{.fd = rfd, .events = POLLIN},
+			{.fd = written < due ? wfd : -1, .events = POLLOUT},
+		};
+		if(poll(pfd, 2, timeout) < 0 && errno != EINTR)
+			break;
+		if(pfd[0].revents){
+			uint8_t buf[512];
+			ssize_t n = read(rfd, buf, sizeof(buf));
+			if(n <= 0){
+				if(n < 0 && (errno == EINTR || errno == EAGAIN))
+					continue;
+				close(rfd);
+				rfd = -1;
+				break;
+			}
+			now = monotonic();
+			idleSince = now;
+			if(out)
+				fwrite(buf, 1, n, out);
+			for(ssize_t i = 0; i < n; i++)
+				rxByte(buf[i], now);
+		} else if(written == count && !idleSince){
+			idleSince = monotonic();
+		}
+	}
+	if(wfd >= 0)
+		close(wfd);
+	int status;
+	waitpid(pid, &status, 0);
+	uint64_t total = monotonic() - start;
+	if(out)
+		fclose(out);
+
+	uint64_t* procs = malloc((reqCnt + 1) * sizeof(*procs));
+	size_t answered = 0;
+	uint64_t sum = 0;
+	for(size_t i = 0; i < reqCnt; i++){
+		request* r = &reqs[i];
+		if(verbose){
+			printf("%10.3f ms seq %3u cmd %3u len %3u", times[r->end - 1] / 1e6, r->seq, r->cmd, r->len);
+			if(r->answered)
+				printf(" -> ret %3u len %3u %10.1f us\n", r->ret, r->replyLen, r->proc / 1e3);
+			else
+				printf(" -> no reply\n");
+		}
+		if(r->answered){
+			procs[answered++] = r->proc;
+			sum += r->proc;
+		}
+	}
+	printf("%zu bytes, %zu requests, %zu replies, %zu service initiated frames, %zu stray replies, replayed in %.1f ms (recorded %.1f ms)\n",
+		count, reqCnt, replies, sifs, stray, total / 1e6, count ? times[count - 1] / 1e6 : 0.0);
+	if(answered){
+		qsort(procs, answered, sizeof(*procs), cmpU64);
+		printf("processing time/us: mean %.1f, median %.1f, p99 %.1f, max %.1f\n", sum / 1e3 / answered,
+			procs[answered / 2] / 1e3, procs[answered * 99 / 100] / 1e3, procs[answered - 1] / 1e3);
+	}
+	return replies == reqCnt ? 0 : 2;
+}
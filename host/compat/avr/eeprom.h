@@ -0,0 +1,46 @@
+/** \file
+Host replacement of avr-libc's EEPROM access.
+
+The EEPROM is emulated by the array #a2j_host_eeprom (defined by the host low level implementation),
+which is erased (0xFF) at startup.*/
+
+#ifndef A2J_HOST_EEPROM_H
+#define A2J_HOST_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+extern uint8_t a2j_host_eeprom[E2END + 1];
+
+static inline uint8_t eeprom_read_byte(const uint8_t* addr){
+	return a2j_host_eeprom[(uintptr_t)addr];
+}
+
+static inline void eeprom_update_byte(uint8_t* addr, uint8_t val){
+	a2j_host_eeprom[(uintptr_t)addr] = val;
+}
+
+#define eeprom_write_byte eeprom_update_byte
+
+static inline void eeprom_update_word(uint16_t* addr, uint16_t val){
+	a2j_host_eeprom[(uintptr_t)addr] = val & 0xFF;
+	a2j_host_eeprom[(uintptr_t)addr + 1] = val >> 8;
+}
+
+static inline void eeprom_update_dword(uint32_t* addr, uint32_t val){
+	eeprom_update_word((uint16_t*)addr, val & 0xFFFF);
+	eeprom_update_word((uint16_t*)((uintptr_t)addr + 2), val >> 16);
+}
+
+#define eeprom_busy_wait()
+
+static inline void eeprom_read_block(void* dst, const void* src, size_t n){
+	memcpy(dst, &a2j_host_eeprom[(uintptr_t)src], n);
+}
+
+static inline void eeprom_update_block(const void* src, void* dst, size_t n){
+	memcpy(&a2j_host_eeprom[(uintptr_t)dst], src, n);
+}
+
+#endif // A2J_HOST_EEPROM_H
@@ -0,0 +1,10 @@
+/** \file
+Host replacement of avr-libc's interrupt handling. The host build has no interrupts.*/
+
+#ifndef A2J_HOST_INTERRUPT_H
+#define A2J_HOST_INTERRUPT_H
+
+#define sei()
+#define cli()
+
+#endif // A2J_HOST_INTERRUPT_H
@@ -0,0 +1,26 @@
+/** \file
+Host replacement of avr-libc's I/O definitions. The host build has no peripherals.*/
+
+#ifndef A2J_HOST_IO_H
+#define A2J_HOST_IO_H
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+#ifndef F_CPU
+/** Clock of the host build (see #a2jTime in a2j_lowlevel_host.c), i.e. "cycles" are microseconds. */
+#define F_CPU 1000000UL
+#endif
+
+#ifndef E2END
+/** Last address of the emulated EEPROM (see avr/eeprom.h). */
+#define E2END 1023
+#endif
+
+#ifndef SPM_PAGESIZE
+/** Page size of the emulated flash (see #A2J_FW_EXTERN_FLASH). */
+#define SPM_PAGESIZE 128
+#endif
+
+#endif // A2J_HOST_IO_H
@@ -0,0 +1,36 @@
+/** \file
+Host replacement of avr-libc's program space utilities.
+
+On the host flash and RAM share one address space, hence all accessors are plain memory accesses.
+Only the subset used by arduino2j is provided.*/
+
+#ifndef A2J_HOST_PGMSPACE_H
+#define A2J_HOST_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char*
+#define PGM_VOID_P const void*
+
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+/* Keeps the type of the object read, since arduino2j reads pointers (e.g. of the jumptable) by pgm_read_word. */
+#define pgm_read_word(addr) (*(addr))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strncmp_P strncmp
+
+static inline size_t strlcpy_P(char* dst, const char* src, size_t size){
+	size_t len = strlen(src);
+	if(size > 0){
+		size_t n = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+
+#endif // A2J_HOST_PGMSPACE_H
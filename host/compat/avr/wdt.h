@@ -0,0 +1,21 @@
+/** \file
+Host replacement of avr-libc's watchdog.
+Enabling the watchdog ends the process, like the reset it leads to on the device.*/
+
+#ifndef A2J_HOST_WDT_H
+#define A2J_HOST_WDT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WDTO_15MS 0
+
+static inline void wdt_enable(uint8_t timeout){
+	(void)timeout;
+	exit(0);
+}
+
+#define wdt_disable()
+#define wdt_reset()
+
+#endif // A2J_HOST_WDT_H
@@ -0,0 +1,12 @@
+/** \file
+Host replacement of avr-libc's atomic blocks.
+The host build executes everything in one thread without interrupts, hence the blocks are executed as is.*/
+
+#ifndef A2J_HOST_ATOMIC_H
+#define A2J_HOST_ATOMIC_H
+
+#define ATOMIC_FORCEON 0
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) for(int a2j_atomic_once = 1; a2j_atomic_once; a2j_atomic_once = 0)
+
+#endif // A2J_HOST_ATOMIC_H
@@ -0,0 +1,26 @@
+/** \file
+Host replacement of avr-libc's CRC routines (the C equivalents given in its documentation).*/
+
+#ifndef A2J_HOST_CRC16_H
+#define A2J_HOST_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a){
+	crc ^= a;
+	for(int i = 0; i < 8; ++i){
+		if(crc & 1)
+			crc = (crc >> 1) ^ 0xA001;
+		else
+			crc = (crc >> 1);
+	}
+	return crc;
+}
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data){
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+#endif // A2J_HOST_CRC16_H
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Symbolizes samples of the arduino2j PC-sampling profiler (a2jProfile) into a flat profile.
+
+The samples are read from a binary file containing the sample words as returned by a2jProfile
+(2 byte little-endian word addresses, without the leading dropped-samples byte of each chunk),
+as written by host/a2jprofile.cpp.
+The function symbols are taken from the ELF file of the firmware by avr-nm.
+
+usage: a2jprof.py [--nm avr-nm] [--lines] firmware.elf samples.bin
+"""
+
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+
+def read_symbols(nm, elf):
+	"""Returns a sorted list of (address, size, name) of all functions in the ELF file."""
+	out = subprocess.run([nm, "--numeric-sort", "--print-size", "--defined-only", elf],
+			check=True, capture_output=True, text=True).stdout
+	syms = []
+	for line in out.splitlines():
+		f = line.split()
+		if len(f) == 4 and f[2] in "tTwW":
+			syms.append((int(f[0], 16), int(f[1], 16), f[3]))
+		elif len(f) == 3 and f[1] in "tTwW":
+			syms.append((int(f[0], 16), 0, f[2]))
+	syms.sort()
+	return syms
+
+
+def read_samples(path):
+	"""Returns the flash byte addresses of the samples in the file at path."""
+	with open(path, "rb") as f:
+		data = f.read()
+	return [(data[i] | data[i + 1] << 8) * 2 for i in range(0, len(data) - 1, 2)]
+
+
+def symbolize(syms, starts, addr):
+	i = bisect.bisect_right(starts, addr) - 1
+	if i < 0:
+		return "??"
+	start, size, name = syms[i]
+	if size and addr >= start + size:
+		return "??"
+	return name
+
+
+def lines(addr2line, elf, addrs):
+	"""Returns a dict mapping every address in addrs to "file:line"."""
+	addrs = sorted(set(addrs))
+	out = subprocess.run([addr2line, "-e", elf] + ["%x" % a for a in addrs],
+			check=True, capture_output=True, text=True).stdout.splitlines()
+	return dict(zip(addrs, out))
+
+
+def main():
+	ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+	ap.add_argument("--nm", default="avr-nm")
+	ap.add_argument("--addr2line", default="avr-addr2line")
+	ap.add_argument("--lines", action="store_true", help="profile by source line instead of function")
+	ap.add_argument("elf")
+	ap.add_argument("samples")
+	args = ap.parse_args()
+
+	samples = read_samples(args.samples)
+	if not samples:
+		sys.exit("no samples")
+
+	if args.lines:
+		where = lines(args.addr2line, args.elf, samples)
+		counts = collections.Counter(where[a] for a in samples)
+	else:
+		syms = read_symbols(args.nm, args.elf)
+		starts = [s[0] for s in syms]
+		counts = collections.Counter(symbolize(syms, starts, a) for a in samples)
+
+	total = len(samples)
+	print("%8s %7s  %s" % ("samples", "%", "location"))
+	for name, cnt in counts.most_common():
+		print("%8d %6.2f%%  %s" % (cnt, 100.0 * cnt / total, name))
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,586 @@
+/** \file
+Cycle-accurate benchmark of arduino2j under simavr.
+
+Runs an unmodified arduino2j firmware in simavr and drives #a2jProcess over the simulated UART.
+Every scenario sends a number of frames and measures the cycles between the \ref simavrtrace "trace markers"
+written by the firmware, i.e. the cycles spent per frame (from its start byte until #a2jProcess returns),
+in the command itself, and per payload byte.
+The effective throughput (bytes/s) relates the data delivered to the simulated time from sending a request until the
+last byte of its reply. The "samples" scenarios read 16-bit samples (#A2J_BENCH_RAMP) via a2jMany without encoding,
+run-length encoded and delta plus run-length encoded (see #A2J_MANY_RLE_MASK), counting the decoded bytes,
+so the encodings can be compared (they only differ if the firmware is built with A2J_MANY_RLE).
+If the firmware supports #A2J_CSUM_CRC16 (A2J_CRC16), all scenarios are run a second time after switching to it
+by #a2jSetChecksum (suffix "-crc16"), so the cost of both checksums per byte can be compared.
+The results can be compared to a baseline: the tool fails if a scenario got slower than the tolerance allows.
+
+The firmware has to be built for an MCU supported by simavr with
+-DA2J_SERIAL -DA2J_FMAP -DA2J_TIME -DA2J_BENCH -DA2J_SIMAVR (and optionally -DA2J_DBG and -DA2J_MANY_RLE).
+The function mapping has to fit into a single frame (see #a2jGetMapping).
+The tool itself is built against simavr, e.g.:
+\code
+gcc -O2 -I<j2arduino>/common -o a2jsimbench tools/a2jsimbench.c -lsimavr -lelf
+\endcode
+
+usage: a2jsimbench [-n frames] [-g gpior-address] [-b baseline] [-w baseline] [-t tolerance-percent] firmware.elf
+
+The baseline file contains one line per scenario: name, cycles per frame and cycles per byte.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/avr_uart.h>
+#include "j2a_const.h"
+
+/* keep in sync with arduino2j.h */
+#define A2J_TRACE_IDLE 0
+#define A2J_TRACE_RX 1
+#define A2J_TRACE_EXEC 2
+#define A2J_TRACE_TX 3
+#define A2J_BENCH_COUNT 1
+#define A2J_BENCH_ESC 2
+#define A2J_BENCH_RAMP 3
+#define A2J_MANY_RLE_MASK (1 << 3)
+#define A2J_MANY_DELTA_MASK (1 << 4)
+#define A2J_CSUM_XOR 0
+#define A2J_CSUM_CRC16 1
+
+/** Cycles to wait for a reply. */
+#define TIMEOUT_CYCLES 100000000ULL
+
+static avr_t* avr;
+static avr_irq_t* uartIn;
+/** Checksum of the frames, see #a2jSetChecksum. */
+static uint8_t csumMode = A2J_CSUM_XOR;
+
+/** @name Host to device */
+//@{
+static uint8_t txBuf[1024];
+static int txLen, txPos;
+static int xon;
+//@}
+
+/** @name Device to host */
+//@{
+static struct{
+	int state;
+	int esc;
+	uint8_t sof;
+	uint8_t seq;
+	uint8_t ret;
+	uint8_t len;
+	uint8_t pos;
+	uint8_t data[256];
+	uint8_t csumCnt; /**< Checksum bytes still to be received. */
+	int done;
+	avr_cycle_count_t doneCycle; /**< When the last byte of the reply was received. */
+	int bytes; /**< Bytes on the wire. */
+}rx;
+//@}
+
+/** @name Markers of the current frame */
+//@{
+static avr_cycle_count_t mark[4];
+static int marked;
+//@}
+
+/** Statistics of a scenario. */
+typedef struct{
+	const char* name;
+	unsigned frames;
+	double cycles; /**< From the start byte until a2jProcess returns. */
+	double exec; /**< In the command. */
+	double bytes; /**< Payload bytes of requests and replies. */
+	double wall; /**< From sending the request until the last byte of the reply. */
+	double decoded; /**< Data bytes delivered after decoding (if not set, #bytes is used for the throughput). */
+}stats_t;
+
+static void pump(void){
+	while(xon && txPos < txLen)
+		avr_raise_irq(uartIn, txBuf[txPos++]);
+}
+
+static void uartXon(struct avr_irq_t* irq, uint32_t value, void* param){
+	xon = 1;
+	pump();
+}
+
+static void uartXoff(struct avr_irq_t* irq, uint32_t value, void* param){
+	xon = 0;
+}
+
+/** Parses the bytes sent by the device. Only replies (no SIFs) are considered. */
+static void uartOut(struct avr_irq_t* irq, uint32_t value, void* param){
+	uint8_t c = value;
+	rx.bytes++;
+	if(rx.esc){
+		// the byte following A2J_ESC is never a delimiter (an escaped A2J_SOS is sent as A2J_SOF)
+		c += 1;
+		rx.esc = 0;
+	} else if(c == A2J_SOF || c == A2J_SOS){
+		rx.sof = c;
+		rx.state = 1;
+		return;
+	} else if(rx.state == 0){
+		return;
+	} else if(c == A2J_ESC){
+		rx.esc = 1;
+		return;
+	}
+	switch(rx.state){
+		case 1: rx.seq = c; rx.state = 2; break;
+		case 2: rx.ret = c; rx.state = 3; break;
+		case 3:
+			rx.len = c;
+			rx.pos = 0;
+			rx.csumCnt = csumMode == A2J_CSUM_CRC16 ? 2 : 1;
+			rx.state = c ? 4 : 5;
+			break;
+		case 4:
+			rx.data[rx.pos++] = c;
+			if(rx.pos == rx.len)
+				rx.state = 5;
+			break;
+		case 5: // checksum (not verified, the simulated link is error free)
+			if(--rx.csumCnt > 0)
+				break;
+			rx.state = 0;
+			if(rx.sof == A2J_SOF){
+				rx.done = 1;
+				rx.doneCycle = avr->cycle;
+			}
+			break;
+	}
+}
+
+/** Records the trace markers written by the firmware. */
+static void traceWrite(struct avr_t* avr, avr_io_addr_t addr, uint8_t v, void* param){
+	avr->data[addr] = v;
+	if(v < 4){
+		mark[v] = avr->cycle;
+		marked |= 1 << v;
+	}
+}
+
+/** CRC-16-CCITT as computed by _crc_ccitt_update of avr-libc. */
+static uint16_t crcCcitt(uint16_t crc, uint8_t data){
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+/** Checksum of a frame, see a2jCsumStart and a2jCsumAdd in arduino2j.c. */
+static uint16_t checksum(uint8_t seq, uint8_t off, uint8_t len, const uint8_t* data){
+	if(csumMode == A2J_CSUM_CRC16){
+		uint16_t crc = crcCcitt(0xFFFF, seq);
+		crc = crcCcitt(crc, off);
+		crc = crcCcitt(crc, len);
+		for(int i = 0; i < len; i++)
+			crc = crcCcitt(crc, data[i]);
+		return crc;
+	}
+	uint8_t csum = seq ^ (off + A2J_CRC_CMD) ^ (len + A2J_CRC_LEN);
+	for(int i = 0; i < len; i++)
+		csum ^= data[i];
+	return csum;
+}
+
+static void put(uint8_t c){
+	if(c == A2J_SOF || c == A2J_SOS || c == A2J_ESC){
+		txBuf[txLen++] = A2J_ESC;
+		txBuf[txLen++] = c - 1;
+	} else {
+		txBuf[txLen++] = c;
+	}
+}
+
+/** Cycle the last request was sent at. */
+static avr_cycle_count_t sentCycle;
+
+/** Sends a request and runs the simulation until its reply (and the end of #a2jProcess) has been seen.
+@return the return value of the command or -1 on errors */
+static int call(uint8_t off, const uint8_t* data, uint8_t len, uint8_t* reply, uint8_t* replyLen){
+	static uint8_t seq = 0;
+	seq++;
+	txLen = txPos = 0;
+	txBuf[txLen++] = A2J_SOF;
+	put(seq);
+	put(off);
+	put(len);
+	for(int i = 0; i < len; i++)
+		put(data[i]);
+	uint16_t csum = checksum(seq, off, len, data);
+	put(csum & 0xFF);
+	if(csumMode == A2J_CSUM_CRC16)
+		put(csum >> 8);
+
+	rx.done = 0;
+	rx.bytes = 0;
+	marked = 0;
+	sentCycle = avr->cycle;
+	pump();
+	avr_cycle_count_t deadline = avr->cycle + TIMEOUT_CYCLES;
+	while(!(rx.done && rx.seq == seq && (marked & (1 << A2J_TRACE_IDLE)) && mark[A2J_TRACE_IDLE] > mark[A2J_TRACE_TX])){
+		int state = avr_run(avr);
+		if(state == cpu_Done || state == cpu_Crashed){
+			fprintf(stderr, "simulation stopped\n");
+			return -1;
+		}
+		if(avr->cycle > deadline){
+			fprintf(stderr, "timeout waiting for reply to offset %u\n", off);
+			return -1;
+		}
+	}
+	if(reply != NULL){
+		memcpy(reply, rx.data, rx.len);
+		*replyLen = rx.len;
+	}
+	return rx.ret;
+}
+
+/** Calls the function at \a off and adds the measurement to \a st.
+The reply is stored at \a reply (256 bytes) if not NULL. */
+static int measure(stats_t* st, uint8_t off, const uint8_t* data, uint8_t len, uint8_t* reply, uint8_t* replyLen){
+	uint8_t buf[256];
+	uint8_t bufLen;
+	if(reply == NULL){
+		reply = buf;
+		replyLen = &bufLen;
+	}
+	int ret = call(off, data, len, reply, replyLen);
+	if(ret < 0)
+		return -1;
+	if((marked & 0x0F) != 0x0F){
+		fprintf(stderr, "%s: trace markers missing, firmware built without A2J_SIMAVR?\n", st->name);
+		return -1;
+	}
+	st->frames++;
+	st->cycles += mark[A2J_TRACE_IDLE] - mark[A2J_TRACE_RX];
+	st->exec += mark[A2J_TRACE_TX] - mark[A2J_TRACE_EXEC];
+	st->bytes += len + *replyLen;
+	st->wall += rx.doneCycle - sentCycle;
+	return ret;
+}
+
+/** Offsets of the functions used, resolved by a2jGetMapping. */
+static int offMany, offEcho, offSink, offSource, offBenchMany, offDebug, offCsum;
+
+static int resolve(void){
+	uint8_t map[256];
+	uint8_t len;
+	if(call(0, NULL, 0, map, &len) != 0){
+		fprintf(stderr, "function mapping does not fit into a frame, build the firmware with fewer options\n");
+		return -1;
+	}
+	offMany = offEcho = offSink = offSource = offBenchMany = offDebug = offCsum = -1;
+	int off = 0;
+	for(int i = 0; i < len; off++){
+		const char* name = (const char*)map + i;
+		if(!strcmp(name, "a2jMany")) offMany = off;
+		else if(!strcmp(name, "a2jEcho")) offEcho = off;
+		else if(!strcmp(name, "a2jBenchSink")) offSink = off;
+		else if(!strcmp(name, "a2jBenchSource")) offSource = off;
+		else if(!strcmp(name, "a2jBenchMany")) offBenchMany = off;
+		else if(!strcmp(name, "a2jDebug")) offDebug = off;
+		else if(!strcmp(name, "a2jSetChecksum")) offCsum = off;
+		i += strlen(name) + 1;
+	}
+	if(offMany < 0 || offEcho < 0 || offSink < 0 || offSource < 0 || offBenchMany < 0){
+		fprintf(stderr, "benchmark functions missing, firmware built without A2J_BENCH?\n");
+		return -1;
+	}
+	return 0;
+}
+
+/** @name Scenarios */
+//@{
+static int benchRpc(stats_t* st, unsigned n){
+	uint8_t data[4] = {1, 2, 3, 4};
+	for(unsigned i = 0; i < n; i++){
+		if(measure(st, offEcho, data, sizeof(data), NULL, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int benchBulk(stats_t* st, unsigned n){
+	uint32_t size = n * A2J_MANY_PAYLOAD;
+	for(uint32_t offset = 0; offset < size; offset += A2J_MANY_PAYLOAD){
+		uint8_t req[A2J_MANY_HEADER + 5] = {offBenchMany, 0};
+		for(int i = 0; i < 4; i++){
+			req[2 + i] = offset >> (8 * i);
+			req[A2J_MANY_HEADER + 1 + i] = size >> (8 * i);
+		}
+		req[A2J_MANY_HEADER] = A2J_BENCH_COUNT;
+		if(measure(st, offMany, req, sizeof(req), NULL, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/** Decodes the data of the a2jMany reply \a reply of \a len bytes into \a out (up to #A2J_MANY_PAYLOAD bytes, see #A2J_MANY_RLE_MASK).
+@return the length of the decoded data or -1 if it is malformed */
+static int manyDecode(const uint8_t* reply, uint8_t len, uint8_t* out){
+	if(len < A2J_MANY_HEADER)
+		return -1;
+	uint8_t flags = reply[1];
+	int n = 0;
+	int i = A2J_MANY_HEADER;
+	if(flags & A2J_MANY_RLE_MASK){
+		while(i < len){
+			uint8_t ctrl = reply[i++];
+			int cnt = ctrl < 0x80 ? ctrl + 1 : 1;
+			int run = ctrl < 0x80 ? cnt : ctrl - 0x80 + 3;
+			if(i + cnt > len || n + run > A2J_MANY_PAYLOAD)
+				return -1;
+			if(ctrl < 0x80){
+				memcpy(out + n, reply + i, cnt);
+				n += cnt;
+			} else {
+				memset(out + n, reply[i], run);
+				n += run;
+			}
+			i += cnt;
+		}
+	} else {
+		n = len - i;
+		memcpy(out, reply + i, n);
+	}
+	if(flags & A2J_MANY_DELTA_MASK){
+		if(n & 1)
+			return -1;
+		for(int k = 2; k < n; k += 2){
+			uint16_t w = (out[k] | (out[k + 1] << 8)) + (out[k - 2] | (out[k - 1] << 8));
+			out[k] = w;
+			out[k + 1] = w >> 8;
+		}
+	}
+	return n;
+}
+
+/** Reads \a n chunks of #A2J_BENCH_RAMP requesting the encodings \a enc and verifies the decoded samples. */
+static int benchSamplesEnc(stats_t* st, unsigned n, uint8_t enc){
+	const uint32_t chunk = A2J_MANY_PAYLOAD & ~1;
+	uint32_t size = n * chunk;
+	for(uint32_t offset = 0; offset < size; offset += chunk){
+		uint8_t req[A2J_MANY_HEADER + 5] = {offBenchMany, enc};
+		for(int i = 0; i < 4; i++){
+			req[2 + i] = offset >> (8 * i);
+			req[A2J_MANY_HEADER + 1 + i] = size >> (8 * i);
+		}
+		req[A2J_MANY_HEADER] = A2J_BENCH_RAMP;
+		uint8_t reply[256];
+		uint8_t replyLen;
+		uint8_t data[A2J_MANY_PAYLOAD];
+		if(measure(st, offMany, req, sizeof(req), reply, &replyLen) < 0)
+			return -1;
+		int len = manyDecode(reply, replyLen, data);
+		if(len != (int)chunk){
+			fprintf(stderr, "%s: malformed reply at offset %u\n", st->name, (unsigned)offset);
+			return -1;
+		}
+		for(int i = 0; i < len; i += 2){
+			uint16_t sample = 1000 + (uint16_t)((offset + i) / 16) * 3;
+			if(data[i] != (sample & 0xFF) || data[i + 1] != sample >> 8){
+				fprintf(stderr, "%s: wrong sample at offset %u\n", st->name, (unsigned)(offset + i));
+				return -1;
+			}
+		}
+		st->decoded += len;
+	}
+	return 0;
+}
+
+static int benchSamples(stats_t* st, unsigned n){
+	return benchSamplesEnc(st, n, 0);
+}
+
+static int benchSamplesRle(stats_t* st, unsigned n){
+	return benchSamplesEnc(st, n, A2J_MANY_RLE_MASK);
+}
+
+static int benchSamplesDelta(stats_t* st, unsigned n){
+	return benchSamplesEnc(st, n, A2J_MANY_RLE_MASK | A2J_MANY_DELTA_MASK);
+}
+
+static int benchEscape(stats_t* st, unsigned n){
+	uint8_t req[2] = {A2J_BENCH_ESC, 200};
+	for(unsigned i = 0; i < n; i++){
+		if(measure(st, offSource, req, sizeof(req), NULL, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int benchUpload(stats_t* st, unsigned n){
+	uint8_t data[200];
+	for(unsigned i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	for(unsigned i = 0; i < n; i++){
+		if(measure(st, offSink, data, sizeof(data), NULL, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int benchDebug(stats_t* st, unsigned n){
+	for(unsigned i = 0; i < n; i++){
+		if(measure(st, offDebug, NULL, 0, NULL, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+//@}
+
+/** Switches the device and the tool to the checksum \a mode. @return 0 on success */
+static int setChecksum(uint8_t mode){
+	// the reply is still sent with the previous checksum, but requests selecting XOR are always protected by XOR
+	if(mode == A2J_CSUM_XOR)
+		csumMode = mode;
+	if(call(offCsum, &mode, 1, NULL, NULL) != 0){
+		fprintf(stderr, "switching the checksum failed\n");
+		return -1;
+	}
+	csumMode = mode;
+	return 0;
+}
+
+/** Compares \a st to the baseline in \a path.
+@return 1 if the scenario regressed */
+static int compare(const char* path, const stats_t* st, double tolerance){
+	FILE* f = fopen(path, "r");
+	if(f == NULL)
+		return 0;
+	char name[64];
+	double frame, byte;
+	int regressed = 0;
+	while(fscanf(f, "%63s %lf %lf", name, &frame, &byte) == 3){
+		if(strcmp(name, st->name))
+			continue;
+		double curFrame = st->cycles / st->frames;
+		double curByte = st->bytes ? st->cycles / st->bytes : 0;
+		if(curFrame > frame * (1 + tolerance / 100) || curByte > byte * (1 + tolerance / 100)){
+			printf("REGRESSION %s: %.0f cycles/frame (baseline %.0f), %.1f cycles/byte (baseline %.1f)\n",
+					st->name, curFrame, frame, curByte, byte);
+			regressed = 1;
+		}
+	}
+	fclose(f);
+	return regressed;
+}
+
+int main(int argc, char** argv){
+	unsigned n = 32;
+	unsigned gpior = 0x3E; // GPIOR0 on most ATmegas
+	const char* baseline = NULL;
+	const char* writeBaseline = NULL;
+	double tolerance = 2;
+	int opt;
+	while((opt = getopt(argc, argv, "n:g:b:w:t:")) != -1){
+		switch(opt){
+			case 'n': n = strtoul(optarg, NULL, 0); break;
+			case 'g': gpior = strtoul(optarg, NULL, 0); break;
+			case 'b': baseline = optarg; break;
+			case 'w': writeBaseline = optarg; break;
+			case 't': tolerance = strtod(optarg, NULL); break;
+			default:
+				fprintf(stderr, "usage: %s [-n frames] [-g gpior-address] [-b baseline] [-w baseline] [-t tolerance-percent] firmware.elf\n", argv[0]);
+				return 2;
+		}
+	}
+	if(optind >= argc){
+		fprintf(stderr, "firmware missing\n");
+		return 2;
+	}
+
+	elf_firmware_t fw;
+	memset(&fw, 0, sizeof(fw));
+	if(elf_read_firmware(argv[optind], &fw)){
+		fprintf(stderr, "cannot read %s\n", argv[optind]);
+		return 2;
+	}
+	avr = avr_make_mcu_by_name(fw.mmcu);
+	if(avr == NULL){
+		fprintf(stderr, "unknown MCU '%s' (AVR_MCU section missing?)\n", fw.mmcu);
+		return 2;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &fw);
+
+	uint32_t flags = 0;
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	uartIn = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), uartOut, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON), uartXon, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF), uartXoff, NULL);
+	avr_register_io_write(avr, gpior, traceWrite, NULL);
+
+	if(resolve())
+		return 1;
+
+	static const struct{
+		const char* name;
+		int (*run)(stats_t*, unsigned);
+	}scenarios[] = {
+		{"rpc", benchRpc},
+		{"bulk", benchBulk},
+		{"escape", benchEscape},
+		{"upload", benchUpload},
+		{"debug", benchDebug},
+		{"samples", benchSamples},
+		{"samples-rle", benchSamplesRle},
+		{"samples-delta", benchSamplesDelta},
+	};
+	// checksums the scenarios are run with and the suffixes of their names
+	static const struct{
+		uint8_t mode;
+		const char* suffix;
+	}modes[] = {
+		{A2J_CSUM_XOR, ""},
+		{A2J_CSUM_CRC16, "-crc16"},
+	};
+
+	FILE* out = NULL;
+	if(writeBaseline != NULL && (out = fopen(writeBaseline, "w")) == NULL){
+		fprintf(stderr, "cannot write %s\n", writeBaseline);
+		return 2;
+	}
+	int regressed = 0;
+	printf("%-20s %8s %12s %12s %12s %12s\n", "scenario", "frames", "cycles/frame", "exec/frame", "cycles/byte", "bytes/s");
+	for(unsigned m = 0; m < sizeof(modes) / sizeof(modes[0]); m++){
+		if(modes[m].mode != csumMode){
+			if(offCsum < 0){
+				printf("(CRC-16 not measured, firmware built without A2J_CRC16)\n");
+				continue;
+			}
+			if(setChecksum(modes[m].mode))
+				return 1;
+		}
+		for(unsigned i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++){
+			char name[32];
+			snprintf(name, sizeof(name), "%s%s", scenarios[i].name, modes[m].suffix);
+			stats_t st = {.name = name};
+			if(scenarios[i].run == benchDebug && offDebug < 0)
+				continue;
+			if(scenarios[i].run(&st, n))
+				return 1;
+			double perByte = st.bytes ? st.cycles / st.bytes : 0;
+			double perSec = (st.decoded ? st.decoded : st.bytes) * avr->frequency / st.wall;
+			printf("%-20s %8u %12.0f %12.0f %12.1f %12.0f\n", st.name, st.frames,
+					st.cycles / st.frames, st.exec / st.frames, perByte, perSec);
+			if(out != NULL)
+				fprintf(out, "%s %.0f %.1f\n", st.name, st.cycles / st.frames, perByte);
+			if(baseline != NULL)
+				regressed |= compare(baseline, &st, tolerance);
+		}
+	}
+	if(out != NULL)
+		fclose(out);
+	return regressed;
+}